@@ -25,6 +25,10 @@
 // ex Fil pilote 1 : /chemin vers le script/etatFP.php 1
 // =========================================================================
 
+// Adresse de la carte sur le réseau local (ex: 192.168.1.50 ou 192.168.1.50:8080
+// pour l'ESP8266), laisser vide pour passer par le cloud :
+$REMORA_IP = "";
+
 // Plus rien a modifier en dessous de cette ligne.
 
 require_once dirname(__FILE__) . '/../../../../core/php/core.inc.php';  
@@ -42,7 +46,10 @@ $fp = $fp-1;
 
 //initialisation de la requete :
 //URL of targeted site  
-$url = "https://api.spark.io/v1/devices/$core/etatfp?access_token=$token";  
+if ($REMORA_IP != "")
+  $url = "http://$REMORA_IP/fp";
+else
+  $url = "https://api.spark.io/v1/devices/$core/etatfp?access_token=$token";  
 $ch = curl_init();  
 
 // set URL and other appropriate options  
@@ -59,8 +66,11 @@ curl_close($ch);
 //On décode la trame JSON 
 $obj = json_decode($output);
 
-//Les infos que l'on cherche sont dans le champ result
-$etatfp = $obj->{'result'};
+//Les infos que l'on cherche sont dans le champ result, etatfp pour l'API locale
+if ($REMORA_IP != "")
+  $etatfp = $obj->{'etatfp'};
+else
+  $etatfp = $obj->{'result'};
 $etatfp = substr($etatfp,$fp,1); 
 
 // Compatibilité native Jeedom avec retour numerique :
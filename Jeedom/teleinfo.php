@@ -37,6 +37,9 @@ require_once dirname(__FILE__) . '/../../../../core/php/core.inc.php';
 $IP = "localhost:80";
 // votre clé API jeedom :
 $API= "xxxxxxxxxxxxxxxxxxx";
+// Adresse de la carte sur le réseau local (ex: 192.168.1.50 ou 192.168.1.50:8080
+// pour l'ESP8266), laisser vide pour passer par le cloud :
+$REMORA_IP = "";
 
 // Plus rien à toucher en dessous de cette ligne.
 // Declaration des variables :
@@ -46,8 +49,11 @@ $token = scenario::getData("SPARK_TOKEN");
 // Let's go !!! 
 
 //initialisation de la requete :
-//On forge l'URL de notre sprk core :  
-$url = "https://api.spark.io/v1/devices/$core/tinfo?access_token=$token";  
+//On forge l'URL de notre sprk core, ou de l'API locale de la carte :  
+if ($REMORA_IP != "")
+  $url = "http://$REMORA_IP/tinfo";
+else
+  $url = "https://api.spark.io/v1/devices/$core/tinfo?access_token=$token";  
 $ch = curl_init();  
 
 // set URL and other appropriate options  
@@ -66,7 +72,11 @@ $obj = json_decode($output);
 
 //Les infos que l'on cherche sont dans le champ recherche, on décode a nouveau
 // TODO : voir comment rendre le json plus propre et ne pas avoir besoin de décoder en 2 passes 
-$json = $obj->{'result'};
+//L'API locale renvoie directement la variable tinfo
+if ($REMORA_IP != "")
+  $json = $output;
+else
+  $json = $obj->{'result'};
 
 //On parse les infos utiles :
 $tinfo = json_decode($json);
@@ -0,0 +1,225 @@
+// **********************************************************************************
+// Test du journal en flash de remora sur PC
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Vérifie flashlog.cpp avec la flash simulée en RAM (FLASHLOG_SIM) :
+//           reprise au redémarrage, coupure pendant une écriture, rotation
+//           des secteurs et lecture à partir d'un numéro de séquence
+//
+// Compilation : g++ -DFLASHLOG_SIM -o flashlog_test flashlog_test.cpp ../remora/flashlog.cpp
+// Utilisation : ./flashlog_test, code de retour 0 si tous les tests passent
+//
+// **********************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include "../remora/flashlog.h"
+
+// Enregistrements utiles d'un secteur, son entête occupe le premier emplacement
+#define SECTOR_RECS  (FLASHLOG_SLOTS - 1)
+
+int failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("  ECHEC ligne %d : %s\n", __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+/* ======================================================================
+Function: append
+Purpose : ajoute des enregistrements FP dont les données suivent seq
+Input   : nombre d'enregistrements
+Output  : nombre d'ajouts réussis
+Comments: data[0..3] = numéro de séquence attendu, pour vérifier la relecture
+====================================================================== */
+uint32_t append(uint32_t nb)
+{
+  uint32_t ok = 0;
+  uint32_t seq;
+
+  while (nb--) {
+    seq = flashlog_seq();
+    if (flashlog_append(FLASHLOG_FP, &seq, sizeof(seq)))
+      ok++;
+  }
+  return ok;
+}
+
+/* ======================================================================
+Function: scan
+Purpose : relit le journal à partir d'un numéro de séquence
+Input   : premier numéro voulu
+          premier et dernier numéros lus
+Output  : nombre d'enregistrements lus, -1 si la suite n'est pas continue
+          ou si les données ne correspondent pas au numéro
+Comments: -
+====================================================================== */
+long scan(uint32_t from, uint32_t * first, uint32_t * last)
+{
+  flashlog_cursor_t cur;
+  flashlog_rec_t rec;
+  uint32_t data;
+  long nb = 0;
+
+  *first = *last = 0;
+  flashlog_rewind(&cur, from);
+
+  while (flashlog_next(&cur, &rec)) {
+    memcpy(&data, rec.data, sizeof(data));
+    if (rec.type != FLASHLOG_FP || data != rec.seq)
+      return -1;
+    if (nb && rec.seq != *last + 1)
+      return -1;
+    if (!nb)
+      *first = rec.seq;
+    *last = rec.seq;
+    nb++;
+  }
+  return nb;
+}
+
+void test_reboot(void)
+{
+  uint32_t first, last;
+
+  printf("Redemarrage\n");
+
+  CHECK(flashlog_setup());
+  CHECK(flashlog_seq() == 1);
+  CHECK(scan(0, &first, &last) == 0);
+
+  // Un peu plus d'un secteur, puis redémarrage
+  CHECK(append(SECTOR_RECS + 10) == SECTOR_RECS + 10);
+  CHECK(flashlog_setup());
+  CHECK(flashlog_seq() == SECTOR_RECS + 11);
+  CHECK(scan(0, &first, &last) == SECTOR_RECS + 10);
+  CHECK(first == 1 && last == SECTOR_RECS + 10);
+
+  // On continue à la suite
+  CHECK(append(5) == 5);
+  CHECK(scan(0, &first, &last) == SECTOR_RECS + 15);
+  CHECK(last == SECTOR_RECS + 15);
+}
+
+void test_power_cut(void)
+{
+  uint32_t first, last, seq;
+  flashlog_cursor_t cur;
+  flashlog_rec_t rec;
+  long nb;
+
+  printf("Coupure pendant une ecriture\n");
+
+  nb = scan(0, &first, &last);
+  seq = flashlog_seq();
+
+  // Seuls les 10 premiers octets sont écrits : seq et crc, mais pas les données
+  flashlog_sim_power_cut(10);
+  append(1);
+
+  // Au redémarrage l'enregistrement coupé est ignoré et son numéro repris
+  CHECK(flashlog_setup());
+  CHECK(flashlog_seq() == seq);
+  CHECK(scan(0, &first, &last) == nb);
+  CHECK(last == seq - 1);
+
+  CHECK(append(3) == 3);
+  CHECK(scan(0, &first, &last) == nb + 3);
+  CHECK(last == seq + 2);
+
+  // L'enregistrement coupé reste en flash sans jamais être relu
+  flashlog_rewind(&cur, seq);
+  CHECK(flashlog_next(&cur, &rec) && rec.seq == seq && rec.len == sizeof(uint32_t));
+}
+
+void test_wrap(void)
+{
+  uint32_t first, last, min, max, n;
+  long capacity = (long) FLASHLOG_SIM_SECTORS * SECTOR_RECS;
+
+  printf("Rotation des secteurs\n");
+
+  // Plusieurs tours complets de la flash
+  CHECK(append(3 * capacity + 17) == 3 * capacity + 17);
+
+  // Le secteur en cours et les secteurs plus anciens, moins celui
+  // qui vient d'être effacé pour la place
+  CHECK(scan(0, &first, &last) >= capacity - 2 * SECTOR_RECS);
+  CHECK(last == flashlog_seq() - 1);
+  CHECK(first > 1);
+
+  // Même résultat après un redémarrage
+  n = flashlog_seq();
+  CHECK(flashlog_setup());
+  CHECK(flashlog_seq() == n);
+  CHECK(scan(0, &first, &last) >= capacity - 2 * SECTOR_RECS);
+  CHECK(last == n - 1);
+
+  // Usure répartie
+  min = max = flashlog_sim_erase_count(0);
+  for (uint16_t s=1; s<FLASHLOG_SIM_SECTORS; s++) {
+    n = flashlog_sim_erase_count(s);
+    if (n < min) min = n;
+    if (n > max) max = n;
+  }
+  CHECK(max - min <= 1);
+}
+
+void test_from(void)
+{
+  uint32_t first, last, oldest, newest, from;
+  long all;
+
+  printf("Lecture a partir d'un numero\n");
+
+  all = scan(0, &oldest, &newest);
+  CHECK(all > 0);
+
+  // Au milieu, dans différents secteurs et en limite de secteur
+  for (from = oldest; from <= newest; from += SECTOR_RECS / 3) {
+    CHECK(scan(from, &first, &last) == (long) (newest - from + 1));
+    CHECK(first == from && last == newest);
+  }
+  CHECK(scan(newest, &first, &last) == 1 && first == newest);
+
+  // Avant le plus ancien : tout, après le plus récent : rien
+  CHECK(scan(1, &first, &last) == all && first == oldest);
+  CHECK(scan(newest + 1, &first, &last) == 0);
+}
+
+void test_format(void)
+{
+  flashlog_cursor_t cur;
+  flashlog_rec_t rec;
+  char buff[128];
+  int len;
+
+  printf("Formatage\n");
+
+  flashlog_rewind(&cur, 0);
+  CHECK(flashlog_next(&cur, &rec));
+
+  len = flashlog_format(buff, sizeof(buff), &rec);
+  CHECK(len > 0 && len == (int) strlen(buff) && buff[len-1] == '\n');
+
+  // Trop petit, rien n'est compté
+  CHECK(flashlog_format(buff, len, &rec) == 0);
+  CHECK(flashlog_format(buff, len + 1, &rec) == len);
+}
+
+int main(void)
+{
+  test_reboot();
+  test_power_cut();
+  test_wrap();
+  test_from();
+  test_format();
+
+  printf(failures ? "%d echec(s)\n" : "OK\n", failures);
+  return failures ? 1 : 0;
+}
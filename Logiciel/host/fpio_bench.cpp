@@ -0,0 +1,170 @@
+// **********************************************************************************
+// Mesure des écritures des sorties fils pilotes de remora sur PC
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Fait passer par FpMockIO (fpio.h, FPIO_HOST) les écritures que
+//           pilotes.cpp fait pour une commande multi-zones (fp_apply), des
+//           ordres zone par zone (setfp) et une heure de Confort-1/-2
+//           (updateFPWave), et compare les écritures de broche aux
+//           transactions sur le bus I2C des MCP23017
+//
+// Compilation : g++ -DFPIO_HOST -o fpio_bench fpio_bench.cpp
+//               g++ -DFPIO_HOST -DMCP_NB=4 -o fpio_bench fpio_bench.cpp
+// Utilisation : ./fpio_bench
+//
+// **********************************************************************************
+
+#include <stdio.h>
+#include "../remora/fpio.h"
+
+#define LOW  0
+#define HIGH 1
+
+// Comme pilotes.h
+#define FP_CONFORT_PERIOD  300000UL
+#define FP_CONFORT1_HIGH     3000UL
+#define FP_EDGE_TOLERANCE      20
+#define FP_STAGGER         (FP_CONFORT_PERIOD/NB_FILS_PILOTES)
+
+// Une écriture writeGPIOAB : adresse, registre et 2 octets, 9 bits par
+// octet avec l'acquittement, à 100 kHz
+#define I2C_US_PER_WRITE   (4 * 9 * 10)
+
+// Lecture puis écriture d'OLAT par Adafruit_MCP23017::digitalWrite,
+// ce que faisait chaque écriture de broche avant l'image des ports
+#define BUS_PER_PIN_DIRECT 2
+
+// Comme pilotes.cpp
+void fpWrite(uint8_t i, uint8_t levelA, uint8_t levelB)
+{
+  FpIO::pinWrite(fpZoneExp(i), fpZonePinA(i), levelA);
+  FpIO::pinWrite(fpZoneExp(i), fpZonePinB(i), levelB);
+}
+
+// Niveaux des 2 sorties pour un ordre, comme setfp_interne
+void fpOrder(uint8_t i, char ordre)
+{
+  switch (ordre) {
+    case 'E': fpWrite(i, HIGH, HIGH); break;
+    case 'H':
+    case 'D': fpWrite(i, HIGH, LOW);  break;
+    case 'A': fpWrite(i, LOW,  HIGH); break;
+    default:  fpWrite(i, LOW,  LOW);  break; // C, 1, 2
+  }
+}
+
+/* ======================================================================
+Function: report
+Purpose : affiche les compteurs d'un scénario et les remet à zéro
+Input   : nom du scénario
+Output  : -
+Comments: -
+====================================================================== */
+void report(const char * name)
+{
+  uint32_t pins = FpIO::log::pinWrites;
+  uint32_t bus  = FpIO::log::busWrites;
+
+  printf("%-32s broches:%6u  bus:%6u  sans image:%6u  bus %5.1f ms\n",
+         name, (unsigned) pins, (unsigned) bus, (unsigned) (pins * BUS_PER_PIN_DIRECT),
+         bus * I2C_US_PER_WRITE / 1000.0);
+  FpIO::log::reset();
+}
+
+/* ======================================================================
+Function: orders
+Purpose : applique un ordre à toutes les zones
+Input   : ordre, true pour une mise à jour groupée comme fp_apply
+Output  : -
+Comments: sans groupement c'est une commande setfp par zone
+====================================================================== */
+void orders(char ordre, bool batch)
+{
+  if (batch)
+    FpIO::batchBegin();
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++)
+    fpOrder(i, ordre);
+  if (batch)
+    FpIO::batchEnd();
+}
+
+/* ======================================================================
+Function: wave
+Purpose : une heure de Confort-1 sur toutes les zones
+Input   : -
+Output  : -
+Comments: les zones sont décalées de FP_STAGGER comme dans fpWaveStart,
+          les fronts à moins de FP_EDGE_TOLERANCE sont groupés comme
+          dans updateFPWave
+====================================================================== */
+void wave(void)
+{
+  unsigned long edge[NB_FILS_PILOTES];
+  bool high[NB_FILS_PILOTES];
+  unsigned long now, next;
+  bool batch;
+
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    edge[i] = i * FP_STAGGER;
+    high[i] = false;
+  }
+
+  for (now = 0; now < 3600000UL; now = next) {
+    batch = false;
+    for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+      if ((long) (edge[i] - now) > FP_EDGE_TOLERANCE)
+        continue;
+      if (!batch) {
+        FpIO::batchBegin();
+        batch = true;
+      }
+      high[i] = !high[i];
+      edge[i] += high[i] ? FP_CONFORT1_HIGH : FP_CONFORT_PERIOD - FP_CONFORT1_HIGH;
+      fpWrite(i, high[i], high[i]);
+    }
+    if (batch)
+      FpIO::batchEnd();
+
+    // Prochain front, comme le timer armé par fpWaveArm
+    next = edge[0];
+    for (uint8_t i=1; i<NB_FILS_PILOTES; i++)
+      if ((long) (edge[i] - next) < 0)
+        next = edge[i];
+  }
+}
+
+int main(void)
+{
+  printf("%d zones, %d expander(s)\n", NB_FILS_PILOTES, MCP_NB);
+
+  FpIO::begin();
+  orders('H', false);
+  FpIO::log::reset();
+
+  orders('C', true);
+  report("fp CCC... (fp_apply)");
+
+  orders('E', false);
+  report("setfp zone par zone");
+
+  // Même ordre une 2e fois, l'image évite le bus
+  orders('E', true);
+  report("fp EEE... deja en place");
+
+  for (uint8_t n=0; n<25; n++) {
+    orders('C', true);
+    orders('E', true);
+    orders('H', true);
+    orders('A', true);
+  }
+  report("100 commandes multi-zones");
+
+  orders('C', true);
+  FpIO::log::reset();
+  wave();
+  report("1 h de Confort-1");
+
+  return 0;
+}
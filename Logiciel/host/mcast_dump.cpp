@@ -0,0 +1,36 @@
+// **********************************************************************************
+// Affiche les trames téléinfo diffusées en multicast par remora
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Exemple d'utilisation de mcast_rx
+//
+// Compilation : g++ -o mcast_dump mcast_dump.cpp mcast_rx.cpp
+// Utilisation : ./mcast_dump [adresse IP de l'interface]
+//
+// **********************************************************************************
+
+#include <stdio.h>
+#include "mcast_rx.h"
+
+int main(int argc, char * argv[])
+{
+  mcast_rx_t rx;
+  char frame[MCAST_RX_FRAME + 1];
+
+  if (mcast_rx_open(&rx, argc > 1 ? argv[1] : NULL) < 0) {
+    perror("mcast_rx_open");
+    return 1;
+  }
+
+  while (mcast_rx_read(&rx, frame, sizeof(frame)) >= 0) {
+    printf("# trame %u (recues %u, perdues %u, redemarrages %u)\n%s",
+           rx.last, rx.frames, rx.lost, rx.restarts, frame);
+    fflush(stdout);
+  }
+
+  perror("mcast_rx_read");
+  mcast_rx_close(&rx);
+  return 1;
+}
@@ -0,0 +1,192 @@
+// **********************************************************************************
+// Réception des trames téléinfo diffusées en multicast par remora
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Librairie PC (Linux, macOS) qui rejoint le groupe multicast de la
+//           carte, réassemble les trames fragmentées et compte les trames
+//           perdues à partir des numéros de séquence
+//
+// **********************************************************************************
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "mcast_rx.h"
+
+/* ======================================================================
+Function: mcast_rx_init
+Purpose : initialise un récepteur sans socket
+Input   : récepteur
+Output  : -
+Comments: suffit pour utiliser mcast_rx_feed avec ses propres datagrammes
+====================================================================== */
+void mcast_rx_init(mcast_rx_t * rx)
+{
+  memset(rx, 0, sizeof(mcast_rx_t));
+  rx->sock = -1;
+}
+
+/* ======================================================================
+Function: mcast_rx_open
+Purpose : rejoint le groupe multicast de la carte
+Input   : récepteur, adresse de l'interface (NULL pour celle par défaut)
+Output  : 0 si OK, -1 en cas d'erreur
+Comments: -
+====================================================================== */
+int mcast_rx_open(mcast_rx_t * rx, const char * ifaddr)
+{
+  struct sockaddr_in addr;
+  struct ip_mreq mreq;
+  uint8_t group[4] = { MCAST_GROUP };
+  int on = 1;
+
+  mcast_rx_init(rx);
+
+  rx->sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (rx->sock < 0)
+    return -1;
+
+  // Plusieurs récepteurs peuvent tourner sur le même PC
+  setsockopt(rx->sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  #ifdef SO_REUSEPORT
+    setsockopt(rx->sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+  #endif
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(MCAST_PORT);
+  if (bind(rx->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    mcast_rx_close(rx);
+    return -1;
+  }
+
+  memcpy(&mreq.imr_multiaddr.s_addr, group, 4);
+  mreq.imr_interface.s_addr = ifaddr ? inet_addr(ifaddr) : htonl(INADDR_ANY);
+  if (setsockopt(rx->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+    mcast_rx_close(rx);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* ======================================================================
+Function: mcast_rx_feed
+Purpose : traite un datagramme reçu
+Input   : récepteur, datagramme et sa taille
+Output  : taille de la trame si elle est complète (dans rx->buf),
+          0 si elle attend d'autres fragments, -1 si le datagramme est
+          rejeté
+Comments: une trame dont il manque des fragments quand la suivante
+          commence est comptée perdue, les trames en retard sont ignorées
+====================================================================== */
+int mcast_rx_feed(mcast_rx_t * rx, const uint8_t * pkt, int len)
+{
+  mcast_hdr_t hdr;
+
+  if (len < (int) sizeof(hdr)) {
+    rx->invalid++;
+    return -1;
+  }
+
+  memcpy(&hdr, pkt, sizeof(hdr));
+  if (hdr.magic != MCAST_MAGIC || hdr.version != MCAST_VERSION ||
+      !hdr.nbfrag || hdr.nbfrag > MCAST_MAX_FRAG || hdr.frag >= hdr.nbfrag ||
+      hdr.len > MCAST_PAYLOAD || (int) sizeof(hdr) + hdr.len != len ||
+      (hdr.frag < hdr.nbfrag-1 && hdr.len != MCAST_PAYLOAD)) {
+    rx->invalid++;
+    return -1;
+  }
+
+  // La carte a redémarré, la séquence repart de 1
+  if (rx->synced && hdr.boot != rx->boot) {
+    rx->restarts++;
+    rx->synced = false;
+    rx->got = 0;
+  }
+
+  // Trame déjà reçue ou plus ancienne
+  if (rx->synced && (int32_t) (hdr.seq - rx->last) <= 0) {
+    return 0;
+  }
+
+  // Nouvelle trame, celle en cours de réassemblage est abandonnée
+  if (!rx->got || hdr.seq != rx->seq) {
+    rx->seq = hdr.seq;
+    rx->nbfrag = hdr.nbfrag;
+    rx->got = 0;
+    rx->len = 0;
+  } else if (hdr.nbfrag != rx->nbfrag) {
+    rx->invalid++;
+    return -1;
+  }
+
+  memcpy(rx->buf + hdr.frag * MCAST_PAYLOAD, pkt + sizeof(hdr), hdr.len);
+  rx->got |= 1 << hdr.frag;
+  if (hdr.frag == hdr.nbfrag-1)
+    rx->len = hdr.frag * MCAST_PAYLOAD + hdr.len;
+
+  if (rx->got != (1 << rx->nbfrag) - 1)
+    return 0;
+
+  // Trame complète, les numéros manquants sont des trames perdues
+  if (rx->synced)
+    rx->lost += hdr.seq - rx->last - 1;
+  rx->synced = true;
+  rx->boot = hdr.boot;
+  rx->last = hdr.seq;
+  rx->got = 0;
+  rx->frames++;
+
+  return rx->len;
+}
+
+/* ======================================================================
+Function: mcast_rx_read
+Purpose : attend la prochaine trame complète
+Input   : récepteur, tampon de la trame et sa taille
+Output  : taille de la trame, -1 en cas d'erreur de socket
+Comments: la trame est une suite de lignes "ETIQUETTE\tVALEUR\n",
+          terminée par un \0 si la place le permet
+====================================================================== */
+int mcast_rx_read(mcast_rx_t * rx, char * frame, int size)
+{
+  uint8_t pkt[sizeof(mcast_hdr_t) + MCAST_PAYLOAD];
+  ssize_t n;
+  int len;
+
+  for (;;) {
+    n = recv(rx->sock, pkt, sizeof(pkt), 0);
+    if (n < 0)
+      return -1;
+
+    len = mcast_rx_feed(rx, pkt, n);
+    if (len > 0) {
+      if (len > size)
+        len = size;
+      memcpy(frame, rx->buf, len);
+      if (len < size)
+        frame[len] = '\0';
+      return len;
+    }
+  }
+}
+
+/* ======================================================================
+Function: mcast_rx_close
+Purpose : quitte le groupe et ferme la socket
+Input   : récepteur
+Output  : -
+Comments: -
+====================================================================== */
+void mcast_rx_close(mcast_rx_t * rx)
+{
+  if (rx->sock >= 0)
+    close(rx->sock);
+  rx->sock = -1;
+}
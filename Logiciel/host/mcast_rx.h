@@ -0,0 +1,50 @@
+// **********************************************************************************
+// Réception des trames téléinfo diffusées en multicast par remora
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Librairie PC (Linux, macOS) qui rejoint le groupe multicast de la
+//           carte, réassemble les trames fragmentées et compte les trames
+//           perdues à partir des numéros de séquence
+//
+// **********************************************************************************
+#ifndef MCAST_RX_h
+#define MCAST_RX_h
+
+#define MCAST_HOST
+#include "../remora/mcast.h"
+
+// Taille maximale d'une trame réassemblée
+#define MCAST_RX_FRAME  (MCAST_PAYLOAD * MCAST_MAX_FRAG)
+
+// Etat d'un récepteur
+typedef struct
+{
+  int      sock;
+  // Trame en cours de réassemblage
+  uint32_t seq;
+  uint8_t  nbfrag;
+  uint8_t  got;             // Masque des fragments reçus
+  uint16_t len;             // Taille de la trame (connue au dernier fragment)
+  char     buf[MCAST_RX_FRAME];
+  // Suivi de la séquence
+  bool     synced;          // Une trame a déjà été reçue
+  uint16_t boot;            // Démarrage de la carte en cours
+  uint32_t last;            // Dernière trame complète
+  // Statistiques
+  uint32_t frames;          // Trames complètes
+  uint32_t lost;            // Trames perdues ou incomplètes
+  uint32_t restarts;        // Redémarrages de la carte
+  uint32_t invalid;         // Datagrammes rejetés
+} mcast_rx_t;
+
+// Function exported for other source file
+// =======================================
+void mcast_rx_init(mcast_rx_t * rx);
+int  mcast_rx_open(mcast_rx_t * rx, const char * ifaddr);
+int  mcast_rx_feed(mcast_rx_t * rx, const uint8_t * pkt, int len);
+int  mcast_rx_read(mcast_rx_t * rx, char * frame, int size);
+void mcast_rx_close(mcast_rx_t * rx);
+
+#endif
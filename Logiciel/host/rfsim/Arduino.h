@@ -0,0 +1,3 @@
+// Arduino.h
+// Host replacement of the Arduino core header, see RHutil/simulator.h
+#include <RHutil/simulator.h>
@@ -0,0 +1,285 @@
+// RH_VirtualRF.cpp
+//
+// Simulated radio on the shared medium of rf_medium, see rfsim.h
+// Creative Commons Attrib Share-Alike License
+
+#include <RH_VirtualRF.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+RH_VirtualRF::RH_VirtualRF()
+    :
+    RHGenericDriver()
+{
+    _sock = -1;
+    _path[0] = '\0';
+    _rxHead = 0;
+    _rxTail = 0;
+    _rxDropped = 0;
+    _rxTimeLast = 0;
+    _rxTimeMax = 0;
+    _lastPreambleTime = 0;
+    _power = RFSIM_POWER_REF;
+}
+
+RH_VirtualRF::~RH_VirtualRF()
+{
+    rfsim_msg_t msg;
+
+    if (_sock < 0)
+	return;
+
+    medium(&msg, RFSIM_LEAVE);
+    close(_sock);
+    unlink(_path);
+}
+
+bool RH_VirtualRF::init()
+{
+    static uint16_t instance = 0;
+    struct sockaddr_un addr;
+    const char* path = getenv("RFSIM_SOCKET");
+    rfsim_msg_t msg;
+
+    if (!RHGenericDriver::init())
+	return false;
+
+    if (!path)
+	path = RFSIM_SOCKET;
+
+    _sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (_sock < 0)
+    {
+	perror("RH_VirtualRF socket");
+	return false;
+    }
+
+    // Our own address so the medium can send us frames
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(_path, sizeof(_path), "%s.%d.%u", path, (int) getpid(), instance++);
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", _path);
+    unlink(_path);
+    if (bind(_sock, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+    {
+	perror("RH_VirtualRF bind");
+	return false;
+    }
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(_sock, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+    {
+	perror("RH_VirtualRF connect (is rf_medium running ?)");
+	close(_sock);
+	unlink(_path);
+	_sock = -1;
+	return false;
+    }
+
+    _mode = RHModeIdle;
+    return medium(&msg, RFSIM_JOIN);
+}
+
+bool RH_VirtualRF::medium(rfsim_msg_t* msg, uint8_t type)
+{
+    size_t size = RFSIM_MSG_HEADER;
+
+    msg->type = type;
+    msg->station = _thisAddress;
+    if (type == RFSIM_TX)
+	size += msg->len;
+    else
+	msg->len = 0;
+
+    return ::send(_sock, msg, size, 0) == (ssize_t) size;
+}
+
+void RH_VirtualRF::setThisAddress(uint8_t thisAddress)
+{
+    rfsim_msg_t msg;
+
+    RHGenericDriver::setThisAddress(thisAddress);
+
+    // Medium needs to know our new station for the link RSSI
+    if (_sock >= 0)
+	medium(&msg, RFSIM_JOIN);
+}
+
+void RH_VirtualRF::rxQueuePush(rfsim_msg_t* msg, unsigned long start)
+{
+    RxSlot* slot;
+    unsigned long elapsed;
+
+    // Check addressing, as RH_RF69 does
+    if (!_promiscuous &&
+	msg->to != _thisAddress &&
+	msg->to != RH_BROADCAST_ADDRESS)
+	return;
+
+    if ((uint8_t) (_rxHead - _rxTail) >= RH_VIRTUALRF_RX_QUEUE_LEN)
+    {
+	_rxDropped++;
+	return;
+    }
+
+    slot = &_rxQueue[_rxHead % RH_VIRTUALRF_RX_QUEUE_LEN];
+    memcpy(&slot->msg, msg, sizeof(rfsim_msg_t));
+    slot->time = millis();
+
+    elapsed = micros() - start;
+    slot->readTime = elapsed > 0xffff ? 0xffff : elapsed;
+    if (slot->readTime > _rxTimeMax)
+	_rxTimeMax = slot->readTime;
+
+    _rxGood++;
+    _rxHead++;
+}
+
+bool RH_VirtualRF::available()
+{
+    rfsim_msg_t msg;
+    ssize_t len;
+
+    if (_sock < 0)
+	return false;
+
+    // Drain whatever the medium sent since last call
+    for (;;)
+    {
+	unsigned long start = micros();
+
+	len = ::recv(_sock, &msg, sizeof(msg), MSG_DONTWAIT);
+	if (len < (ssize_t) RFSIM_MSG_HEADER)
+	    break;
+
+	if (msg.type == RFSIM_TXDONE && _mode == RHModeTx)
+	{
+	    _mode = RHModeIdle;
+	    _txGood++;
+	}
+	else if (msg.type == RFSIM_RX && len == (ssize_t) (RFSIM_MSG_HEADER + msg.len))
+	    rxQueuePush(&msg, start);
+    }
+
+    if (_mode == RHModeTx)
+	return false;
+
+    _mode = RHModeRx;
+    return _rxHead != _rxTail;
+}
+
+bool RH_VirtualRF::recv(uint8_t* buf, uint8_t* len)
+{
+    RxSlot* slot;
+
+    if (!available())
+	return false;
+
+    slot = &_rxQueue[_rxTail % RH_VIRTUALRF_RX_QUEUE_LEN];
+    _rxHeaderTo = slot->msg.to;
+    _rxHeaderFrom = slot->msg.from;
+    _rxHeaderId = slot->msg.id;
+    _rxHeaderFlags = slot->msg.flags;
+    _lastRssi = slot->msg.rssi;
+    _lastPreambleTime = slot->time;
+    _rxTimeLast = slot->readTime;
+
+    if (buf && len)
+    {
+	if (*len > slot->msg.len)
+	    *len = slot->msg.len;
+	memcpy(buf, slot->msg.data, *len);
+    }
+    _rxTail++;
+
+    return true;
+}
+
+bool RH_VirtualRF::send(const uint8_t* data, uint8_t len)
+{
+    rfsim_msg_t msg;
+
+    if (len > RH_VIRTUALRF_MAX_MESSAGE_LEN || _sock < 0)
+	return false;
+
+    waitPacketSent(); // Make sure we dont interrupt an outgoing message
+
+    msg.len = len;
+    msg.to = _txHeaderTo;
+    msg.from = _txHeaderFrom;
+    msg.id = _txHeaderId;
+    msg.flags = _txHeaderFlags;
+    msg.power = _power;
+    memcpy(msg.data, data, len);
+
+    if (!medium(&msg, RFSIM_TX))
+	return false;
+
+    _mode = RHModeTx;
+    return true;
+}
+
+bool RH_VirtualRF::waitPacketSent()
+{
+    struct pollfd pfd;
+
+    pfd.fd = _sock;
+    pfd.events = POLLIN;
+
+    while (_mode == RHModeTx)
+    {
+	available();
+	if (_mode == RHModeTx)
+	    poll(&pfd, 1, 1);
+    }
+    return true;
+}
+
+uint8_t RH_VirtualRF::maxMessageLength()
+{
+    return RH_VIRTUALRF_MAX_MESSAGE_LEN;
+}
+
+void RH_VirtualRF::setTxPower(int8_t power)
+{
+    _power = power;
+}
+
+int8_t RH_VirtualRF::txPower()
+{
+    return _power;
+}
+
+uint32_t RH_VirtualRF::getLastPreambleTime()
+{
+    return _lastPreambleTime;
+}
+
+uint16_t RH_VirtualRF::rxTimeLast()
+{
+    return _rxTimeLast;
+}
+
+uint16_t RH_VirtualRF::rxTimeMax()
+{
+    return _rxTimeMax;
+}
+
+uint8_t RH_VirtualRF::rxQueued()
+{
+    return _rxHead - _rxTail;
+}
+
+uint16_t RH_VirtualRF::rxDropped()
+{
+    return _rxDropped;
+}
+
+uint32_t RH_VirtualRF::bitRate()
+{
+    const char* bitrate = getenv("RFSIM_BITRATE");
+
+    return bitrate ? atol(bitrate) : RFSIM_BITRATE;
+}
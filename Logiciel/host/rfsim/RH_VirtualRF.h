@@ -0,0 +1,137 @@
+// RH_VirtualRF.h
+//
+// Definitions for a simulated radio on a shared medium, for the remora RF simulation
+// Creative Commons Attrib Share-Alike License
+
+#ifndef RH_VirtualRF_h
+#define RH_VirtualRF_h
+
+#include <RHGenericDriver.h>
+#include "rfsim.h"
+
+// Same as RH_RF69_MAX_MESSAGE_LEN
+#define RH_VIRTUALRF_MAX_MESSAGE_LEN RFSIM_MAX_LEN
+
+// Received messages kept until recv(), as RH_RF69_RX_QUEUE_LEN
+#ifndef RH_VIRTUALRF_RX_QUEUE_LEN
+#define RH_VIRTUALRF_RX_QUEUE_LEN 4
+#endif
+
+/////////////////////////////////////////////////////////////////////
+/// \class RH_VirtualRF RH_VirtualRF.h <RH_VirtualRF.h>
+/// \brief Driver to send and receive unaddressed, unreliable datagrams over the simulated
+/// medium of rf_medium (see rfsim.h), on Linux and OSX.
+///
+/// It has the RH_RF69 functions used by the remora gateway (rfm.cpp), so the same
+/// code can be run on a PC against any number of simulated nodes.
+///
+/// The medium sends each frame to all other stations once its airtime is over, the
+/// driver stays in RHModeTx until then, like a real radio. Frames are read from the
+/// medium socket in available(), as the RH_RF69 IRQ less driver does on ESP8266.
+///
+/// The medium socket is RFSIM_SOCKET, or the RFSIM_SOCKET environment variable.
+class RH_VirtualRF : public RHGenericDriver
+{
+public:
+    /// Constructor.
+    RH_VirtualRF();
+
+    /// Destructor, leaves the medium
+    ~RH_VirtualRF();
+
+    /// Opens a socket and joins the medium.
+    /// \return true if the medium socket could be reached
+    virtual bool init();
+
+    /// Reads frames sent by the medium and tells if a message is waiting for recv()
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv()
+    virtual bool available();
+
+    /// Turns the receiver on if it not already on.
+    /// If there is a valid message available, copy it to buf and return true
+    /// else return false.
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    virtual bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
+    /// Then hands the message to the medium, which keeps it on air for its airtime.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send
+    /// \return true if the message length was valid and it was sent to the medium
+    virtual bool send(const uint8_t* data, uint8_t len);
+
+    /// Blocks until the medium tells the current frame is sent
+    /// \return true
+    virtual bool waitPacketSent();
+
+    /// Sets the address of this node, which is also the station for the link RSSI
+    /// \param[in] thisAddress The address of this node.
+    virtual void setThisAddress(uint8_t thisAddress);
+
+    /// \return The maximum message length supported by this driver
+    virtual uint8_t maxMessageLength();
+
+    /// Sets the transmitter power, the medium adds it to the link RSSI
+    /// (RFSIM_POWER_REF gives the link RSSI as is)
+    /// \param[in] power Transmitter power in dBm
+    void setTxPower(int8_t power);
+
+    /// \return The transmitter power in dBm
+    int8_t txPower();
+
+    /// \return millis() when the last message returned by recv() was received
+    uint32_t getLastPreambleTime();
+
+    /// Time spent reading the last message returned by recv() from the medium socket
+    /// \return The time in microseconds
+    uint16_t rxTimeLast();
+
+    /// \return The longest time spent reading a received message since init(), in microseconds
+    uint16_t rxTimeMax();
+
+    /// \return The number of received messages waiting for recv()
+    uint8_t  rxQueued();
+
+    /// \return The count of messages lost because the receive queue was full
+    uint16_t rxDropped();
+
+    /// \return The medium bit rate in bits per second, RFSIM_BITRATE environment
+    /// variable (as rf_medium) or RFSIM_BITRATE
+    uint32_t bitRate();
+
+protected:
+    /// Sends a message to the medium
+    /// \param[in] msg Message, type and station are set here
+    /// \param[in] type RFSIM_xxx type
+    /// \return true if sent
+    bool     medium(rfsim_msg_t* msg, uint8_t type);
+
+    /// Puts a frame received from the medium in the receive queue
+    /// \param[in] msg RFSIM_RX message
+    /// \param[in] start micros() when the read started
+    void     rxQueuePush(rfsim_msg_t* msg, unsigned long start);
+
+private:
+    /// A received message waiting in the receive queue
+    typedef struct
+    {
+	rfsim_msg_t msg;         ///< Message and headers
+	uint16_t    readTime;    ///< Time spent reading it, in microseconds
+	uint32_t    time;        ///< millis() when it was received
+    } RxSlot;
+
+    int                 _sock;
+    char                _path[108];
+    RxSlot              _rxQueue[RH_VIRTUALRF_RX_QUEUE_LEN];
+    uint8_t             _rxHead;
+    uint8_t             _rxTail;
+    uint16_t            _rxDropped;
+    uint16_t            _rxTimeLast;
+    uint16_t            _rxTimeMax;
+    uint32_t            _lastPreambleTime;
+    int8_t              _power;
+};
+
+#endif
@@ -0,0 +1,119 @@
+// simulator.h
+// Lets Arduino-style sketches and RadioHead drivers compile and run on Linux
+// and OSX (RH_PLATFORM_UNIX), for the remora RF simulation (see rfsim.h)
+// Only the subset of the Arduino API used by remora RF code is provided.
+
+#ifndef simulator_h
+#define simulator_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+// No flash/ram distinction on a PC
+#define PROGMEM
+#define PSTR(s)             (s)
+#define F(s)                (s)
+#define sprintf_P           sprintf
+#define strcpy_P            strcpy
+#define strlen_P            strlen
+#define pgm_read_byte(x)    (*(const uint8_t *)(x))
+#define pgm_read_word(x)    (*(const uint16_t *)(x))
+
+#define constrain(x,lo,hi)  ((x)<(lo) ? (lo) : ((x)>(hi) ? (hi) : (x)))
+
+/// Milliseconds since the simulator started
+extern unsigned long millis();
+
+/// Microseconds since the simulator started
+extern unsigned long micros();
+
+/// Sleep for ms milliseconds
+extern void delay(unsigned long ms);
+
+/// Sleep for us microseconds
+extern void delayMicroseconds(unsigned int us);
+
+/// Random number in [from, to)
+extern long random(long from, long to);
+
+/// Random number in [0, to)
+extern long random(long to);
+
+/// Float to string, from avr-libc
+extern char* dtostrf(double val, signed char width, unsigned char prec, char* s);
+
+/// Console output, on stdout unless quiet
+class SerialSimulator
+{
+public:
+    SerialSimulator() : quiet(false) {}
+
+    void   begin(int baud) { (void) baud; }
+    void   flush() { if (!quiet) fflush(stdout); }
+    size_t write(uint8_t ch);
+
+    size_t print(const char* s);
+    size_t print(char ch);
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long) n, base); }
+    size_t print(int n, int base = DEC)           { return print((long) n, base); }
+    size_t print(unsigned int n, int base = DEC)  { return print((unsigned long) n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return print("\r\n"); }
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+
+    /// Discard all output, for benchmarks
+    bool quiet;
+};
+
+extern SerialSimulator Serial;
+
+/// Free heap is not meaningful here, always 0
+class EspSimulator
+{
+public:
+    uint32_t getFreeHeap() { return 0; }
+};
+
+extern EspSimulator ESP;
+
+/// EEPROM kept in a file, RFSIM_EEPROM environment variable or
+/// /tmp/remora_rfsim.eeprom, so gateway state survives a restart
+#define EEPROM_SIMULATOR_SIZE 4096
+class EepromSimulator
+{
+public:
+    void begin(size_t size);
+    bool commit();
+
+    template <typename T> T& get(int addr, T& t)
+    {
+	memcpy(&t, _data + addr, sizeof(T));
+	return t;
+    }
+    template <typename T> const T& put(int addr, const T& t)
+    {
+	memcpy(_data + addr, &t, sizeof(T));
+	return t;
+    }
+
+private:
+    uint8_t _data[EEPROM_SIMULATOR_SIZE];
+};
+
+extern EepromSimulator EEPROM;
+
+#endif
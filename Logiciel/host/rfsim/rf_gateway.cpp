@@ -0,0 +1,205 @@
+// **********************************************************************************
+// Remora RF simulation, the gateway
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : Simulated radio medium to load test the gateway on a PC
+//
+// Usage : rf_gateway [-q] [-w loop_us] [-s stats_s] [-d node,prio,hex ...] [-o node:file]
+//
+// Runs rfm_setup() / rfm_loop() from remora rfm.cpp, decoding with
+// ULPNode_RF_Protocol.cpp, on a RH_VirtualRF driver. -q hides the
+// Serial output, -w adds a busy wait to each loop to stand for the other
+// modules (teleinfo, web server, ...). Every stats_s seconds it prints
+// received packets, per node losses, ACK/PINGBACK latency and loop time.
+// Each -d queues a downlink message, as /rfsend does. -o offers file as
+// firmware update to node, as POST /rfota does. Decoded values go to
+// rfbatch batches, counted but not sent anywhere.
+//
+// **********************************************************************************
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "remora.h"
+
+// Defined in remora.ino on the remora
+uint16_t status = 0;
+unsigned long uptime = 0;
+
+volatile bool quit = false;
+FILE * ota_file = NULL;
+
+/* ======================================================================
+Function: ota_read
+Purpose : firmware image reader for rfota_start, from -o file
+Input   : offset in image, buffer and size
+Output  : false on read error
+Comments: -
+====================================================================== */
+bool ota_read(uint32_t offset, uint8_t * buf, uint8_t len)
+{
+  return fseek(ota_file, offset, SEEK_SET) == 0 && fread(buf, 1, len, ota_file) == len;
+}
+
+/* ======================================================================
+Function: timeAgo
+Purpose : format total seconds to human readable text
+Input   : second
+Output  : pointer to string
+Comments: short version of remora.ino one
+====================================================================== */
+char * timeAgo(unsigned long sec)
+{
+  static char buff[24];
+
+  sprintf(buff, "%lu seconds ago", sec);
+  return buff;
+}
+
+/* ======================================================================
+Function: bootId
+Purpose : random ID of this run
+Input   : -
+Output  : ID
+Comments: remora.ino one uses the hardware RNG
+====================================================================== */
+uint16_t bootId(void)
+{
+  return time(NULL) ^ getpid();
+}
+
+/* ======================================================================
+Function: gateway_stats
+Purpose : display gateway counters since previous call
+Input   : seconds since previous call, longest loop (us)
+Output  : -
+Comments: -
+====================================================================== */
+void gateway_stats(uint32_t seconds, unsigned long loop_max)
+{
+  static uint16_t last_rx = 0;
+  static uint32_t last_hist[RF_REPLY_BUCKETS+1];
+  static uint32_t last_sum = 0;
+  uint32_t lost = 0, dups = 0, packets = 0, replies = 0;
+  uint16_t nodes = 0;
+  long power = 0;
+  uint16_t rx = driver.rxGood();
+  NodeList * me = &nodes_list;
+
+  while ((me = me->next)) {
+    nodes++;
+    packets += me->packets;
+    lost += me->lost;
+    dups += me->dups;
+    power += me->power;
+  }
+
+  printf("rx:%u (%.1f/s) nodes:%u packets:%u lost:%u (%.2f%%) dups:%u queue drop:%u over budget:%u loop max:%luus\n",
+         (uint16_t) (rx - last_rx), (float) (uint16_t) (rx - last_rx) / seconds, nodes, packets,
+         lost, packets + lost ? 100.0 * lost / (packets - dups + lost) : 0.0, dups,
+         driver.rxDropped(), rf_rx_over_budget, loop_max);
+  last_rx = rx;
+
+  printf("reply latency ms");
+  for (uint8_t b=0; b<=RF_REPLY_BUCKETS; b++) {
+    if (b < RF_REPLY_BUCKETS)
+      printf(" <=%u:%u", rf_reply_bounds[b], rf_reply_hist[b] - last_hist[b]);
+    else
+      printf(" more:%u", rf_reply_hist[b] - last_hist[b]);
+    replies += rf_reply_hist[b] - last_hist[b];
+    last_hist[b] = rf_reply_hist[b];
+  }
+  printf(" avg:%.2f expired:%u\n", replies ? (float) (rf_reply_sum - last_sum) / replies : 0.0, rf_reply_expired);
+  printf("downlink delivered:%u dropped:%u dhcp leases:%u\n", rf_down_delivered, rf_down_dropped, rfm_dhcp_leases());
+  printf("link power avg:%.1fdBm network could use:%u bps (now %u)\n", nodes ? (float) power / nodes : 0.0,
+         rflink_network_bitrate(), driver.bitRate());
+  printf("batch readings:%u merged:%u sent:%u bytes:%u\n", rfbatch_readings, rfbatch_merged, rfbatch_sent, rfbatch_bytes);
+  if (rfota.state != RFOTA_IDLE)
+    printf("ota node:%u state:%u block:%u/%u sent:%u again:%u goodput:%u/%u bps\n", rfota.nodeid, rfota.state,
+           rfota.base, rfota.blocks, rfota.sent, rfota.resent, rfota_goodput(), rfota.bitrate);
+  last_sum = rf_reply_sum;
+  fflush(stdout);
+}
+
+void on_signal(int sig)
+{
+  (void) sig;
+  quit = true;
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned long loop_us = 0;
+  unsigned long loop_max = 0;
+  unsigned long stats_s = 10;
+  unsigned long stats;
+  unsigned int ota_node = 0;
+  uint32_t ota_size = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "qw:s:d:o:")) != -1) {
+    switch (opt) {
+      case 'q': Serial.quiet = true; break;
+      case 'w': loop_us = atol(optarg); break;
+      case 's': stats_s = atol(optarg); break;
+      case 'd':
+        if (rfsend_cmd(optarg, strlen(optarg)) < 0) {
+          fprintf(stderr, "downlink %s not queued\n", optarg);
+          return 1;
+        }
+        break;
+      case 'o':
+        if (sscanf(optarg, "%u:", &ota_node) != 1 || !strchr(optarg, ':') ||
+            !(ota_file = fopen(strchr(optarg, ':') + 1, "rb"))) {
+          fprintf(stderr, "-o node:file, can't open %s\n", optarg);
+          return 1;
+        }
+        fseek(ota_file, 0, SEEK_END);
+        ota_size = ftell(ota_file);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-q] [-w loop_us] [-s stats_s] [-d node,prio,hex ...] [-o node:file]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  // Done by pilotes_restore() on the remora
+  EEPROM.begin(EEPROM_SIZE);
+
+  rfm_setup();
+  if (driver.mode() == RHGenericDriver::RHModeInitialising)
+    return 1;
+
+  if (ota_file && !rfota_start(ota_node, ota_size, ota_read)) {
+    fprintf(stderr, "firmware update of %u bytes not started\n", ota_size);
+    return 1;
+  }
+
+  stats = millis();
+  while (!quit) {
+    unsigned long start = micros();
+
+    uptime = millis() / 1000;
+    rfm_loop();
+
+    // Other modules
+    while (micros() - start < loop_us);
+
+    if (micros() - start > loop_max)
+      loop_max = micros() - start;
+
+    if (millis() - stats >= stats_s * 1000) {
+      gateway_stats((millis() - stats) / 1000, loop_max);
+      stats = millis();
+      loop_max = 0;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,395 @@
+// **********************************************************************************
+// Remora RF simulation, the shared medium (the "air")
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : Simulated radio medium to load test the gateway on a PC
+//
+// Usage : rf_medium [-b bitrate] [-r rssi_min:rssi_max] [-l loss%] [-s socket]
+//
+// Each frame sent by a station stays on air for its airtime. Frames that
+// overlap collide and are lost for everybody. Others are delivered to all
+// stations not transmitting at that time, with the link RSSI, unless under
+// RFSIM_SENSITIVITY or randomly lost (-l). Link RSSI of a station is spread
+// between rssi_min and rssi_max from its address, gateway (1) is nearest,
+// and moves with the sender TX power. Within RFSIM_FADE dB of sensitivity
+// frames are lost more and more often.
+//
+// **********************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "rfsim.h"
+
+#define MEDIUM_STATIONS   300   // Connected drivers
+#define MEDIUM_AIR         64   // Frames on air at the same time
+#define MEDIUM_STATS_S     10   // Stats display period
+
+// A connected driver
+typedef struct
+{
+  struct sockaddr_un addr;
+  uint8_t  station;         // RadioHead address
+  uint64_t tx_start;        // Last frame sent (us)
+  uint64_t tx_end;
+} station_t;
+
+// A frame on air
+typedef struct
+{
+  station_t * from;
+  uint64_t    start;        // us
+  uint64_t    end;
+  bool        collided;
+  rfsim_msg_t msg;
+} frame_t;
+
+int sock;
+station_t stations[MEDIUM_STATIONS];
+uint16_t nb_stations = 0;
+frame_t air[MEDIUM_AIR];
+uint8_t nb_air = 0;
+
+// Configuration
+long bitrate  = RFSIM_BITRATE;
+int rssi_min  = RFSIM_RSSI_MIN;
+int rssi_max  = RFSIM_RSSI_MAX;
+int loss      = 0;          // % of random losses
+
+// Stats
+uint32_t st_frames, st_collided, st_delivered, st_weak, st_lost, st_deaf, st_full;
+uint64_t st_airtime;
+volatile bool quit = false;
+
+/* ======================================================================
+Function: now_us
+Purpose : monotonic time
+Input   : -
+Output  : time in microseconds
+Comments: -
+====================================================================== */
+uint64_t now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* ======================================================================
+Function: station_find
+Purpose : find (or add) the station from a driver socket address
+Input   : socket address
+Output  : station, NULL if table is full
+Comments: -
+====================================================================== */
+station_t * station_find(struct sockaddr_un * addr)
+{
+  for (uint16_t i=0; i<nb_stations; i++)
+    if (!strcmp(stations[i].addr.sun_path, addr->sun_path))
+      return &stations[i];
+
+  if (nb_stations >= MEDIUM_STATIONS)
+    return NULL;
+
+  memset(&stations[nb_stations], 0, sizeof(station_t));
+  stations[nb_stations].addr = *addr;
+  return &stations[nb_stations++];
+}
+
+/* ======================================================================
+Function: station_purge
+Purpose : remove stations that left
+Input   : -
+Output  : -
+Comments: frames on air point to stations, so only when air is empty
+====================================================================== */
+void station_purge(void)
+{
+  for (uint16_t i=0; i<nb_stations; ) {
+    if (!stations[i].addr.sun_path[0])
+      stations[i] = stations[--nb_stations];
+    else
+      i++;
+  }
+}
+
+/* ======================================================================
+Function: link_rssi
+Purpose : RSSI of a frame between two stations
+Input   : stations addresses
+Output  : RSSI (dB)
+Comments: weakest station of the link gives the level, plus some fading
+====================================================================== */
+int link_rssi(uint8_t a, uint8_t b)
+{
+  int range = rssi_max - rssi_min + 1;
+  int ra = a == 1 ? rssi_max : rssi_max - (a * 37) % range;
+  int rb = b == 1 ? rssi_max : rssi_max - (b * 37) % range;
+
+  return (ra < rb ? ra : rb) + (rand() % 5) - 2;
+}
+
+/* ======================================================================
+Function: medium_send
+Purpose : send a message to a station
+Input   : station, message, total size
+Output  : -
+Comments: a station not reading fast enough just loses it, as radio would
+====================================================================== */
+void medium_send(station_t * s, rfsim_msg_t * msg, size_t size)
+{
+  if (!s->addr.sun_path[0])
+    return;
+
+  if (sendto(sock, msg, size, MSG_DONTWAIT, (struct sockaddr *) &s->addr, sizeof(s->addr)) < 0) {
+    // Driver exited without leaving
+    if (errno == ECONNREFUSED || errno == ENOENT)
+      s->addr.sun_path[0] = '\0';
+    else
+      st_full++;
+  }
+}
+
+/* ======================================================================
+Function: medium_tx
+Purpose : put a frame on air
+Input   : sending station, message
+Output  : -
+Comments: any frame already on air collides with it
+====================================================================== */
+void medium_tx(station_t * s, rfsim_msg_t * msg)
+{
+  uint64_t now = now_us();
+  frame_t * f;
+
+  st_frames++;
+
+  if (nb_air >= MEDIUM_AIR) {
+    st_collided++;
+    return;
+  }
+
+  f = &air[nb_air++];
+  f->from = s;
+  f->start = now;
+  f->end = now + (uint64_t) (RFSIM_OVERHEAD + msg->len) * 8 * 1000000 / bitrate;
+  f->collided = false;
+  f->msg = *msg;
+  st_airtime += f->end - f->start;
+
+  for (uint8_t i=0; i<nb_air-1; i++) {
+    if (!air[i].collided)
+      st_collided++;
+    air[i].collided = true;
+    f->collided = true;
+  }
+  if (f->collided)
+    st_collided++;
+
+  s->tx_start = f->start;
+  s->tx_end = f->end;
+}
+
+/* ======================================================================
+Function: medium_deliver
+Purpose : frame has been fully sent, give it to the listening stations
+Input   : frame
+Output  : -
+Comments: -
+====================================================================== */
+void medium_deliver(frame_t * f)
+{
+  rfsim_msg_t done;
+  int rssi;
+
+  done.type = RFSIM_TXDONE;
+  done.len = 0;
+  medium_send(f->from, &done, RFSIM_MSG_HEADER);
+
+  if (f->collided)
+    return;
+
+  f->msg.type = RFSIM_RX;
+
+  for (uint16_t i=0; i<nb_stations; i++) {
+    station_t * s = &stations[i];
+
+    if (s == f->from)
+      continue;
+
+    // Half duplex, a station sending during this frame can't hear it
+    if (s->tx_end > f->start && s->tx_start < f->end) {
+      st_deaf++;
+      continue;
+    }
+
+    rssi = link_rssi(f->from->station, s->station) + f->msg.power - RFSIM_POWER_REF;
+    f->msg.rssi = rssi < -127 ? -127 : rssi;
+    if (rssi < RFSIM_SENSITIVITY || rand() % RFSIM_FADE > rssi - RFSIM_SENSITIVITY) {
+      st_weak++;
+      continue;
+    }
+
+    if (loss && rand() % 100 < loss) {
+      st_lost++;
+      continue;
+    }
+
+    st_delivered++;
+    medium_send(s, &f->msg, RFSIM_MSG_HEADER + f->msg.len);
+  }
+}
+
+/* ======================================================================
+Function: medium_receive
+Purpose : handle messages sent by stations
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void medium_receive(void)
+{
+  struct sockaddr_un addr;
+  socklen_t addrlen;
+  rfsim_msg_t msg;
+  station_t * s;
+  ssize_t len;
+
+  for (;;) {
+    addrlen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    len = recvfrom(sock, &msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr *) &addr, &addrlen);
+    if (len < (ssize_t) RFSIM_MSG_HEADER)
+      return;
+
+    if (!(s = station_find(&addr)))
+      continue;
+
+    s->station = msg.station;
+
+    if (msg.type == RFSIM_LEAVE)
+      s->addr.sun_path[0] = '\0';
+    else if (msg.type == RFSIM_TX && len == (ssize_t) (RFSIM_MSG_HEADER + msg.len))
+      medium_tx(s, &msg);
+  }
+}
+
+/* ======================================================================
+Function: medium_stats
+Purpose : display medium counters
+Input   : seconds since previous display
+Output  : -
+Comments: air use is the part of time a frame was on air
+====================================================================== */
+void medium_stats(uint32_t seconds)
+{
+  printf("stations:%u frames:%u (%.1f/s) collided:%u delivered:%u weak:%u lost:%u deaf:%u overrun:%u air:%.1f%%\n",
+         nb_stations, st_frames, (float) st_frames / seconds, st_collided, st_delivered,
+         st_weak, st_lost, st_deaf, st_full, st_airtime / (seconds * 10000.0));
+  fflush(stdout);
+
+  st_frames = st_collided = st_delivered = st_weak = st_lost = st_deaf = st_full = 0;
+  st_airtime = 0;
+}
+
+void on_signal(int sig)
+{
+  (void) sig;
+  quit = true;
+}
+
+int main(int argc, char * argv[])
+{
+  const char * path = getenv("RFSIM_SOCKET");
+  struct sockaddr_un addr;
+  struct pollfd pfd;
+  uint64_t stats = now_us();
+  int opt;
+
+  if (getenv("RFSIM_BITRATE"))
+    bitrate = atol(getenv("RFSIM_BITRATE"));
+
+  while ((opt = getopt(argc, argv, "b:r:l:s:")) != -1) {
+    switch (opt) {
+      case 'b': bitrate = atol(optarg); break;
+      case 'r': sscanf(optarg, "%d:%d", &rssi_min, &rssi_max); break;
+      case 'l': loss = atoi(optarg); break;
+      case 's': path = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-b bitrate] [-r rssi_min:rssi_max] [-l loss%%] [-s socket]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (!path)
+    path = RFSIM_SOCKET;
+  if (bitrate <= 0 || rssi_min > rssi_max) {
+    fprintf(stderr, "invalid bitrate or RSSI range\n");
+    return 1;
+  }
+
+  sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+  if (sock < 0 || bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    perror(path);
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  printf("medium on %s, %ld bps, RSSI %d..%d dB, %d%% loss\n", path, bitrate, rssi_min, rssi_max, loss);
+
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+
+  while (!quit) {
+    uint64_t now = now_us();
+    uint64_t next = now + 100000;
+    struct timespec ts;
+
+    // Wake up when next frame is over
+    for (uint8_t i=0; i<nb_air; i++)
+      if (air[i].end < next)
+        next = air[i].end;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = next > now ? (next - now) * 1000 : 0;
+    ppoll(&pfd, 1, &ts, NULL);
+
+    medium_receive();
+
+    now = now_us();
+    for (uint8_t i=0; i<nb_air; ) {
+      if (air[i].end <= now) {
+        medium_deliver(&air[i]);
+        air[i] = air[--nb_air];
+      } else {
+        i++;
+      }
+    }
+    if (!nb_air)
+      station_purge();
+
+    if (now - stats >= MEDIUM_STATS_S * 1000000ULL) {
+      medium_stats((now - stats) / 1000000);
+      stats = now;
+    }
+  }
+
+  close(sock);
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,472 @@
+// **********************************************************************************
+// Remora RF simulation, ULPNode sensors
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : Simulated radio medium to load test the gateway on a PC
+//
+// Usage : rf_nodes [-n nodes] [-f first_id] [-p period_s] [-P ping_every] [-t duration_s] [-D]
+//
+// Each node is a RH_VirtualRF station sending, every period (+/- 10%),
+// an alive or a sensor data payload asking for ACK, and every ping_every
+// frame a ping waiting for the PINGBACK. Without answer after
+// RF_ANSWER_TIMEOUT the frame is sent again with the same ID, up to
+// RF_RETRIES times, as ULPNode does.
+// With -D nodes start without ID, from RF_DEFAULT_NODE_ID they send
+// DHCP requests until the gateway offers one. Hardware IDs are the same
+// from one run to the next, so a restarted gateway must give same IDs.
+// A node offered a firmware update (RF_OTA_START in ACK) stops sending
+// frames, receives the blocks and answers RF_OTA_STATUS until it has
+// the whole image, then checks its CRC.
+// A link config in ACK (RF_PL_OTA_CONFIG) sets node TX power, medium
+// moves the RSSI gateway gets with it.
+//
+// **********************************************************************************
+
+#include <signal.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <RH_VirtualRF.h>
+#include <RHReliableDatagram.h>
+#include "ULPNode_RF_Protocol.h"
+
+#define NODES_MAX 250
+
+// Silence after last block or status before node sends its status again
+#define OTA_SILENCE 100
+// Status sent without an answer before node gives up the update
+#define OTA_GIVE_UP 20
+
+// A simulated node
+typedef struct
+{
+  RH_VirtualRF  driver;
+  uint8_t       nodeid;
+  uint32_t      hwid;
+  uint8_t       seqid;
+  uint8_t       frames;       // Frames sent, to choose payload type
+  uint8_t       tries;        // 0 when not waiting answer
+  unsigned long sent;         // millis() of last try
+  unsigned long next;         // millis() of next frame
+  uint8_t       len;
+  uint8_t       flags;
+  uint8_t       buf[RH_VIRTUALRF_MAX_MESSAGE_LEN];
+  // Firmware update
+  uint8_t *     ota;          // Image, NULL if no update running
+  RFOtaStartPayload ota_info;
+  uint16_t      ota_base;     // First block missing
+  uint32_t      ota_bitmap;   // bit n set if got block ota_base+n
+  uint8_t       ota_state;    // RF_OTA_ST_xxx
+  unsigned long ota_start;    // millis() of offer
+  unsigned long ota_last;     // millis() of last block or status
+  uint8_t       ota_silent;   // Status sent since last block
+} node_t;
+
+node_t * nodes;
+uint16_t nb_nodes = 50;
+unsigned long period = 10000;   // ms
+uint8_t ping_every = 10;
+
+// Stats
+uint32_t st_frames, st_retries, st_answered, st_failed, st_latency, st_latency_max, st_downlink, st_dhcp, st_ota, st_link;
+volatile bool quit = false;
+
+/* ======================================================================
+Function: node_payload
+Purpose : build node next frame
+Input   : node
+Output  : -
+Comments: values move a bit on each frame
+====================================================================== */
+void node_payload(node_t * n)
+{
+  if (n->nodeid == RF_DEFAULT_NODE_ID) {
+    RFDhcpRequestPayload * p = (RFDhcpRequestPayload *) n->buf;
+
+    p->command = RF_PL_DHCP_REQUEST;
+    p->hwid = n->hwid;
+    n->len = sizeof(RFDhcpRequestPayload);
+    n->flags = RH_FLAGS_NONE;
+
+  } else if (ping_every && n->frames % ping_every == ping_every - 1) {
+    RFPingPayload * p = (RFPingPayload *) n->buf;
+
+    p->command = RF_PL_PING;
+    p->status = RF_NODE_STATE_RADIO | RF_NODE_STATE_RFM69;
+    p->vbat = 3000 + random(300);
+    p->rssi = 0;
+    n->len = sizeof(RFPingPayload);
+    n->flags = RH_FLAGS_NONE;
+
+  } else if (n->frames & 1) {
+    RFAlivePayload * p = (RFAlivePayload *) n->buf;
+
+    p->command = RF_PL_ALIVE;
+    p->status = RF_NODE_STATE_RADIO | RF_NODE_STATE_RFM69;
+    p->vbat = 3000 + random(300);
+    n->len = sizeof(RFAlivePayload);
+    n->flags = RF_PAYLOAD_REQ_ACK;
+
+  } else {
+    uint8_t * p = n->buf;
+    s_temp temp = { RF_DAT_TEMP, (int16_t) (1800 + random(500)) };
+    s_hum  hum  = { RF_DAT_HUM,  (uint16_t) (400 + random(300)) };
+    s_lux  lux  = { RF_DAT_LUX,  (uint16_t) random(5000) };
+
+    *p++ = RF_PL_SENSOR_DATA;
+    memcpy(p, &temp, sizeof(temp)); p += sizeof(temp);
+    memcpy(p, &hum, sizeof(hum));   p += sizeof(hum);
+    memcpy(p, &lux, sizeof(lux));   p += sizeof(lux);
+    n->len = p - n->buf;
+    n->flags = RF_PAYLOAD_REQ_ACK;
+  }
+  n->frames++;
+}
+
+/* ======================================================================
+Function: node_send
+Purpose : send (or send again) node current frame
+Input   : node
+Output  : -
+Comments: -
+====================================================================== */
+void node_send(node_t * n)
+{
+  n->driver.setHeaderTo(RF_DEFAULT_GW_ID);
+  n->driver.setHeaderFrom(n->nodeid);
+  n->driver.setHeaderId(n->seqid);
+  n->driver.setHeaderFlags(n->flags, 0xFF);
+  n->driver.send(n->buf, n->len);
+  n->sent = millis();
+  n->tries++;
+}
+
+/* ======================================================================
+Function: crc_ccitt_update
+Purpose : CRC16 CCITT of one byte
+Input   : CRC so far, byte
+Output  : new CRC
+Comments: from avr-libc util/crc16.h, as ULPNode uses
+====================================================================== */
+uint16_t crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= crc & 0xFF;
+  data ^= data << 4;
+  return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+}
+
+/* ======================================================================
+Function: node_ota_status
+Purpose : tell gateway which blocks node has
+Input   : node
+Output  : -
+Comments: not acked, gateway sends its window again if status is lost
+====================================================================== */
+void node_ota_status(node_t * n)
+{
+  RFOtaStatusPayload st;
+
+  st.command = RF_PL_OTA_UPDATE;
+  st.type    = RF_OTA_STATUS;
+  st.state   = n->ota_state;
+  st.base    = n->ota_base;
+  st.bitmap  = n->ota_bitmap;
+
+  n->driver.setHeaderTo(RF_DEFAULT_GW_ID);
+  n->driver.setHeaderFrom(n->nodeid);
+  n->driver.setHeaderId(++n->seqid);
+  n->driver.setHeaderFlags(RH_FLAGS_NONE, 0xFF);
+  n->driver.send((uint8_t *) &st, sizeof(st));
+
+  n->ota_last = millis() ? millis() : 1;
+}
+
+/* ======================================================================
+Function: node_ota_start
+Purpose : firmware update offered by gateway
+Input   : node, offer
+Output  : -
+Comments: -
+====================================================================== */
+void node_ota_start(node_t * n, RFOtaStartPayload * offer)
+{
+  memcpy(&n->ota_info, offer, sizeof(n->ota_info));
+  free(n->ota);
+  n->ota = NULL;
+  n->ota_base = 0;
+  n->ota_bitmap = 0;
+  n->ota_start = millis();
+  n->ota_silent = 0;
+
+  if (offer->blocksize != RF_OTA_BLOCK_SIZE || offer->window > 32 ||
+      offer->blocks != (offer->size + RF_OTA_BLOCK_SIZE - 1) / RF_OTA_BLOCK_SIZE) {
+    n->ota_state = RF_OTA_ST_REFUSED;
+  } else {
+    n->ota = (uint8_t *) malloc(offer->size);
+    n->ota_state = n->ota ? RF_OTA_ST_RECEIVING : RF_OTA_ST_REFUSED;
+  }
+
+  printf("node %u firmware update of %u bytes offered\n", n->nodeid, offer->size);
+  node_ota_status(n);
+}
+
+/* ======================================================================
+Function: node_ota_block
+Purpose : store a firmware block
+Input   : node, block payload, frame size and header flags
+Output  : -
+Comments: status is sent when gateway asks for it, or after OTA_SILENCE
+          if that block got lost. Blocks node already has count too, they
+          mean gateway missed last status
+====================================================================== */
+void node_ota_block(node_t * n, RFOtaBlockPayload * pl, uint8_t len, uint8_t flags)
+{
+  uint16_t block = pl->block;
+  uint16_t offset = block - n->ota_base;
+  uint32_t pos = (uint32_t) block * RF_OTA_BLOCK_SIZE;
+  uint16_t crc = 0xFFFF;
+
+  // Update is over, gateway did not get our last status
+  if (n->ota_state != RF_OTA_ST_RECEIVING) {
+    node_ota_status(n);
+    return;
+  }
+
+  n->ota_last = millis() ? millis() : 1;
+  n->ota_silent = 0;
+
+  if (block >= n->ota_base && offset < n->ota_info.window && block < n->ota_info.blocks &&
+      len - offsetof(RFOtaBlockPayload, data) == (n->ota_info.size - pos < RF_OTA_BLOCK_SIZE ? n->ota_info.size - pos : RF_OTA_BLOCK_SIZE)) {
+    memcpy(n->ota + pos, pl->data, len - offsetof(RFOtaBlockPayload, data));
+    n->ota_bitmap |= 1UL << offset;
+  }
+
+  // Slide window on blocks received in order
+  while (n->ota_bitmap & 1) {
+    n->ota_bitmap >>= 1;
+    n->ota_base++;
+  }
+
+  if (n->ota_base == n->ota_info.blocks) {
+    for (uint32_t i=0; i<n->ota_info.size; i++)
+      crc = crc_ccitt_update(crc, n->ota[i]);
+
+    n->ota_state = crc == n->ota_info.crc ? RF_OTA_ST_DONE : RF_OTA_ST_CRC_ERROR;
+    printf("node %u firmware update %s in %lums\n", n->nodeid,
+           n->ota_state == RF_OTA_ST_DONE ? "done, CRC OK" : "CRC error", millis() - n->ota_start);
+    free(n->ota);
+    n->ota = NULL;
+    st_ota++;
+    node_ota_status(n);
+
+  // Last block gateway is sending
+  } else if (flags & RF_PAYLOAD_RESPONSE) {
+    node_ota_status(n);
+  }
+}
+
+/* ======================================================================
+Function: node_loop
+Purpose : run a node
+Input   : node
+Output  : -
+Comments: -
+====================================================================== */
+void node_loop(node_t * n)
+{
+  uint8_t buf[RH_VIRTUALRF_MAX_MESSAGE_LEN];
+  uint8_t len;
+
+  // Answer from gateway ?
+  while (n->driver.available()) {
+    bool ack;
+
+    len = sizeof(buf);
+    n->driver.recv(buf, &len);
+
+    // Firmware block, not an answer
+    if (len > offsetof(RFOtaBlockPayload, data) && buf[0] == RF_PL_OTA_UPDATE && buf[1] == RF_OTA_BLOCK &&
+        n->driver.headerFrom() == RF_DEFAULT_GW_ID) {
+      if (n->ota_info.command)
+        node_ota_block(n, (RFOtaBlockPayload *) buf, len, n->driver.headerFlags());
+      continue;
+    }
+
+    if (!n->tries || n->driver.headerFrom() != RF_DEFAULT_GW_ID || n->driver.headerId() != n->seqid)
+      continue;
+
+    if (n->buf[0] == RF_PL_PING)
+      ack = len && buf[0] == RF_PL_PINGBACK;
+    else if (n->buf[0] == RF_PL_DHCP_REQUEST)
+      // New nodes share the same address, offer may be for another one
+      ack = len == sizeof(RFDhcpOfferPayload) && buf[0] == RF_PL_DHCP_OFFER &&
+            ((RFDhcpOfferPayload *) buf)->hwid == n->hwid;
+    else
+      ack = n->driver.headerFlags() & RH_FLAGS_ACK;
+
+    if (ack) {
+      unsigned long latency = millis() - n->sent;
+
+      // Our ID, use it from next frame
+      if (n->buf[0] == RF_PL_DHCP_REQUEST && ((RFDhcpOfferPayload *) buf)->nodeid) {
+        st_dhcp++;
+        n->nodeid = ((RFDhcpOfferPayload *) buf)->nodeid;
+        n->driver.setThisAddress(n->nodeid);
+        printf("node %08X got ID %u\n", n->hwid, n->nodeid);
+
+      // Firmware update offer
+      } else if (len == sizeof(RFOtaStartPayload) && buf[0] == RF_PL_OTA_UPDATE && buf[1] == RF_OTA_START &&
+                 n->buf[0] != RF_PL_PING && n->buf[0] != RF_PL_DHCP_REQUEST) {
+        st_downlink++;
+        node_ota_start(n, (RFOtaStartPayload *) buf);
+
+      // TX power from gateway
+      } else if (len == sizeof(RFLinkConfigPayload) && buf[0] == RF_PL_OTA_CONFIG &&
+                 buf[1] == ULPN_CONFIG_TYPE_LINK && n->buf[0] != RF_PL_PING && n->buf[0] != RF_PL_DHCP_REQUEST) {
+        st_downlink++;
+        st_link++;
+        n->driver.setTxPower(constrain(((RFLinkConfigPayload *) buf)->power, -18, 20));
+
+      // Gateway message instead of '!'
+      } else if (n->buf[0] != RF_PL_PING && n->buf[0] != RF_PL_DHCP_REQUEST && len && buf[0] != '!') {
+        st_downlink++;
+        printf("node %u got downlink %02X (%u bytes)%s\n", n->nodeid, buf[0], len,
+               n->driver.headerFlags() & RF_PAYLOAD_PENDING ? ", more pending" : "");
+      }
+
+      st_answered++;
+      st_latency += latency;
+      if (latency > st_latency_max)
+        st_latency_max = latency;
+      n->tries = 0;
+    }
+  }
+
+  // Node stays awake for the update, blocks stopped coming
+  if (n->ota) {
+    if (millis() - n->ota_last < OTA_SILENCE)
+      return;
+
+    if (++n->ota_silent > OTA_GIVE_UP) {
+      printf("node %u firmware update given up\n", n->nodeid);
+      free(n->ota);
+      n->ota = NULL;
+    } else {
+      node_ota_status(n);
+    }
+    return;
+  }
+
+  // No answer
+  if (n->tries && millis() - n->sent >= RF_ANSWER_TIMEOUT) {
+    if (n->tries > RF_RETRIES) {
+      st_failed++;
+      n->tries = 0;
+    } else {
+      st_retries++;
+      node_send(n);
+    }
+  }
+
+  // Time to send a new frame
+  if (!n->tries && (long) (millis() - n->next) >= 0) {
+    n->seqid++;
+    node_payload(n);
+    node_send(n);
+    n->next += period - period / 10 + random(period / 5);
+    st_frames++;
+  }
+}
+
+/* ======================================================================
+Function: nodes_stats
+Purpose : display nodes counters since previous call
+Input   : seconds since previous call
+Output  : -
+Comments: latency is from the try that got the answer
+====================================================================== */
+void nodes_stats(uint32_t seconds)
+{
+  long power = 0;
+
+  for (uint16_t i=0; i<nb_nodes; i++)
+    power += nodes[i].driver.txPower();
+
+  printf("nodes:%u frames:%u (%.1f/s) retries:%u answered:%u failed:%u latency avg:%.1fms max:%ums downlink:%u dhcp:%u ota:%u link:%u power avg:%.1fdBm\n",
+         nb_nodes, st_frames, (float) st_frames / seconds, st_retries, st_answered, st_failed,
+         st_answered ? (float) st_latency / st_answered : 0.0, st_latency_max, st_downlink, st_dhcp, st_ota,
+         st_link, (float) power / nb_nodes);
+  fflush(stdout);
+
+  st_frames = st_retries = st_answered = st_failed = st_latency = st_latency_max = st_downlink = st_dhcp = st_ota = st_link = 0;
+}
+
+void on_signal(int sig)
+{
+  (void) sig;
+  quit = true;
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned long duration = 0;
+  unsigned long stats;
+  uint8_t first = 10;
+  bool dhcp = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:f:p:P:t:D")) != -1) {
+    switch (opt) {
+      case 'n': nb_nodes = atoi(optarg); break;
+      case 'f': first = atoi(optarg); break;
+      case 'p': period = atof(optarg) * 1000; break;
+      case 'P': ping_every = atoi(optarg); break;
+      case 't': duration = atol(optarg) * 1000; break;
+      case 'D': dhcp = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-n nodes] [-f first_id] [-p period_s] [-P ping_every] [-t duration_s] [-D]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (!nb_nodes || nb_nodes > NODES_MAX || (!dhcp && first + nb_nodes > RH_BROADCAST_ADDRESS) || period < 10) {
+    fprintf(stderr, "1 to %d nodes with IDs under %d, period of 10ms at least\n", NODES_MAX, RH_BROADCAST_ADDRESS);
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  nodes = new node_t[nb_nodes];
+  for (uint16_t i=0; i<nb_nodes; i++) {
+    nodes[i].nodeid = dhcp ? RF_DEFAULT_NODE_ID : first + i;
+    nodes[i].hwid = 0x52460000 + i + 1;
+    nodes[i].seqid = random(256);
+    nodes[i].frames = random(256);
+    nodes[i].tries = 0;
+    nodes[i].ota = NULL;
+    nodes[i].ota_info.command = 0;
+    // Spread first frames over a period
+    nodes[i].next = millis() + random(period);
+    if (!nodes[i].driver.init())
+      return 1;
+    nodes[i].driver.setThisAddress(nodes[i].nodeid);
+  }
+
+  stats = millis();
+  while (!quit && (!duration || millis() < duration)) {
+    for (uint16_t i=0; i<nb_nodes; i++)
+      node_loop(&nodes[i]);
+
+    if (millis() - stats >= 10000) {
+      nodes_stats((millis() - stats) / 1000);
+      stats = millis();
+    }
+    usleep(200);
+  }
+
+  nodes_stats((millis() - stats) / 1000 + 1);
+  delete[] nodes;
+  return 0;
+}
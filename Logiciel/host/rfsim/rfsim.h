@@ -0,0 +1,78 @@
+// **********************************************************************************
+// Remora RF simulation, shared medium messages
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : Simulated radio medium to load test the gateway on a PC
+//
+// rf_medium is the "air": every station (RH_VirtualRF driver) talks to it
+// over a UNIX datagram socket. It keeps each frame on air for its airtime,
+// drops frames that overlap (collision) and delivers the others to all
+// other stations with a per link RSSI.
+//
+//  rf_medium [-b bitrate] [-r rssi_min:rssi_max] [-l loss%]   the air
+//  rf_gateway [-q] [-w loop_us] [-o node:file]   real rfm.cpp code as on the remora
+//  rf_nodes [-n nodes] [-p period_s] [-t duration_s] [-D]   ULPNode senders
+//
+// Build (from this directory), REMORA_HOST builds remora.h with RF module only :
+//  g++ -o rf_medium rf_medium.cpp
+//  g++ -I. -I../../remora -DARDUINO -DREMORA_HOST -DRH_PLATFORM=RH_PLATFORM_UNIX
+//      -o rf_gateway rf_gateway.cpp RH_VirtualRF.cpp simulator.cpp
+//      ../../remora/rfm.cpp ../../remora/rfota.cpp ../../remora/rflink.cpp
+//      ../../remora/rfbatch.cpp ../../remora/linked_list.cpp
+//      ../../remora/ULPNode_RF_Protocol.cpp ../../remora/RHGenericDriver.cpp
+//  g++ -I. -I../../remora -DARDUINO -DREMORA_HOST -DRH_PLATFORM=RH_PLATFORM_UNIX
+//      -o rf_nodes rf_nodes.cpp RH_VirtualRF.cpp simulator.cpp
+//      ../../remora/RHGenericDriver.cpp
+//
+// **********************************************************************************
+#ifndef RFSIM_h
+#define RFSIM_h
+
+#include <stdint.h>
+
+// Medium socket, can be changed with RFSIM_SOCKET environment variable
+#define RFSIM_SOCKET      "/tmp/remora_rfsim.sock"
+
+// Same as RH_RF69_MAX_MESSAGE_LEN so payloads are the same as on real radio
+#define RFSIM_MAX_LEN     60
+
+// Default air, RFM69 as configured by rfm_setup (GFSK_Rb250Fd250), bit
+// rate can be changed for all programs with RFSIM_BITRATE environment variable
+#define RFSIM_BITRATE     250000
+#define RFSIM_RSSI_MIN    -95   // Farthest station
+#define RFSIM_RSSI_MAX    -45   // Nearest station
+#define RFSIM_SENSITIVITY -100  // Below this frame is not received
+#define RFSIM_FADE        6     // dB over sensitivity where frames get lost
+#define RFSIM_POWER_REF   13    // TX power (dBm) of the RSSI range above
+
+// On air bytes added to payload : preamble, sync word, length, 4 headers, CRC
+#define RFSIM_OVERHEAD    (4 + 2 + 1 + 4 + 2)
+
+// Message types
+#define RFSIM_JOIN        1     // station -> medium, station is listening
+#define RFSIM_LEAVE       2     // station -> medium
+#define RFSIM_TX          3     // station -> medium, frame to send
+#define RFSIM_TXDONE      4     // medium -> station, frame left the antenna
+#define RFSIM_RX          5     // medium -> station, frame received
+
+// Message between a station and the medium
+typedef struct
+{
+  uint8_t  type;    // RFSIM_xxx
+  uint8_t  station; // Station address, used for link RSSI
+  int8_t   rssi;    // RX : RSSI of received frame
+  int8_t   power;   // TX : sender power (dBm)
+  uint8_t  len;     // Payload size
+  uint8_t  to;      // RadioHead headers
+  uint8_t  from;
+  uint8_t  id;
+  uint8_t  flags;
+  uint8_t  data[RFSIM_MAX_LEN];
+} rfsim_msg_t;
+
+#define RFSIM_MSG_HEADER  (sizeof(rfsim_msg_t) - RFSIM_MAX_LEN)
+
+#endif
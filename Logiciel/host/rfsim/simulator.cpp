@@ -0,0 +1,136 @@
+// simulator.cpp
+// Arduino API subset for the remora RF simulation, see RHutil/simulator.h
+
+#include <RHutil/simulator.h>
+#include <time.h>
+#include <unistd.h>
+
+SerialSimulator Serial;
+EspSimulator    ESP;
+EepromSimulator EEPROM;
+
+// Time base, first call to micros() is time 0
+static uint64_t now_us()
+{
+    static uint64_t start = 0;
+    struct timespec ts;
+    uint64_t us;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    us = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (!start)
+	start = us;
+    return us - start;
+}
+
+unsigned long millis()
+{
+    return now_us() / 1000;
+}
+
+unsigned long micros()
+{
+    return now_us();
+}
+
+void delay(unsigned long ms)
+{
+    usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    usleep(us);
+}
+
+long random(long from, long to)
+{
+    return to > from ? from + ::random() % (to - from) : from;
+}
+
+long random(long to)
+{
+    return random(0, to);
+}
+
+char* dtostrf(double val, signed char width, unsigned char prec, char* s)
+{
+    sprintf(s, "%*.*f", width, prec, val);
+    return s;
+}
+
+static const char* eeprom_path()
+{
+    const char* path = getenv("RFSIM_EEPROM");
+
+    return path ? path : "/tmp/remora_rfsim.eeprom";
+}
+
+void EepromSimulator::begin(size_t size)
+{
+    FILE* f = fopen(eeprom_path(), "rb");
+
+    // Erased flash reads as 0xFF
+    memset(_data, 0xFF, sizeof(_data));
+    if (size > sizeof(_data))
+	fprintf(stderr, "EEPROM size %zu over %d\n", size, EEPROM_SIMULATOR_SIZE);
+    if (!f)
+	return;
+    if (fread(_data, 1, sizeof(_data), f) == 0)
+	memset(_data, 0xFF, sizeof(_data));
+    fclose(f);
+}
+
+bool EepromSimulator::commit()
+{
+    FILE* f = fopen(eeprom_path(), "wb");
+    bool ok;
+
+    if (!f)
+	return false;
+    ok = fwrite(_data, 1, sizeof(_data), f) == sizeof(_data);
+    fclose(f);
+    return ok;
+}
+
+size_t SerialSimulator::write(uint8_t ch)
+{
+    if (!quiet)
+	putchar(ch);
+    return 1;
+}
+
+size_t SerialSimulator::print(const char* s)
+{
+    if (quiet)
+	return strlen(s);
+    return fputs(s, stdout) < 0 ? 0 : strlen(s);
+}
+
+size_t SerialSimulator::print(char ch)
+{
+    return write(ch);
+}
+
+size_t SerialSimulator::print(long n, int base)
+{
+    if (n < 0 && base == DEC)
+	return print('-') + print((unsigned long) -n, base);
+    return print((unsigned long) n, base);
+}
+
+size_t SerialSimulator::print(unsigned long n, int base)
+{
+    char buf[24];
+
+    snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+    return print(buf);
+}
+
+size_t SerialSimulator::print(double n, int digits)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
@@ -14,6 +14,16 @@ RHGenericSPI::RHGenericSPI(Frequency frequency, BitOrder bitOrder, DataMode data
 {
 }
 
+void RHGenericSPI::transferBytes(const uint8_t* tx, uint8_t* rx, uint8_t len)
+{
+    while (len--)
+    {
+	uint8_t val = transfer(tx ? *tx++ : 0);
+	if (rx)
+	    *rx++ = val;
+    }
+}
+
 void RHGenericSPI::setBitOrder(BitOrder bitOrder)
 {
     _bitOrder = bitOrder;
@@ -89,6 +89,15 @@ public:
     /// \return The octet read from SPI while the data octet was sent
     virtual uint8_t transfer(uint8_t data) = 0;
 
+    /// Transfer a block of octets to and from the SPI interface, as part of the
+    /// same bus transaction (slave select is driven by the caller).
+    /// The default implementation calls transfer() for each octet, subclasses
+    /// may use the platform block transfer instead
+    /// \param[in] tx The octets to send, or NULL to send dummy octets
+    /// \param[out] rx Where to store the octets read, or NULL to discard them
+    /// \param[in] len Number of octets to transfer
+    virtual void transferBytes(const uint8_t* tx, uint8_t* rx, uint8_t len);
+
     /// SPI Configuration methods
     /// Enable SPI interrupts (if supported)
     /// This can be used in an SPI slave to indicate when an SPI message has been received
@@ -43,6 +43,24 @@ uint8_t RHHardwareSPI::transfer(uint8_t data)
     return SPI.transfer(data);
 }
 
+void RHHardwareSPI::transferBytes(const uint8_t* tx, uint8_t* rx, uint8_t len)
+{
+#ifdef ESP8266
+    // Fills the SPI FIFO by 64 octets, dummy octets are 0xff. Older cores
+    // take a non const buffer, it is only read
+    SPI.transferBytes((uint8_t *) tx, rx, len);
+#else
+    // Particle DMA transfer is not usable from the RF interrupt handler,
+    // it waits for a DMA completion interrupt
+    while (len--)
+    {
+	uint8_t val = SPI.transfer(tx ? *tx++ : 0);
+	if (rx)
+	    *rx++ = val;
+    }
+#endif
+}
+
 void RHHardwareSPI::attachInterrupt()
 {
 #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) || (RH_PLATFORM == RH_PLATFORM_PARTICLE)
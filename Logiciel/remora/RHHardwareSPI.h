@@ -34,6 +34,14 @@ public:
     /// \return The octet read from SPI while the data octet was sent
     uint8_t transfer(uint8_t data);
 
+    /// Transfer a block of octets to and from the SPI interface
+    /// On ESP8266 uses the SPI block transfer, elsewhere calls SPI.transfer() directly
+    /// for each octet, without a virtual call per octet
+    /// \param[in] tx The octets to send, or NULL to send dummy octets
+    /// \param[out] rx Where to store the octets read, or NULL to discard them
+    /// \param[in] len Number of octets to transfer
+    void transferBytes(const uint8_t* tx, uint8_t* rx, uint8_t len);
+
     // SPI Configuration methods
     /// Enable SPI interrupts
     /// This can be used in an SPI slave to indicate when an SPI message has been received
@@ -57,8 +57,7 @@ uint8_t RHSPIDriver::spiBurstRead(uint8_t reg, uint8_t* dest, uint8_t len)
     ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg & ~RH_SPI_WRITE_MASK); // Send the start address with the write mask off
-    while (len--)
-	*dest++ = _spi.transfer(0);
+    _spi.transferBytes(NULL, dest, len);
     digitalWrite(_slaveSelectPin, HIGH);
     ATOMIC_BLOCK_END;
     return status;
@@ -70,8 +69,7 @@ uint8_t RHSPIDriver::spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t len)
     ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg | RH_SPI_WRITE_MASK); // Send the start address with the write mask on
-    while (len--)
-	_spi.transfer(*src++);
+    _spi.transferBytes(src, NULL, len);
     digitalWrite(_slaveSelectPin, HIGH);
     ATOMIC_BLOCK_END;
     return status;
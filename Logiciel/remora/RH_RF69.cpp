@@ -94,6 +94,11 @@ RH_RF69::RH_RF69(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi
     _myInterruptIndex = 0xff; // Not allocated yet
     #endif
     _idleMode = RH_RF69_OPMODE_MODE_STDBY;
+    _rxTimeLast = 0;
+    _rxTimeMax = 0;
+    _rxHead = 0;
+    _rxTail = 0;
+    _rxDropped = 0;
 }
 
 void RH_RF69::setIdleMode(uint8_t idleMode)
@@ -204,6 +209,8 @@ bool RH_RF69::init()
 #ifndef RH_RF69_IRQLESS
 void RH_RF69::handleInterrupt()
 {
+    unsigned long start = micros();
+
     //#ifndef ESP8266
     // Get the interrupt cause
     uint8_t irqflags2 = spiRead(RH_RF69_REG_28_IRQFLAGS2);
@@ -219,14 +226,17 @@ void RH_RF69::handleInterrupt()
     // has been done
     if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY))
     {
-	// A complete message has been received with good CRC
-	_lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
-	_lastPreambleTime = millis();
+	// A complete message has been received with good CRC. RSSI and time
+	// go to the queue slot only, _lastRssi belongs to the message recv()
+	// returned last
+	int8_t rssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
+	uint32_t time = millis();
 
 	setModeIdle();
 
-	// Save it in our buffer
-	readFifo();
+	// Save it in the queue and listen again right away
+	rxQueuePush(readFifo(rssi, time), start);
+	setModeRx();
 //	Serial.println("PAYLOADREADY");
     }
     //#endif
@@ -237,40 +247,97 @@ void RH_RF69::handleInterrupt()
 // Caution: since we put our headers in what the RH_RF69 considers to be the payload, if encryption is enabled
 // we have to suffer the cost of decryption before we can determine whether the address is acceptable.
 // Performance issue?
-void RH_RF69::readFifo()
+RH_RF69::RxSlot* RH_RF69::readFifo(int8_t rssi, uint32_t time)
 {
+    // Payload len (counting the headers) followed by the 4 headers
+    uint8_t header[RH_RF69_HEADER_LEN + 1];
+    RxSlot* slot = NULL;
+
     ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(RH_RF69_REG_00_FIFO); // Send the start address with the write mask off
-    uint8_t payloadlen = _spi.transfer(0); // First byte is payload len (counting the headers)
+    _spi.transferBytes(NULL, header, sizeof(header));
+    uint8_t payloadlen = header[0];
 
     if (payloadlen <= RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN && 
 	payloadlen >= RH_RF69_HEADER_LEN)
     {
-	_rxHeaderTo = _spi.transfer(0);
-
      // Check addressing
 	if (_promiscuous ||
-	    _rxHeaderTo == _thisAddress ||
-	    _rxHeaderTo == RH_BROADCAST_ADDRESS)
+	    header[1] == _thisAddress ||
+	    header[1] == RH_BROADCAST_ADDRESS)
 	{
-	    // Get the rest of the headers
-	    _rxHeaderFrom  = _spi.transfer(0);
-        _rxHeaderId    = _spi.transfer(0);
-	    _rxHeaderFlags = _spi.transfer(0);
-
-	    // And now the real payload
-	    for (_bufLen = 0; _bufLen < (payloadlen - RH_RF69_HEADER_LEN); _bufLen++)
-            _buf[_bufLen] = _spi.transfer(0);
-
-        Serial.println();
-	    _rxGood++;
-	    _rxBufValid = true;
+	    // Application did not call recv() fast enough
+	    if ((uint8_t) (_rxHead - _rxTail) >= RH_RF69_RX_QUEUE_LEN)
+	    {
+		_rxDropped++;
+	    }
+	    else
+	    {
+		slot = &_rxQueue[_rxHead & (RH_RF69_RX_QUEUE_LEN - 1)];
+		slot->headerTo    = header[1];
+		slot->headerFrom  = header[2];
+		slot->headerId    = header[3];
+		slot->headerFlags = header[4];
+		slot->rssi        = rssi;
+		slot->time        = time;
+
+		// And now the real payload, in the same transaction
+		slot->len = payloadlen - RH_RF69_HEADER_LEN;
+		_spi.transferBytes(NULL, slot->buf, slot->len);
+
+		_rxGood++;
+	    }
 	}
     }
     digitalWrite(_slaveSelectPin, HIGH);
     ATOMIC_BLOCK_END;
     // Any junk remaining in the FIFO will be cleared next time we go to receive mode.
+    return slot;
+}
+
+void RH_RF69::rxQueuePush(RxSlot* slot, unsigned long start)
+{
+    unsigned long elapsed = micros() - start;
+    uint16_t us = elapsed > 0xffff ? 0xffff : elapsed;
+
+    if (us > _rxTimeMax)
+	_rxTimeMax = us;
+
+    if (slot)
+    {
+	slot->readTime = us;
+	// Slot content must be written before recv() can see it
+	__asm__ __volatile__ ("" ::: "memory");
+	_rxHead++;
+    }
+}
+
+uint8_t RH_RF69::rxQueued()
+{
+    return _rxHead - _rxTail;
+}
+
+uint16_t RH_RF69::rxDropped()
+{
+    return _rxDropped;
+}
+
+uint32_t RH_RF69::bitRate()
+{
+    uint16_t div = ((uint16_t) spiRead(RH_RF69_REG_03_BITRATEMSB) << 8) | spiRead(RH_RF69_REG_04_BITRATELSB);
+
+    return div ? (uint32_t) (RH_RF69_FXOSC / div) : 0;
+}
+
+uint16_t RH_RF69::rxTimeLast()
+{
+    return _rxTimeLast;
+}
+
+uint16_t RH_RF69::rxTimeMax()
+{
+    return _rxTimeMax;
 }
 
 // These are low level functions that call the interrupt handler for the correct
@@ -503,24 +570,33 @@ bool RH_RF69::available()
     // Get the interrupt cause
     uint8_t irqflags2 = spiRead(RH_RF69_REG_28_IRQFLAGS2);
 
+    // A transmitter message has been fully sent, so callers can check mode()
+    // instead of blocking in waitPacketSent()
+    if (_mode == RHModeTx && (irqflags2 & RH_RF69_IRQFLAGS2_PACKETSENT))
+    {
+    setModeIdle(); // Clears FIFO
+    _txGood++;
+    }
+
     if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY))
     {
+    unsigned long start = micros();
+
     // A complete message has been received with good CRC
-    _lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
-    _lastPreambleTime = millis();
+    int8_t rssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
+    uint32_t time = millis();
 
     setModeIdle();
 
-    // Save it in our buffer
-    readFifo();
+    // Save it in the queue, we go back to receive below
+    rxQueuePush(readFifo(rssi, time), start);
     }
   #endif
 
-  if (_mode == RHModeTx)
-  	return false;
-
-  setModeRx(); // Make sure we are receiving
-  return _rxBufValid;
+  // Messages queued before a transmit are still available
+  if (_mode != RHModeTx)
+    setModeRx(); // Make sure we are receiving
+  return _rxHead != _rxTail;
 }
 
 bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
@@ -528,15 +604,27 @@ bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
     if (!available())
 	return false;
 
+    // Oldest message, the interrupt handler does not write this slot
+    // until _rxTail moves on
+    RxSlot* slot = &_rxQueue[_rxTail & (RH_RF69_RX_QUEUE_LEN - 1)];
+
     if (buf && len)
     {
-	ATOMIC_BLOCK_START;
-	if (*len > _bufLen)
-	    *len = _bufLen;
-	memcpy(buf, _buf, *len);
-	ATOMIC_BLOCK_END;
+	if (*len > slot->len)
+	    *len = slot->len;
+	memcpy(buf, slot->buf, *len);
     }
-    _rxBufValid = false; // Got the most recent message
+    _rxHeaderTo       = slot->headerTo;
+    _rxHeaderFrom     = slot->headerFrom;
+    _rxHeaderId       = slot->headerId;
+    _rxHeaderFlags    = slot->headerFlags;
+    _lastRssi         = slot->rssi;
+    _lastPreambleTime = slot->time;
+    _rxTimeLast       = slot->readTime;
+
+    // Slot is read before the interrupt handler can reuse it
+    __asm__ __volatile__ ("" ::: "memory");
+    _rxTail++;
 //    printBuffer("recv:", buf, *len);
     return true;
 }
@@ -549,18 +637,19 @@ bool RH_RF69::send(const uint8_t* data, uint8_t len)
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
     setModeIdle(); // Prevent RX while filling the fifo
 
+    // Start address with the write mask on, length (including the headers)
+    // and the 4 headers
+    uint8_t header[RH_RF69_HEADER_LEN + 2] = {
+	RH_RF69_REG_00_FIFO | RH_RF69_SPI_WRITE_MASK,
+	(uint8_t) (len + RH_RF69_HEADER_LEN),
+	_txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags
+    };
+
     ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
-    _spi.transfer(RH_RF69_REG_00_FIFO | RH_RF69_SPI_WRITE_MASK); // Send the start address with the write mask on
-    _spi.transfer(len + RH_RF69_HEADER_LEN); // Include length of headers
-    // First the 4 headers
-    _spi.transfer(_txHeaderTo);
-    _spi.transfer(_txHeaderFrom);
-    _spi.transfer(_txHeaderId);
-    _spi.transfer(_txHeaderFlags);
+    _spi.transferBytes(header, NULL, sizeof(header));
     // Now the payload
-    while (len--)
-	_spi.transfer(*data++);
+    _spi.transferBytes(data, NULL, len);
     digitalWrite(_slaveSelectPin, HIGH);
     ATOMIC_BLOCK_END;
 
@@ -45,6 +45,13 @@
 #define RH_RF69_MAX_MESSAGE_LEN (RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN - RH_RF69_HEADER_LEN)
 #endif
 
+// Number of received messages held until recv() is called, must be a power of 2.
+// The radio goes back to receive as soon as a message is queued
+// Can be pre-defined prior to including this header
+#ifndef RH_RF69_RX_QUEUE_LEN
+#define RH_RF69_RX_QUEUE_LEN 4
+#endif
+
 // Keep track of the mode the RF69 is in
 #define RH_RF69_MODE_IDLE         0
 #define RH_RF69_MODE_RX           1
@@ -712,8 +719,8 @@ public:
     bool        available();
 
     /// Turns the receiver on if it not already on.
-    /// If there is a valid message available, copy it to buf and return true
-    /// else return false.
+    /// If there is a valid message available, copy the oldest one to buf and return true
+    /// else return false. headerFrom(), lastRssi() etc then refer to this message.
     /// If a message is copied, *len is set to the length (Caution, 0 length messages are permitted).
     /// You should be sure to call this function frequently enough to not miss any messages
     /// It is recommended that you call it in your main loop.
@@ -797,7 +804,44 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Returns the time spent reading the last message returned by recv() out of the radio,
+    /// in the interrupt handler, or in available() when the driver is IRQ less.
+    /// This is the time other interrupts (such as a UART) may have to wait
+    /// \return The time in microseconds
+    uint16_t        rxTimeLast();
+
+    /// Returns the longest time spent reading a received message since init()
+    /// \return The time in microseconds
+    uint16_t        rxTimeMax();
+
+    /// Returns the number of received messages waiting for recv()
+    /// \return The number of messages in the receive queue
+    uint8_t         rxQueued();
+
+    /// Returns the count of messages lost because the receive queue was full
+    /// \return The number of messages dropped
+    uint16_t        rxDropped();
+
+    /// Returns the bit rate of the current modem configuration, as set by
+    /// setModemConfig() or setModemRegisters()
+    /// \return The bit rate in bits per second
+    uint32_t        bitRate();
+
 protected:
+    /// A received message waiting in the receive queue
+    typedef struct
+    {
+	uint8_t  len;           ///< Message length
+	uint8_t  headerTo;      ///< TO header
+	uint8_t  headerFrom;    ///< FROM header
+	uint8_t  headerId;      ///< ID header
+	uint8_t  headerFlags;   ///< FLAGS header
+	int8_t   rssi;          ///< RSSI when it was received
+	uint16_t readTime;      ///< Time spent reading it from the radio, in microseconds
+	uint32_t time;          ///< millis() when it was received
+	uint8_t  buf[RH_RF69_MAX_MESSAGE_LEN]; ///< Message octets
+    } RxSlot;
+
     /// This is a low level function to handle the interrupts for one instance of RF69.
     /// Called automatically by isr*()
     /// Should not need to be called by user code.
@@ -805,9 +849,19 @@ protected:
     void           handleInterrupt();
     #endif
 
-    /// Low level function to read the FIFO and put the received data into the receive buffer
+    /// Low level function to read the FIFO and put the received data into a free slot
+    /// of the receive queue
     /// Should not need to be called by user code.
-    void           readFifo();
+    /// \param[in] rssi RSSI of the message, measured when it was received
+    /// \param[in] time millis() when the message was received
+    /// \return The filled slot, or NULL if there was no message for us or the queue is full
+    RxSlot*        readFifo(int8_t rssi, uint32_t time);
+
+    /// Low level function to record the time spent reading a received message and make
+    /// it available to recv()
+    /// \param[in] slot The slot filled by readFifo(), may be NULL
+    /// \param[in] start micros() when the handling started
+    void           rxQueuePush(RxSlot* slot, unsigned long start);
 
 protected:
 		#ifndef RH_RF69_IRQLESS
@@ -843,16 +897,26 @@ protected:
     /// The selected output power in dBm
     int8_t              _power;
 
-    /// The message length in _buf
-    volatile uint8_t    _bufLen;
+    /// Received messages, filled by the interrupt handler
+    RxSlot              _rxQueue[RH_RF69_RX_QUEUE_LEN];
+
+    /// Messages queued since init(), only written by the interrupt handler
+    volatile uint8_t    _rxHead;
+
+    /// Messages retrieved by recv(), only written by recv()
+    volatile uint8_t    _rxTail;
+
+    /// Messages lost because the queue was full
+    volatile uint16_t   _rxDropped;
 
-    /// Array of octets of teh last received message or the next to transmit message
-    uint8_t             _buf[RH_RF69_MAX_MESSAGE_LEN];
+    /// Time spent reading the last received message, in microseconds
+    volatile uint16_t   _rxTimeLast;
 
-    /// True when there is a valid message in the Rx buffer
-    volatile bool    _rxBufValid;
+    /// Longest time spent reading a received message, in microseconds
+    volatile uint16_t   _rxTimeMax;
 
     /// Time in millis since the last preamble was received (and the last time the RSSI was measured)
+    /// Only written by recv(), as _lastRssi, the interrupt handler writes the queue slot
     uint32_t            _lastPreambleTime;
 };
 
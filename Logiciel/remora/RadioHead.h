@@ -708,6 +708,12 @@
 	#define ATOMIC_BLOCK_START unsigned int __status = INTDisableInterrupts(); {
 	#define ATOMIC_BLOCK_END } INTRestoreInterrupts(__status);
 
+#elif (RH_PLATFORM == RH_PLATFORM_PARTICLE)
+	// The interrupt handler reads the FIFO, SPI accesses from the main
+	// thread must not be cut by it. Nests, readFifo runs in the handler
+	#define ATOMIC_BLOCK_START { int32_t __status = HAL_disable_irq();
+	#define ATOMIC_BLOCK_END HAL_enable_irq(__status); }
+
 #else
 	// TO BE DONE:
 	#define ATOMIC_BLOCK_START
@@ -22,7 +22,7 @@
 #include "ULPNode_RF_Protocol.h"
 
 #ifdef ARDUINO
-#include <arduino.h>
+#include <Arduino.h>
 #endif
 
 
@@ -32,6 +32,34 @@ char pbuf[24];
 // Buffer containing JSON data string to return
 char json_str[128];
 
+// Called for each decoded value, NULL if none
+ULPNReadingCallback decode_callback = NULL;
+
+/* ======================================================================
+Function: decode_set_callback
+Purpose : set function called for each value decoded
+Input   : callback, NULL to remove it
+Output  : -
+Comments: see ULPNReadingCallback
+====================================================================== */
+void decode_set_callback(ULPNReadingCallback cb)
+{
+  decode_callback = cb;
+}
+
+/* ======================================================================
+Function: decode_reading
+Purpose : give a decoded value to the callback
+Input   : node id, rssi, data code and raw value
+Output  : -
+Comments: -
+====================================================================== */
+void decode_reading(uint8_t nodeid, int8_t rssi, uint8_t code, int32_t value)
+{
+  if (decode_callback)
+    decode_callback(nodeid, rssi, code, value);
+}
+
 /* ======================================================================
 Function: ftoa
 Purpose : convert float value to string
@@ -361,14 +389,19 @@ uint8_t decode_received_data(uint8_t nodeid, int8_t rssi, uint8_t len, uint8_t c
     sprintf_P(pbuf, PSTR("\"state\":%d"), ((RFAlivePayload*)pdat)->status);
     add_json_data(json_str, pbuf);
     add_json_data(json_str, decode_bat(((RFAlivePayload*)pdat)->vbat, (char*)""));
+    decode_reading(nodeid, rssi, RF_DAT_STATUS, ((RFAlivePayload*)pdat)->status);
+    decode_reading(nodeid, rssi, RF_DAT_BAT, ((RFAlivePayload*)pdat)->vbat);
 
   // ping/ping back packet ?
   } else if ( (c==RF_PL_PING || c==RF_PL_PINGBACK) && len==sizeof(RFPingPayload)) {
     sprintf_P(pbuf, PSTR("\"state\":%d"), ((RFAlivePayload*)pdat)->status);
     add_json_data(json_str, pbuf);
     // Vbat is sent only on emiting ping packet, not ping back
-    if (c==RF_PL_PING )
+    if (c==RF_PL_PING ) {
       add_json_data(json_str, decode_bat(((RFPingPayload*)pdat)->vbat, (char*)""));
+      decode_reading(nodeid, rssi, RF_DAT_STATUS, ((RFPingPayload*)pdat)->status);
+      decode_reading(nodeid, rssi, RF_DAT_BAT, ((RFPingPayload*)pdat)->vbat);
+    }
 
     // RSSI from other side is sent only in pingback response
     // this is the 2nd rssi value, we call it myrssi
@@ -376,6 +409,18 @@ uint8_t decode_received_data(uint8_t nodeid, int8_t rssi, uint8_t len, uint8_t c
       sprintf_P(pbuf, PSTR("\"myrssi\":%d"), rssi);
       add_json_data(json_str, pbuf);
     }
+  // firmware update progress ?
+  } else if ( c==RF_PL_OTA_UPDATE && len==sizeof(RFOtaStatusPayload) && pdat[1]==RF_OTA_STATUS) {
+    sprintf_P(pbuf, PSTR("\"ota\":%d"), ((RFOtaStatusPayload*)pdat)->state);
+    add_json_data(json_str, pbuf);
+    sprintf_P(pbuf, PSTR("\"block\":%u"), ((RFOtaStatusPayload*)pdat)->base);
+    add_json_data(json_str, pbuf);
+
+  // node asking for an ID ?
+  } else if ( c==RF_PL_DHCP_REQUEST && len==sizeof(RFDhcpRequestPayload)) {
+    sprintf_P(pbuf, PSTR("\"hwid\":\"%08lX\""), (unsigned long) ((RFDhcpRequestPayload*)pdat)->hwid);
+    add_json_data(json_str, pbuf);
+
   // payload Packet with datas
   // we need at least size of payload > 2
   // 1 payload command + 1 sensor type + 1 sensor data)
@@ -385,6 +430,7 @@ uint8_t decode_received_data(uint8_t nodeid, int8_t rssi, uint8_t len, uint8_t c
     uint8_t data_type ;
     uint8_t l ;
     char *  pval;
+    int32_t value ;
     boolean error ;
 
     // Ok we set up on 1st data field
@@ -398,6 +444,7 @@ uint8_t decode_received_data(uint8_t nodeid, int8_t rssi, uint8_t len, uint8_t c
       char str_idx[] = " ";
       data_size = 0;
       pval= NULL;
+      value = 0;
       error = false;
 
       // If index of sensor value is > 0 change string
@@ -414,48 +461,59 @@ uint8_t decode_received_data(uint8_t nodeid, int8_t rssi, uint8_t len, uint8_t c
       if (isDataTemp(data_type) && l>=sizeof(s_temp)) {
         // Temperature, and have enought data ?
         pval = decode_temp(((s_temp*)pdat)->temp, str_idx);
+        value = ((s_temp*)pdat)->temp;
         data_size = sizeof(s_temp);
       } else if (isDataHum(data_type) && l>=sizeof(s_hum)) {
         // Humidity, and have enought data ?
         pval = decode_hum(((s_hum*)pdat)->hum, str_idx);
+        value = ((s_hum*)pdat)->hum;
         data_size = sizeof(s_hum);
       } else if (isDataLux(data_type) && l>=sizeof(s_lux)) {
         // Luminosity and have enought data ?
         pval =  decode_lux(((s_lux*)pdat)->lux, str_idx);
+        value = ((s_lux*)pdat)->lux;
         data_size = sizeof(s_lux);
       } else if (isDataCO2(data_type) && l>=sizeof(s_co2)) {
         // CO2 and have enought data ?
         pval = decode_co2(((s_co2*)pdat)->co2, str_idx);
+        value = ((s_co2*)pdat)->co2;
         data_size = sizeof(s_co2);
       } else if (isDataVolt(data_type) && l>=sizeof(s_volt)) {
         // voltage and have enought data ?
         pval = decode_volt(((s_volt*)pdat)->volt, str_idx);
+        value = ((s_volt*)pdat)->volt;
         data_size = sizeof(s_volt);
       }  else if (isDataBat(data_type) && l>=sizeof(s_volt)) {
         // battery (same payload as volt) and have enought data ?
         pval = decode_bat(((s_volt*)pdat)->volt, str_idx);
+        value = ((s_volt*)pdat)->volt;
         data_size = sizeof(s_volt);
       } else if (isDataRSSI(data_type) && l>=sizeof(s_rssi)) {
         // RSSI and have enought data ?
         pval =  decode_rssi(((s_rssi*)pdat)->rssi, str_idx);
+        value = ((s_rssi*)pdat)->rssi;
         data_size = sizeof(s_rssi);
       } else if (isDataCounter(data_type) && l>=sizeof(s_counter)) {
         // counter and have enought data ?
         pval =  decode_counter(((s_counter*)pdat)->counter, str_idx);
+        value = ((s_counter*)pdat)->counter;
         data_size = sizeof(s_counter);
       } else if (isDataLowBat(data_type) && l>=sizeof(s_lowbat)) {
         // lowbat and have enought data ?
         pval =  decode_lowbat(((s_lowbat*)pdat)->lowbat, str_idx);
+        value = ((s_lowbat*)pdat)->lowbat;
         data_size = sizeof(s_lowbat);
       } else if (isDataDigitalIO(data_type) && l>=sizeof(s_io_digital)) {
         // digital I/0
         pval =  decode_digital_io(((s_io_digital*)pdat)->digital,
                                   ((s_io_digital*)pdat)->code - RF_DAT_IO_DIGITAL);
+        value = ((s_io_digital*)pdat)->digital;
         data_size = sizeof(s_io_digital);
       } else if (isDataAnalogIO(data_type) && l>=sizeof(s_io_analog)) {
         // analog I/O
         pval =  decode_analog_io(((s_io_analog*)pdat)->analog,
                                  ((s_io_analog*)pdat)->code - RF_DAT_IO_ANALOG);
+        value = ((s_io_analog*)pdat)->analog;
         data_size = sizeof(s_io_analog);
       } else {
         // Unknown data code, so we can't check data value
@@ -481,6 +539,7 @@ uint8_t decode_received_data(uint8_t nodeid, int8_t rssi, uint8_t len, uint8_t c
       if (!error && data_size && pval) {
         // Add to JSon string
         add_json_data(json_str, pval);
+        decode_reading(nodeid, rssi, data_type, value);
 
         // remove data size we just worked on
         l-= data_size;
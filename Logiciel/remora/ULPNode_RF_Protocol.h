@@ -43,11 +43,11 @@
     //#undef PROGMEM
     //#define PROGMEM __attribute__((section(".progmem.data")))
 
-    #ifdef ESP8266
+    #if defined (ESP8266) || defined (REMORA_HOST)
       // This will force structure to 1 byte alignment to
       // ensure packet structure sent by RF will be same size
       // when receiving, else data are wrong because Spark align
-      // on 4 bytes not 1
+      // on 4 bytes not 1 (REMORA_HOST is the PC simulation)
       #pragma pack(push)  // push current alignment to stack
       #pragma pack(1)     // set alignment to 1 byte boundary
     #endif
@@ -106,6 +106,7 @@
 // each sensor data type can sent 4 differents values
 #define RF_DAT_SENSOR_MASK  0xFC// isolate sensor type
 
+#define RF_DAT_STATUS       0x1F // Node status flags of ALIVE/PING, for decode callback only
 #define RF_DAT_SENSOR_START 0x20// first value for sensor payload type
 #define RF_DAT_BAT          0x20 // 20 to 23 = Battery Voltage
 #define RF_DAT_TEMP         0x24 // 24 to 27 = Temperature data
@@ -149,6 +150,10 @@
 // Application Parameters header flags of Radio Frame
 #define RF_PAYLOAD_REQ_ACK   0x01  // Request ACK FLAGS
 #define RF_PAYLOAD_RESPONSE  0x02  // Request Response FLAGS
+#define RF_PAYLOAD_PENDING   0x04  // ACK: gateway has more messages for node
+
+// ACK payload is '!', or a gateway message for the node (1st byte is
+// the command code, ie RF_PL_OTA_CONFIG) held until the node talks
 
 #define RF_ANSWER_TIMEOUT     200  // number of ms to receive ACK/Response
 #define RF_RETRIES            3    // number of retries
@@ -200,6 +205,7 @@
 // ===========================
 #define ULPN_CONFIG_TYPE_RF69  69 /* Type for RFM69 */
 #define ULPN_CONFIG_TYPE_NRF24 24 /* Type for NRF24 */
+#define ULPN_CONFIG_TYPE_LINK   1 /* Link settings only, see RFLinkConfigPayload */
 
 // config flags
 #define ULPN_CONFIG_REQUEST_ACK 0x0000 /* Node wants ACK */
@@ -226,6 +232,17 @@ typedef struct
   uint16_t  crc;
 } RFConfigPayload;
 
+// Link config sent by gateway in ACK (RF_PL_OTA_CONFIG), from the node
+// RSSI and losses. Node uses it from its next frame, not saved into
+// eeprom so a reset goes back to RFConfigPayload values
+typedef struct
+{
+  uint8_t   command;    /* RF_PL_OTA_CONFIG */
+  uint8_t   type;       /* ULPN_CONFIG_TYPE_LINK */
+  int8_t    power;      /* RF power level (dBm), kept in module range */
+  uint8_t   modem;      /* modem config (RH_RF69 table) of the network */
+} RFLinkConfigPayload;
+
 
 
 // Command payloads type
@@ -247,6 +264,72 @@ typedef struct
   uint16_t vbat;     /* Battery voltage (in mV ex 1500 for 1.5V) */
 } RFAlivePayload;
 
+// OTA firmware update, RF_PL_OTA_UPDATE payloads, 2nd byte is type
+#define RF_OTA_START        0x01 // gateway -> node in ACK, update offer
+#define RF_OTA_BLOCK        0x02 // gateway -> node, image block
+#define RF_OTA_STATUS       0x03 // node -> gateway, blocks received
+
+#define RF_OTA_BLOCK_SIZE   48   // Image bytes per block, last one shorter
+#define RF_OTA_WINDOW       16   // Blocks sent before node status, 32 max
+
+// Node state in RF_OTA_STATUS
+#define RF_OTA_ST_RECEIVING 0    // Send blocks from base
+#define RF_OTA_ST_DONE      1    // Got all blocks and CRC is good
+#define RF_OTA_ST_CRC_ERROR 2    // Got all blocks but CRC is wrong
+#define RF_OTA_ST_REFUSED   3    // Can't take this image (size, ...)
+
+// OTA Start Payload sent by gateway in ACK
+typedef struct
+{
+  uint8_t  command;   /* Command code     */
+  uint8_t  type;      /* RF_OTA_START     */
+  uint32_t size;      /* Image size       */
+  uint16_t blocks;    /* Image size in blocks */
+  uint16_t crc;       /* CRC16 CCITT of image, init 0xFFFF */
+  uint8_t  blocksize; /* RF_OTA_BLOCK_SIZE */
+  uint8_t  window;    /* RF_OTA_WINDOW    */
+} RFOtaStartPayload;
+
+// OTA Block Payload sent by gateway, frame size gives data size
+typedef struct
+{
+  uint8_t  command;   /* Command code     */
+  uint8_t  type;      /* RF_OTA_BLOCK     */
+  uint16_t block;     /* Block number     */
+  uint8_t  data[RF_OTA_BLOCK_SIZE];
+} RFOtaBlockPayload;
+
+// OTA Status Payload sent by node after a block with RF_PAYLOAD_RESPONSE
+// flag (last one gateway sends, even if node already has it), or when
+// blocks stop coming
+typedef struct
+{
+  uint8_t  command;   /* Command code     */
+  uint8_t  type;      /* RF_OTA_STATUS    */
+  uint8_t  state;     /* RF_OTA_ST_xxx    */
+  uint16_t base;      /* First block missing */
+  uint32_t bitmap;    /* bit n set if got block base+n */
+} RFOtaStatusPayload;
+
+// DHCP Request Payload sent by node, from RF_DEFAULT_NODE_ID when
+// it has no ID yet, or from its ID to renew the lease
+typedef struct
+{
+  uint8_t  command;  /* Command code     */
+  uint32_t hwid;     /* Node unique hardware ID, never 0 */
+} RFDhcpRequestPayload;
+
+// DHCP Offer Payload sent back by gateway to the requesting address,
+// node checks hwid since all new nodes share RF_DEFAULT_NODE_ID
+typedef struct
+{
+  uint8_t  command;  /* Command code     */
+  uint32_t hwid;     /* Hardware ID of requesting node */
+  uint8_t  nodeid;   /* Node ID to use, 0 if none left */
+  uint8_t  groupid;  /* Network ID */
+  uint16_t lease;    /* Lease duration (days), renewed by any frame */
+} RFDhcpOfferPayload;
+
 // Data payloads format
 // ====================
 // Temperature format in payload
@@ -342,7 +425,7 @@ typedef struct
   #pragma pack(pop)
   extern const char * rf_frame[];
 #else
-  #ifdef ESP8266
+  #if defined (ESP8266) || defined (REMORA_HOST)
     // restore original alignment from stack
     #pragma pack(pop)
   #endif
@@ -351,6 +434,11 @@ typedef struct
 
 extern char json_str[];
 
+// Called by decode_received_data for each value decoded, with the data
+// code (RF_DAT_xxx including index) and the raw value sent by the node
+typedef void (*ULPNReadingCallback)(uint8_t nodeid, int8_t rssi, uint8_t code, int32_t value);
+void decode_set_callback(ULPNReadingCallback cb);
+
 char * decode_frame_type(uint8_t);
 char * decode_bat(uint16_t, char * index=NULL);
 char * decode_volt(uint16_t, char * index=NULL);
@@ -0,0 +1,515 @@
+// **********************************************************************************
+// Journal circulaire en flash SPI management file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Journal des agrégats minute et des changements d'état des fils
+//           pilotes dans la flash SPI libre de l'ESP8266 (zone SPIFFS)
+//
+// La zone est découpée en secteurs de 4Ko écrits les uns après les autres
+// (répartition de l'usure), chaque secteur commence par une entête avec son
+// numéro de séquence et son nombre d'effacements. Un ajout ne coûte qu'une
+// programmation de 32 octets dans une page. Au démarrage on ne lit que les
+// entêtes pour trouver le secteur courant, puis une recherche dichotomique
+// donne le premier emplacement libre.
+// **********************************************************************************
+
+#include "flashlog.h"
+
+#if defined (MOD_FLASHLOG) || defined (FLASHLOG_SIM)
+
+#ifdef FLASHLOG_SIM
+  #include <string.h>
+  #include <stdio.h>
+#else
+  extern "C" {
+    #include "spi_flash.h"
+  }
+  // Zone SPIFFS définie par le linker, non utilisée par Remora
+  extern "C" uint32_t _SPIFFS_start;
+  extern "C" uint32_t _SPIFFS_end;
+#endif
+
+// Entête de secteur, dans le premier emplacement
+typedef struct
+{
+  uint32_t magic;
+  uint32_t seq;       // Numéro de séquence du secteur
+  uint32_t first;     // Numéro du premier enregistrement du secteur
+  uint32_t erase;     // Nombre d'effacements du secteur
+  uint16_t crc;
+  uint16_t pad;
+} flashlog_hdr_t;
+
+#define FLASHLOG_BLANK 0xFFFFFFFF
+
+uint32_t flashlog_base = 0;       // Adresse de la zone en flash
+uint16_t flashlog_nb_sectors = 0; // Nombre de secteurs de la zone
+uint16_t flashlog_head = 0;       // Secteur en cours d'écriture
+uint16_t flashlog_slot = 0;       // Prochain emplacement libre du secteur
+uint32_t flashlog_head_seq = 0;   // Numéro de séquence du secteur en cours
+uint32_t flashlog_next_seq = 1;   // Prochain numéro d'enregistrement
+bool     flashlog_ok = false;
+
+// ======================================================================
+// Accès à la flash, réelle ou simulée
+// ======================================================================
+#ifdef FLASHLOG_SIM
+uint8_t  flashlog_sim[FLASHLOG_SIM_SECTORS*FLASHLOG_SECTOR_SIZE];
+uint32_t flashlog_sim_erase[FLASHLOG_SIM_SECTORS];
+uint16_t flashlog_sim_cut = 0;
+bool     flashlog_sim_ready = false;
+
+bool flashlog_read(uint32_t addr, void * buff, uint16_t size)
+{
+  memcpy(buff, flashlog_sim + addr, size);
+  return true;
+}
+
+// Comme une NOR, une programmation ne peut que passer des bits à 0
+bool flashlog_write(uint32_t addr, const void * buff, uint16_t size)
+{
+  const uint8_t * p = (const uint8_t *) buff;
+
+  // Coupure d'alimentation simulée, écriture partielle
+  if (flashlog_sim_cut && flashlog_sim_cut < size) {
+    size = flashlog_sim_cut;
+    flashlog_sim_cut = 0;
+  }
+
+  for (uint16_t i=0; i<size; i++)
+    flashlog_sim[addr+i] &= p[i];
+
+  return true;
+}
+
+bool flashlog_erase(uint16_t sector)
+{
+  memset(flashlog_sim + sector*FLASHLOG_SECTOR_SIZE, 0xFF, FLASHLOG_SECTOR_SIZE);
+  flashlog_sim_erase[sector]++;
+  return true;
+}
+
+/* ======================================================================
+Function: flashlog_sim_erase_count
+Purpose : nombre d'effacements d'un secteur de la flash simulée
+Input   : numéro du secteur
+Output  : nombre d'effacements
+Comments: pour vérifier la répartition de l'usure
+====================================================================== */
+uint32_t flashlog_sim_erase_count(uint16_t sector)
+{
+  return sector<FLASHLOG_SIM_SECTORS ? flashlog_sim_erase[sector] : 0;
+}
+
+/* ======================================================================
+Function: flashlog_sim_power_cut
+Purpose : simule une coupure pendant la prochaine écriture
+Input   : nombre d'octets réellement écrits
+Output  : -
+Comments: -
+====================================================================== */
+void flashlog_sim_power_cut(uint16_t bytes)
+{
+  flashlog_sim_cut = bytes;
+}
+
+#else
+// La flash SPI de l'ESP8266 se lit et s'écrit par mots de 32 bits alignés
+bool flashlog_read(uint32_t addr, void * buff, uint16_t size)
+{
+  return spi_flash_read(flashlog_base + addr, (uint32_t *) buff, size) == SPI_FLASH_RESULT_OK;
+}
+
+bool flashlog_write(uint32_t addr, const void * buff, uint16_t size)
+{
+  return spi_flash_write(flashlog_base + addr, (uint32_t *) buff, size) == SPI_FLASH_RESULT_OK;
+}
+
+bool flashlog_erase(uint16_t sector)
+{
+  return spi_flash_erase_sector(flashlog_base/FLASHLOG_SECTOR_SIZE + sector) == SPI_FLASH_RESULT_OK;
+}
+#endif
+
+/* ======================================================================
+Function: flashlog_crc
+Purpose : calcul de CRC16 CCITT
+Input   : données, taille et valeur initiale du CRC
+Output  : CRC
+Comments: -
+====================================================================== */
+uint16_t flashlog_crc(const void * buff, uint16_t size, uint16_t crc)
+{
+  const uint8_t * p = (const uint8_t *) buff;
+
+  while (size--) {
+    crc ^= (uint16_t) *p++ << 8;
+    for (uint8_t i=0; i<8; i++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// CRC d'un enregistrement, tout sauf le champ crc
+uint16_t flashlog_rec_crc(flashlog_rec_t * rec)
+{
+  uint16_t crc = flashlog_crc(&rec->seq, sizeof(rec->seq), 0xFFFF);
+  return flashlog_crc(&rec->type, FLASHLOG_REC_SIZE - offsetof(flashlog_rec_t, type), crc);
+}
+
+// Lecture et vérification d'une entête de secteur
+bool flashlog_read_hdr(uint16_t sector, flashlog_hdr_t * hdr)
+{
+  if (!flashlog_read(sector*FLASHLOG_SECTOR_SIZE, hdr, sizeof(flashlog_hdr_t)))
+    return false;
+
+  return hdr->magic == FLASHLOG_MAGIC &&
+         hdr->crc == flashlog_crc(hdr, offsetof(flashlog_hdr_t, crc), 0xFFFF);
+}
+
+// Lecture d'un enregistrement
+bool flashlog_read_rec(uint16_t sector, uint16_t slot, flashlog_rec_t * rec)
+{
+  return flashlog_read(sector*FLASHLOG_SECTOR_SIZE + slot*FLASHLOG_REC_SIZE, rec, FLASHLOG_REC_SIZE);
+}
+
+/* ======================================================================
+Function: flashlog_open
+Purpose : efface et prépare un secteur pour l'écriture
+Input   : numéro du secteur
+Output  : true si ok
+Comments: le compteur d'effacements est repris de l'ancienne entête
+====================================================================== */
+bool flashlog_open(uint16_t sector)
+{
+  flashlog_hdr_t hdr;
+  uint32_t erase = 0;
+
+  if (flashlog_read_hdr(sector, &hdr))
+    erase = hdr.erase;
+
+  if (!flashlog_erase(sector))
+    return false;
+
+  memset(&hdr, 0xFF, sizeof(hdr));
+  hdr.magic = FLASHLOG_MAGIC;
+  hdr.seq   = ++flashlog_head_seq;
+  hdr.first = flashlog_next_seq;
+  hdr.erase = erase + 1;
+  hdr.crc   = flashlog_crc(&hdr, offsetof(flashlog_hdr_t, crc), 0xFFFF);
+
+  if (!flashlog_write(sector*FLASHLOG_SECTOR_SIZE, &hdr, sizeof(hdr)))
+    return false;
+
+  flashlog_head = sector;
+  flashlog_slot = 1;
+  return true;
+}
+
+/* ======================================================================
+Function: flashlog_append
+Purpose : ajoute un enregistrement au journal
+Input   : type d'enregistrement
+          données et taille (FLASHLOG_DATA_SIZE au maximum)
+Output  : true si ok
+Comments: une seule programmation de 32 octets, plus un effacement
+          tous les FLASHLOG_SLOTS-1 enregistrements
+====================================================================== */
+bool flashlog_append(uint8_t type, const void * data, uint8_t len)
+{
+  flashlog_rec_t rec;
+
+  if (!flashlog_ok || len > FLASHLOG_DATA_SIZE)
+    return false;
+
+  // Secteur plein, on passe au suivant (le plus ancien)
+  if (flashlog_slot >= FLASHLOG_SLOTS) {
+    if (!flashlog_open((flashlog_head + 1) % flashlog_nb_sectors)) {
+      flashlog_ok = false;
+      return false;
+    }
+  }
+
+  memset(&rec, 0xFF, sizeof(rec));
+  rec.seq  = flashlog_next_seq;
+  rec.type = type;
+  rec.len  = len;
+  memcpy(rec.data, data, len);
+  rec.crc  = flashlog_rec_crc(&rec);
+
+  // L'emplacement est consommé même si l'écriture échoue
+  if (!flashlog_write(flashlog_head*FLASHLOG_SECTOR_SIZE + flashlog_slot*FLASHLOG_REC_SIZE, &rec, sizeof(rec))) {
+    flashlog_slot++;
+    return false;
+  }
+
+  flashlog_slot++;
+  flashlog_next_seq++;
+  return true;
+}
+
+/* ======================================================================
+Function: flashlog_rewind
+Purpose : positionne une lecture au début du journal
+Input   : position de lecture
+          premier numéro de séquence voulu (0 pour tout)
+Output  : -
+Comments: -
+====================================================================== */
+void flashlog_rewind(flashlog_cursor_t * cur, uint32_t from)
+{
+  cur->n    = 0;
+  cur->slot = 0;
+  cur->from = from;
+}
+
+/* ======================================================================
+Function: flashlog_next
+Purpose : lit l'enregistrement suivant du journal
+Input   : position de lecture
+          enregistrement lu
+Output  : true si un enregistrement a été lu, false en fin de journal
+Comments: les secteurs entièrement antérieurs à cur->from ne sont pas
+          lus, seule leur entête et celle du suivant le sont.
+          Les enregistrements corrompus (coupure pendant l'écriture)
+          sont ignorés
+====================================================================== */
+bool flashlog_next(flashlog_cursor_t * cur, flashlog_rec_t * rec)
+{
+  flashlog_hdr_t hdr;
+  uint16_t sector;
+
+  if (!flashlog_ok)
+    return false;
+
+  // Le plus ancien secteur suit le secteur en cours
+  while (cur->n < flashlog_nb_sectors) {
+    sector = (flashlog_head + 1 + cur->n) % flashlog_nb_sectors;
+
+    // Entrée dans un nouveau secteur
+    if (cur->slot == 0) {
+      if (!flashlog_read_hdr(sector, &hdr)) {
+        cur->n++;
+        continue;
+      }
+
+      // Le secteur suivant commence avant ce qu'on cherche
+      if (sector != flashlog_head &&
+          flashlog_read_hdr((sector + 1) % flashlog_nb_sectors, &hdr) &&
+          hdr.first <= cur->from) {
+        cur->n++;
+        continue;
+      }
+      cur->slot = 1;
+    }
+
+    // Fin du secteur
+    if (cur->slot >= FLASHLOG_SLOTS || (sector == flashlog_head && cur->slot >= flashlog_slot)) {
+      cur->n++;
+      cur->slot = 0;
+      continue;
+    }
+
+    if (!flashlog_read_rec(sector, cur->slot++, rec))
+      return false;
+
+    // Reste du secteur vierge
+    if (rec->seq == FLASHLOG_BLANK) {
+      cur->n++;
+      cur->slot = 0;
+      continue;
+    }
+
+    if (rec->crc == flashlog_rec_crc(rec) && rec->len <= FLASHLOG_DATA_SIZE && rec->seq >= cur->from)
+      return true;
+  }
+
+  return false;
+}
+
+/* ======================================================================
+Function: flashlog_format
+Purpose : formate un enregistrement en une ligne JSON
+Input   : buffer de destination et sa taille
+          enregistrement
+Output  : nombre de caractères écrits
+Comments: -
+====================================================================== */
+int flashlog_format(char * buff, int size, flashlog_rec_t * rec)
+{
+  flashlog_minute_t m;
+  int len;
+
+  len = snprintf(buff, size, "{\"seq\":%lu,", (unsigned long) rec->seq);
+  if (len >= size)
+    return 0;
+
+  switch (rec->type) {
+    case FLASHLOG_BOOT:
+      len += snprintf(buff+len, size-len, "\"boot\":%u}\n", rec->data[0]);
+    break;
+
+    case FLASHLOG_MINUTE:
+      memcpy(&m, rec->data, sizeof(m));
+      len += snprintf(buff+len, size-len,
+                      "\"minute\":%u,\"nb\":%u,\"adps\":%u,\"papp\":[%u,%u,%u],\"iinst\":[%u,%u],"
+                      "\"wh\":[%u,%u,%u,%u,%u,%u]}\n",
+                      m.minute, m.nb, m.adps, m.papp_min, m.papp_avg, m.papp_max,
+                      m.iinst_min, m.iinst_max,
+                      m.wh[0], m.wh[1], m.wh[2], m.wh[3], m.wh[4], m.wh[5]);
+    break;
+
+    case FLASHLOG_FP:
+      len += snprintf(buff+len, size-len, "\"fp\":%u,\"ordre\":\"%c\",\"delest\":%u}\n",
+                      rec->data[0], rec->data[1], rec->data[2]);
+    break;
+
+    case FLASHLOG_RELAIS:
+      len += snprintf(buff+len, size-len, "\"relais\":%u}\n", rec->data[0]);
+    break;
+
+    default:
+      len += snprintf(buff+len, size-len, "\"type\":%u}\n", rec->type);
+    break;
+  }
+
+  return len < size ? len : 0;
+}
+
+/* ======================================================================
+Function: flashlog_seq
+Purpose : retourne le numéro du prochain enregistrement
+Input   : -
+Output  : numéro de séquence
+Comments: -
+====================================================================== */
+uint32_t flashlog_seq(void)
+{
+  return flashlog_next_seq;
+}
+
+/* ======================================================================
+Function: flashlog_setup
+Purpose : retrouve la position d'écriture du journal
+Input   : -
+Output  : true si le journal est utilisable
+Comments: lit une entête par secteur puis ~7 emplacements du secteur
+          le plus récent, jamais l'ensemble des enregistrements
+====================================================================== */
+bool flashlog_setup(void)
+{
+  flashlog_hdr_t hdr;
+  flashlog_rec_t rec;
+  bool found = false;
+  uint16_t lo, hi, mid;
+
+  flashlog_ok = false;
+
+  #ifdef FLASHLOG_SIM
+    if (!flashlog_sim_ready) {
+      memset(flashlog_sim, 0xFF, sizeof(flashlog_sim));
+      flashlog_sim_ready = true;
+    }
+    flashlog_base = 0;
+    flashlog_nb_sectors = FLASHLOG_SIM_SECTORS;
+  #else
+    Serial.print("Initializing Flash log...");
+
+    flashlog_base = (uint32_t) &_SPIFFS_start - 0x40200000;
+    flashlog_nb_sectors = ((uint32_t) &_SPIFFS_end - (uint32_t) &_SPIFFS_start) / FLASHLOG_SECTOR_SIZE;
+  #endif
+
+  // Il faut au moins 2 secteurs pour tourner
+  if (flashlog_nb_sectors < 2) {
+    #ifndef FLASHLOG_SIM
+      Serial.println("pas de zone SPIFFS!");
+    #endif
+    return false;
+  }
+
+  // Recherche du secteur le plus récent
+  for (uint16_t s=0; s<flashlog_nb_sectors; s++) {
+    if (flashlog_read_hdr(s, &hdr) && (!found || (int32_t) (hdr.seq - flashlog_head_seq) > 0)) {
+      found = true;
+      flashlog_head = s;
+      flashlog_head_seq = hdr.seq;
+      flashlog_next_seq = hdr.first;
+    }
+  }
+
+  // Journal vierge
+  if (!found) {
+    flashlog_head_seq = 0;
+    flashlog_next_seq = 1;
+    flashlog_ok = flashlog_open(0);
+  } else {
+    // Recherche dichotomique du premier emplacement vierge,
+    // les enregistrements sont écrits dans l'ordre
+    lo = 1;
+    hi = FLASHLOG_SLOTS;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      flashlog_read_rec(flashlog_head, mid, &rec);
+      if (rec.seq == FLASHLOG_BLANK)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    flashlog_slot = lo;
+
+    // Numéro du dernier enregistrement valide
+    for (mid=lo-1; mid>=1; mid--) {
+      flashlog_read_rec(flashlog_head, mid, &rec);
+      if (rec.crc == flashlog_rec_crc(&rec)) {
+        flashlog_next_seq = rec.seq + 1;
+        break;
+      }
+    }
+    flashlog_ok = true;
+  }
+
+  #ifndef FLASHLOG_SIM
+    Serial.print(flashlog_ok ? "OK! " : "Erreur! ");
+    Serial.print(flashlog_nb_sectors);
+    Serial.print(" secteurs, seq=");
+    Serial.println(flashlog_next_seq);
+
+    // On trace le démarrage et sa cause
+    uint8_t reason = system_get_rst_info()->reason;
+    flashlog_append(FLASHLOG_BOOT, &reason, sizeof(reason));
+  #endif
+
+  return flashlog_ok;
+}
+
+#ifndef FLASHLOG_SIM
+/* ======================================================================
+Function: flashlog_fp
+Purpose : enregistre le changement d'état d'un fil pilote
+Input   : numéro du fil pilote et ordre appliqué
+Output  : -
+Comments: -
+====================================================================== */
+void flashlog_fp(uint8_t fp, char ordre)
+{
+  uint8_t data[3] = { fp, (uint8_t) ordre, (uint8_t) nivDelest };
+
+  flashlog_append(FLASHLOG_FP, data, sizeof(data));
+}
+
+/* ======================================================================
+Function: flashlog_relais
+Purpose : enregistre le changement d'état du relais
+Input   : état du relais
+Output  : -
+Comments: -
+====================================================================== */
+void flashlog_relais(uint8_t etat)
+{
+  flashlog_append(FLASHLOG_RELAIS, &etat, sizeof(etat));
+}
+#endif
+
+#endif // MOD_FLASHLOG || FLASHLOG_SIM
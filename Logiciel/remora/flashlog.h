@@ -0,0 +1,97 @@
+// **********************************************************************************
+// Journal circulaire en flash SPI header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Journal des agrégats minute et des changements d'état des fils
+//           pilotes dans la flash SPI libre de l'ESP8266 (zone SPIFFS)
+//
+// **********************************************************************************
+#ifndef FLASHLOG_h
+#define FLASHLOG_h
+
+// FLASHLOG_SIM permet de compiler le module sur un PC avec une flash
+// simulée en RAM, sans le reste du projet (voir Logiciel/host/flashlog_test.cpp)
+#ifdef FLASHLOG_SIM
+  #include <stdint.h>
+  #include <stdbool.h>
+  #include <stddef.h>
+#else
+  #include "remora.h"
+#endif
+
+// Géométrie de la flash, un enregistrement par emplacement, le premier
+// emplacement de chaque secteur contient l'entête du secteur
+#define FLASHLOG_SECTOR_SIZE  4096
+#define FLASHLOG_REC_SIZE       32
+#define FLASHLOG_SLOTS        (FLASHLOG_SECTOR_SIZE/FLASHLOG_REC_SIZE)
+#define FLASHLOG_DATA_SIZE      24
+#define FLASHLOG_MAGIC  0x474C4D52 // "RMLG"
+
+// Nombre de secteurs de la flash simulée
+#ifndef FLASHLOG_SIM_SECTORS
+#define FLASHLOG_SIM_SECTORS     8
+#endif
+
+// Types d'enregistrement
+enum flashlog_type_e {
+  FLASHLOG_BOOT = 1,  // Démarrage, data[0] = cause du reset
+  FLASHLOG_MINUTE,    // Agrégat d'une minute téléinfo
+  FLASHLOG_FP,        // Changement d'état d'un fil pilote
+  FLASHLOG_RELAIS     // Changement d'état du relais
+};
+
+// Un enregistrement, 32 octets pour rester aligné sur les pages de 256
+typedef struct
+{
+  uint32_t seq;                       // Numéro de séquence (croissant)
+  uint16_t crc;                       // CRC16 du reste de l'enregistrement
+  uint8_t  type;                      // flashlog_type_e
+  uint8_t  len;                       // Taille utile de data
+  uint8_t  data[FLASHLOG_DATA_SIZE];
+} flashlog_rec_t;
+
+// Agrégat minute, réduit pour tenir dans data (les 24 octets sont pris).
+// minute repasse à 0 après 65536 minutes (45 jours et demi) : les
+// enregistrements MINUTE qui suivent un BOOT sont croissants, un minute
+// plus petit que le précédent sans BOOT entre eux est un tour de plus
+typedef struct
+{
+  uint16_t minute;                    // Minute depuis le démarrage, modulo 65536
+  uint8_t  nb;                        // Nombre de trames (saturé à 255)
+  uint8_t  adps;                      // Nombre d'ADPS (saturé à 255)
+  uint16_t papp_min;
+  uint16_t papp_avg;
+  uint16_t papp_max;
+  uint8_t  iinst_min;
+  uint8_t  iinst_max;
+  uint16_t wh[6];                     // Consommation par période tarifaire
+} flashlog_minute_t;
+
+// Position de lecture dans le journal
+typedef struct
+{
+  uint16_t n;                         // Secteurs parcourus depuis le plus ancien
+  uint16_t slot;                      // Emplacement dans le secteur, 0 = entête
+  uint32_t from;                      // Premier numéro de séquence voulu
+} flashlog_cursor_t;
+
+// Function exported for other source file
+// =======================================
+bool     flashlog_setup(void);
+bool     flashlog_append(uint8_t type, const void * data, uint8_t len);
+void     flashlog_rewind(flashlog_cursor_t * cur, uint32_t from);
+bool     flashlog_next(flashlog_cursor_t * cur, flashlog_rec_t * rec);
+int      flashlog_format(char * buff, int size, flashlog_rec_t * rec);
+uint32_t flashlog_seq(void);
+
+#ifdef FLASHLOG_SIM
+  uint32_t flashlog_sim_erase_count(uint16_t sector);
+  void     flashlog_sim_power_cut(uint16_t bytes);
+#else
+  void     flashlog_fp(uint8_t fp, char ordre);
+  void     flashlog_relais(uint8_t etat);
+#endif
+
+#endif
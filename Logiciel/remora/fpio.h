@@ -0,0 +1,271 @@
+// **********************************************************************************
+// Sorties fils pilotes header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Accès aux sorties des fils pilotes, choisi à la compilation
+//           selon la carte : GPIO du Spark (1.0/1.1), MCP23017 (1.2) ou
+//           simulation sur PC (FPIO_HOST) qui enregistre les écritures
+//
+// Toutes les fonctions sont statiques et inline, pilotes.cpp appelle FpIO
+// sans indirection : sur carte 1.2 une écriture ne coûte que la mise à jour
+// de l'image du port, le bus I2C n'est utilisé qu'en fin de mise à jour
+//
+// **********************************************************************************
+#ifndef FPIO_h
+#define FPIO_h
+
+// FPIO_HOST permet de compiler la couche seule sur un PC, avec le
+// câblage de la carte 1.2 par défaut (voir Logiciel/host/fpio_bench.cpp)
+#ifdef FPIO_HOST
+  #include <stdint.h>
+  #include <string.h>
+  #ifndef NB_FP_CARTE
+    #define NB_FP_CARTE 7
+    #define FP1 14,15
+    #define FP2 12,13
+    #define FP3 10,11
+    #define FP4  1,0
+    #define FP5  3,2
+    #define FP6  5,4
+    #define FP7  7,6
+  #endif
+  #ifndef MCP_NB
+    #define MCP_NB 1
+  #endif
+  #ifndef NB_FILS_PILOTES
+    #define NB_FILS_PILOTES (NB_FP_CARTE + 8*(MCP_NB-1))
+  #endif
+  // Taille du journal des écritures simulées
+  #ifndef FPIO_MOCK_LOG
+    #define FPIO_MOCK_LOG 256
+  #endif
+#endif
+
+// Broches a et b des zones de la carte
+constexpr uint8_t fp_pins_carte[NB_FP_CARTE*2] = {
+  FP1,FP2,FP3,FP4,FP5,FP6
+#ifdef FP7
+  ,FP7
+#endif
+};
+
+// Expander et broches d'une zone, les zones au delà de la carte sont sur
+// les expanders ajoutés, 8 par expander dans l'ordre GPA0/GPA1..GPB6/GPB7
+constexpr uint8_t fpZoneExp(uint8_t i)
+{
+  return i < NB_FP_CARTE ? 0 : 1 + (i-NB_FP_CARTE)/8;
+}
+constexpr uint8_t fpZonePinA(uint8_t i)
+{
+  return i < NB_FP_CARTE ? fp_pins_carte[2*i] : 2*((i-NB_FP_CARTE)%8);
+}
+constexpr uint8_t fpZonePinB(uint8_t i)
+{
+  return i < NB_FP_CARTE ? fp_pins_carte[2*i+1] : 2*((i-NB_FP_CARTE)%8)+1;
+}
+
+// Image des ports de N expanders, écrite seulement si modifiée et hors
+// mise à jour groupée. Write(e, gpio) est l'écriture effective
+template <uint8_t N, void (*Write)(uint8_t, uint16_t)>
+struct FpShadow
+{
+  static uint16_t gpio[N];
+  static uint8_t  dirty;  // Masque des expanders à écrire
+  static uint8_t  batch;  // Niveau d'imbrication des mises à jour groupées
+
+  static inline void flush(void)
+  {
+    for (uint8_t e=0; dirty && e<N; e++) {
+      if (dirty & (1<<e)) {
+        Write(e, gpio[e]);
+        dirty &= ~(1<<e);
+      }
+    }
+  }
+
+  static inline void pinWrite(uint8_t exp, uint8_t pin, uint8_t level)
+  {
+    if (exp >= N)
+      return;
+
+    uint16_t v = level ? gpio[exp] | (1<<pin) : gpio[exp] & ~(1<<pin);
+
+    if (v != gpio[exp]) {
+      gpio[exp] = v;
+      dirty |= 1<<exp;
+    }
+    if (!batch)
+      flush();
+  }
+
+  static inline void batchBegin(void) { batch++; }
+  static inline void batchEnd(void)   { if (batch && !--batch) flush(); }
+};
+
+template <uint8_t N, void (*Write)(uint8_t, uint16_t)>
+uint16_t FpShadow<N,Write>::gpio[N];
+template <uint8_t N, void (*Write)(uint8_t, uint16_t)>
+uint8_t FpShadow<N,Write>::dirty = 0;
+template <uint8_t N, void (*Write)(uint8_t, uint16_t)>
+uint8_t FpShadow<N,Write>::batch = 0;
+
+#if defined (FPIO_HOST)
+
+// Simulation : même image que sur le MCP23017, chaque transaction bus
+// est enregistrée pour les mesures
+template <uint16_t SIZE>
+struct FpMockLog
+{
+  typedef struct
+  {
+    uint8_t  exp;
+    uint16_t gpio;
+  } bus_t;
+
+  static bus_t    bus[SIZE];  // Premières transactions bus
+  static uint16_t nbBus;      // Nombre de transactions enregistrées
+  static uint32_t busWrites;  // Total des transactions bus
+  static uint32_t pinWrites;  // Total des écritures de broche
+
+  static void write(uint8_t exp, uint16_t gpio)
+  {
+    if (nbBus < SIZE) {
+      bus[nbBus].exp  = exp;
+      bus[nbBus].gpio = gpio;
+      nbBus++;
+    }
+    busWrites++;
+  }
+
+  static void reset(void)
+  {
+    nbBus = 0;
+    busWrites = 0;
+    pinWrites = 0;
+  }
+};
+
+template <uint16_t SIZE>
+typename FpMockLog<SIZE>::bus_t FpMockLog<SIZE>::bus[SIZE];
+template <uint16_t SIZE>
+uint16_t FpMockLog<SIZE>::nbBus = 0;
+template <uint16_t SIZE>
+uint32_t FpMockLog<SIZE>::busWrites = 0;
+template <uint16_t SIZE>
+uint32_t FpMockLog<SIZE>::pinWrites = 0;
+
+inline void fpMockWrite(uint8_t exp, uint16_t gpio) { FpMockLog<FPIO_MOCK_LOG>::write(exp, gpio); }
+
+template <uint8_t N>
+struct FpMockIO : FpShadow<N, fpMockWrite>
+{
+  typedef FpShadow<N, fpMockWrite> shadow;
+  typedef FpMockLog<FPIO_MOCK_LOG> log;
+
+  static bool begin(void)
+  {
+    memset(shadow::gpio, 0, sizeof(shadow::gpio));
+    shadow::dirty = 0;
+    shadow::batch = 0;
+    log::reset();
+    return true;
+  }
+
+  static inline void pinWrite(uint8_t exp, uint8_t pin, uint8_t level)
+  {
+    log::pinWrites++;
+    shadow::pinWrite(exp, pin, level);
+  }
+};
+
+typedef FpMockIO<MCP_NB> FpIO;
+
+#elif defined (REMORA_BOARD_V12)
+
+// Expanders, le 1er (mcp, adresse 0x20) est celui de la carte, les suivants
+// sont aux adresses 0x21 et plus
+extern Adafruit_MCP23017 mcp;
+
+template <uint8_t N>
+struct FpMcpDevices
+{
+  static Adafruit_MCP23017 ext[N > 1 ? N-1 : 1];
+
+  static inline Adafruit_MCP23017 & dev(uint8_t e) { return e ? ext[e-1] : mcp; }
+  static void write(uint8_t e, uint16_t gpio) { dev(e).writeGPIOAB(gpio); }
+};
+
+template <uint8_t N>
+Adafruit_MCP23017 FpMcpDevices<N>::ext[N > 1 ? N-1 : 1];
+
+inline void fpMcpWrite(uint8_t e, uint16_t gpio) { FpMcpDevices<MCP_NB>::write(e, gpio); }
+
+template <uint8_t N>
+struct FpMcpIO : FpShadow<N, fpMcpWrite>
+{
+  typedef FpShadow<N, fpMcpWrite> shadow;
+  typedef FpMcpDevices<N> devices;
+
+  // Retourne false si l'expander de la carte est absent, un expander
+  // ajouté absent ne bloque pas les autres zones
+  static bool begin(void)
+  {
+    for (uint8_t e=0; e<N; e++) {
+      if (!i2c_detect(MCP23017_ADDRESS+e)) {
+        if (!e)
+          return false;
+        Serial.print("MCP 0x");
+        Serial.print(MCP23017_ADDRESS+e, HEX);
+        Serial.print(" not found...");
+        continue;
+      }
+
+      devices::dev(e).begin(e);
+
+      // On repart des latchs de sortie, conservés si seul
+      // le micro a redémarré
+      shadow::gpio[e] = devices::dev(e).readRegister(MCP23017_OLATA) |
+                        devices::dev(e).readRegister(MCP23017_OLATB) << 8;
+
+      // Mettre les 16 I/O PIN en sortie
+      devices::dev(e).writeRegister(MCP23017_IODIRA,0x00);
+      devices::dev(e).writeRegister(MCP23017_IODIRB,0x00);
+    }
+    return true;
+  }
+};
+
+typedef FpMcpIO<MCP_NB> FpIO;
+
+#else
+
+// GPIO du Spark, écriture directe dans les registres du port
+struct FpNativeIO
+{
+  static bool begin(void)
+  {
+    // 2 pins pour commander 1 fil pilote
+    for (uint8_t i=0; i<NB_FP_CARTE*2; i++)
+      pinMode(fp_pins_carte[i], OUTPUT);
+    return true;
+  }
+
+  static inline void pinWrite(uint8_t, uint8_t pin, uint8_t level)
+  {
+    if (level)
+      pinSetFast(pin);
+    else
+      pinResetFast(pin);
+  }
+
+  static inline void batchBegin(void) {}
+  static inline void batchEnd(void) {}
+};
+
+typedef FpNativeIO FpIO;
+
+#endif
+
+#endif
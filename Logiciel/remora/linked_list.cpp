@@ -83,6 +83,7 @@ NodeList * ll_Add(NodeList * me, uint8_t groupid, uint8_t nodeid, int8_t rssi, u
         // Update data
         me->rssi = rssi ;
         me->lastseen = *sec;
+        me->packets++;
 
         // Return old value
         *sec = old_sec;
@@ -101,6 +102,15 @@ NodeList * ll_Add(NodeList * me, uint8_t groupid, uint8_t nodeid, int8_t rssi, u
       newNode->nodeid = nodeid;
       newNode->rssi = rssi ;
       newNode->lastseen = *sec;
+      newNode->packets = 1;
+      newNode->seqid = 0;
+      newNode->lost = 0;
+      newNode->dups = 0;
+      newNode->rssi_avg = (int16_t) rssi * 16;
+      newNode->power = RF_LINK_POWER_DEFAULT;
+      newNode->modem = RF_LINK_MODEMS - 1;
+      newNode->window = 0;
+      newNode->window_bad = 0;
 
       // add the new node on the list
       me->next = newNode;
@@ -139,6 +149,8 @@ uint8_t ll_Dump(NodeList * me, unsigned long sec)
       Serial.print(F("  Node:"));  Serial.print(me->nodeid, DEC) ;
       Serial.print(F("  RSSI:"));  Serial.print(me->rssi, DEC) ;
       Serial.print(F("  seen:"));  Serial.print(sec-me->lastseen) ;
+      Serial.print(F("  lost:"));  Serial.print(me->lost) ;
+      Serial.print(F("  dups:"));  Serial.print(me->dups) ;
       Serial.println(F("")) ;
     }
   }
@@ -32,11 +32,20 @@ struct _NodeList
   uint8_t groupid;        // Network ID
   int8_t  rssi;           // RSSI
   unsigned long lastseen; // Last seen time (in second)
+  uint32_t packets;       // Packets received from this node
+  uint8_t  seqid;         // Last sequence ID received
+  uint16_t lost;          // Packets missed (sequence gaps)
+  uint16_t dups;          // Retransmissions received twice
+  int16_t  rssi_avg;      // RSSI average (1/16 dB), see rflink
+  int8_t   power;         // TX power asked to node (dBm)
+  uint8_t  modem;         // Fastest rflink_modems[] entry for the link
+  uint8_t  window;        // Frames received in current rflink window
+  uint16_t window_bad;    // lost + dups at window start
 };
 
 // Variables exported to other source file
 // ========================================
-// extern _NodeList nodes_list;
+extern NodeList nodes_list;
 
 // Function exported to other source file
 // =======================================
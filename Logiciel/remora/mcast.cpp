@@ -0,0 +1,164 @@
+// **********************************************************************************
+// Diffusion multicast de la téléinfo pour remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Chaque trame téléinfo modifiée est envoyée une seule fois en UDP
+//           multicast, quel que soit le nombre de récepteurs sur le réseau.
+//           Les récepteurs détectent les trames perdues grâce au numéro de
+//           séquence (voir Logiciel/host/mcast_rx)
+//
+// **********************************************************************************
+
+#include "mcast.h"
+
+#ifdef MOD_MCAST
+
+#ifdef SPARK
+  UDP mcast_udp;
+#endif
+#ifdef ESP8266
+  WiFiUDP mcast_udp;
+#endif
+
+IPAddress mcast_group(MCAST_GROUP);
+uint16_t mcast_boot;    // Identifiant du démarrage
+uint32_t mcast_seq = 0; // Dernière trame envoyée
+
+// Datagramme en cours de remplissage
+uint8_t  mcast_buf[sizeof(mcast_hdr_t) + MCAST_PAYLOAD];
+uint16_t mcast_len;
+
+/* ======================================================================
+Function: mcast_send
+Purpose : envoie le datagramme en cours
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void mcast_send(void)
+{
+  mcast_hdr_t * hdr = (mcast_hdr_t *) mcast_buf;
+
+  hdr->len = mcast_len;
+
+  #ifdef SPARK
+    mcast_udp.sendPacket(mcast_buf, sizeof(mcast_hdr_t) + mcast_len, mcast_group, MCAST_PORT);
+  #endif
+  #ifdef ESP8266
+    mcast_udp.beginPacketMulticast(mcast_group, MCAST_PORT, WiFi.localIP(), MCAST_TTL);
+    mcast_udp.write(mcast_buf, sizeof(mcast_hdr_t) + mcast_len);
+    mcast_udp.endPacket();
+  #endif
+
+  hdr->frag++;
+  mcast_len = 0;
+}
+
+/* ======================================================================
+Function: mcast_put
+Purpose : ajoute des données à la trame
+Input   : données et taille
+Output  : -
+Comments: un datagramme est envoyé chaque fois qu'il est plein
+====================================================================== */
+void mcast_put(const char * data, uint16_t len)
+{
+  uint8_t * payload = mcast_buf + sizeof(mcast_hdr_t);
+  uint16_t n;
+
+  while (len) {
+    n = min(len, MCAST_PAYLOAD - mcast_len);
+    memcpy(payload + mcast_len, data, n);
+    mcast_len += n;
+    data += n;
+    len -= n;
+
+    if (mcast_len == MCAST_PAYLOAD)
+      mcast_send();
+  }
+}
+
+/* ======================================================================
+Function: mcast_frame
+Purpose : diffuse une trame téléinfo
+Input   : liste des étiquettes de la trame
+Output  : -
+Comments: appelé par le callback de trame modifiée
+====================================================================== */
+void mcast_frame(ValueList * me)
+{
+  mcast_hdr_t * hdr = (mcast_hdr_t *) mcast_buf;
+  ValueList * first = me;
+  uint16_t total = 0;
+
+  // Taille de la trame pour connaître le nombre de fragments
+  while (me->next) {
+    me = me->next;
+    if (me->name && me->value)
+      total += strlen(me->name) + strlen(me->value) + 2;
+  }
+
+  if (!total || total > MCAST_PAYLOAD * MCAST_MAX_FRAG)
+    return;
+
+  hdr->magic   = MCAST_MAGIC;
+  hdr->version = MCAST_VERSION;
+  hdr->frag    = 0;
+  hdr->nbfrag  = (total + MCAST_PAYLOAD - 1) / MCAST_PAYLOAD;
+  hdr->pad     = 0;
+  hdr->boot    = mcast_boot;
+  hdr->seq     = ++mcast_seq;
+  mcast_len = 0;
+
+  me = first;
+  while (me->next) {
+    me = me->next;
+    if (me->name && me->value) {
+      mcast_put(me->name, strlen(me->name));
+      mcast_put("\t", 1);
+      mcast_put(me->value, strlen(me->value));
+      mcast_put("\n", 1);
+    }
+  }
+
+  // Dernier fragment incomplet
+  if (mcast_len)
+    mcast_send();
+}
+
+/* ======================================================================
+Function: mcast_setup
+Purpose : prépare la diffusion
+Input   : -
+Output  : true si OK
+Comments: la socket est ouverte par mcast_start
+====================================================================== */
+bool mcast_setup(void)
+{
+  // Les récepteurs distinguent ainsi un redémarrage d'une perte de trames
+  mcast_boot = bootId();
+
+  Serial.print("Teleinfo multicast sur le port ");
+  Serial.println(MCAST_PORT);
+  return true;
+}
+
+/* ======================================================================
+Function: mcast_start
+Purpose : ouvre la socket de diffusion
+Input   : -
+Output  : -
+Comments: à appeler une fois le réseau disponible et à chaque
+          reconnexion, la numérotation des trames continue
+====================================================================== */
+void mcast_start(void)
+{
+  #ifdef SPARK
+    mcast_udp.stop();
+    mcast_udp.begin(MCAST_PORT);
+  #endif
+}
+
+#endif // MOD_MCAST
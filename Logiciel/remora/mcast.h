@@ -0,0 +1,56 @@
+// **********************************************************************************
+// Diffusion multicast de la téléinfo header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Chaque trame téléinfo modifiée est envoyée une seule fois en UDP
+//           multicast, quel que soit le nombre de récepteurs sur le réseau
+//
+// **********************************************************************************
+#ifndef MCAST_h
+#define MCAST_h
+
+// MCAST_HOST permet d'utiliser le format des datagrammes sur un PC
+// (voir Logiciel/host), sans le reste du projet
+#ifdef MCAST_HOST
+  #include <stdint.h>
+#else
+  #include "remora.h"
+#endif
+
+// Groupe et port de diffusion
+#define MCAST_GROUP     239,255,70,80
+#define MCAST_PORT      7080
+#define MCAST_TTL       1       // Réseau local uniquement
+
+// Format des datagrammes
+#define MCAST_MAGIC     0x5452  // "RT"
+#define MCAST_VERSION   1
+#define MCAST_PAYLOAD   480     // Données par datagramme, sous la MTU
+#define MCAST_MAX_FRAG  8       // Une trame fait au plus 8 datagrammes
+
+// Entête de chaque datagramme, little endian. La trame est une suite de
+// lignes "ETIQUETTE\tVALEUR\n" découpée en fragments de MCAST_PAYLOAD
+// octets, le dernier pouvant être plus court
+typedef struct __attribute__((packed))
+{
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  frag;      // Numéro du fragment (0 à nbfrag-1)
+  uint8_t  nbfrag;    // Nombre de fragments de la trame
+  uint8_t  pad;
+  uint16_t boot;      // Change à chaque démarrage de la carte
+  uint32_t seq;       // Numéro de la trame, +1 à chaque trame envoyée
+  uint16_t len;       // Taille des données de ce fragment
+} mcast_hdr_t;
+
+// Function exported for other source file
+// =======================================
+#ifndef MCAST_HOST
+  bool mcast_setup(void);
+  void mcast_start(void);
+  void mcast_frame(ValueList * me);
+#endif
+
+#endif
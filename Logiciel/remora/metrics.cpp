@@ -0,0 +1,485 @@
+// **********************************************************************************
+// Exposition Prometheus pour remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Métriques au format texte Prometheus (/metrics) : téléinfo,
+//           zones, délestage, noeuds RF et fonctionnement interne
+//
+//           Les valeurs sont écrites sur METRICS_WIDTH caractères avec des
+//           zéros non significatifs (00000001234), ce que Prometheus accepte,
+//           pour pouvoir les réécrire sur place sans décaler le texte
+//
+// **********************************************************************************
+
+#include <stdarg.h>
+#include "metrics.h"
+
+#ifdef MOD_METRICS
+
+// Index téléinfo exposés, un par tarif
+const char * metrics_index[] = { "BASE", "HCHC", "HCHP", "EJPHN", "EJPHPM",
+                                 "BBRHCJB", "BBRHPJB", "BBRHCJW", "BBRHPJW",
+                                 "BBRHCJR", "BBRHPJR" };
+#define METRICS_NB_INDEX (sizeof(metrics_index)/sizeof(metrics_index[0]))
+
+// Intensité instantanée, IINST en monophasé et IINST1 à 3 en triphasé
+const char * metrics_iinst[] = { "IINST", "IINST1", "IINST2", "IINST3" };
+
+// Origine d'une valeur
+enum metrics_id_e { M_NONE, M_UPTIME, M_HEAP, M_HEAP_FRAG, M_LOOP_MAX, M_LOOPS,
+                    M_TINFO_FRAMES, M_INDEX, M_IINST, M_PAPP, M_ISOUSC,
+                    M_FP, M_DELEST, M_DELESTAGES, M_RELESTAGES, M_RAMP, M_RELAIS,
+                    M_RF_RSSI, M_RF_PACKETS, M_RF_SEEN, M_RF_RX_MAX,
+                    M_RF_RX_OVER, M_RF_RX_DROPPED, M_RF_REPLY, M_RF_REPLY_SUM,
+                    M_RF_REPLY_EXPIRED, M_RF_LOST, M_RF_DUPS, M_RF_DOWN,
+                    M_RF_DOWN_DELIVERED, M_RF_DOWN_DROPPED, M_RF_LEASES,
+                    M_RF_OTA_STATE, M_RF_OTA_RESENT, M_RF_OTA_GOODPUT, M_RF_OTA_BITRATE,
+                    M_RF_POWER, M_RF_LINK_BITRATE, M_RF_NET_BITRATE,
+                    M_RF_BATCH_READINGS, M_RF_BATCH_MERGED, M_RF_BATCH_SENT, M_RF_BATCH_BYTES };
+
+char metrics_buf[METRICS_SIZE];
+uint16_t metrics_len = 0;
+metrics_slot_t metrics_slots[METRICS_SLOTS];
+uint8_t metrics_nb_slots = 0;
+bool metrics_full;
+uint32_t metrics_layout = 0xFFFFFFFF; // Jamais construit
+
+// metrics_nb_slots et le rang d'un noeud tiennent sur un octet
+static_assert(METRICS_SLOTS <= 255, "METRICS_SLOTS trop grand");
+
+// Durée de la boucle principale
+unsigned long metrics_loop_last = 0;
+unsigned long metrics_loop_max = 0;   // Depuis la dernière lecture (µs)
+uint32_t metrics_loops = 0;
+
+/* ======================================================================
+Function: metrics_loop
+Purpose : mesure la durée d'un tour de boucle
+Input   : -
+Output  : -
+Comments: à appeler une fois par tour de loop()
+====================================================================== */
+void metrics_loop(void)
+{
+  unsigned long now = micros();
+
+  if (metrics_loops && now - metrics_loop_last > metrics_loop_max)
+    metrics_loop_max = now - metrics_loop_last;
+
+  metrics_loop_last = now;
+  metrics_loops++;
+}
+
+/* ======================================================================
+Function: metrics_tinfo
+Purpose : valeur numérique d'une étiquette de la dernière trame
+Input   : étiquette, valeur trouvée (peut être NULL)
+Output  : true si l'étiquette est présente et numérique
+Comments: utilise l'index de /json, sans parcourir la liste téléinfo
+====================================================================== */
+bool metrics_tinfo(const char * label, long * value)
+{
+  #ifdef MOD_TELEINFO
+  uint16_t len;
+  const char * p = tinfo_json_label(label, &len);
+
+  if (p) {
+    p = strchr(p, ':') + 1;
+    if (*p != '"') {
+      if (value)
+        *value = strtol(p, NULL, 10);
+      return true;
+    }
+  }
+  #endif
+  return false;
+}
+
+/* ======================================================================
+Function: metrics_rf_node
+Purpose : noeud RF d'un rang donné
+Input   : rang (0 pour le premier), nombre de noeuds (peut être NULL)
+Output  : noeud, NULL si le rang n'existe pas, le nombre de noeuds est
+          alors rempli
+Comments: la liste ne fait que grandir, le rang d'un noeud ne change pas
+====================================================================== */
+#ifdef MOD_RF69
+NodeList * metrics_rf_node(uint8_t rank, uint8_t * count)
+{
+  NodeList * me = &nodes_list;
+  uint8_t n = 0;
+
+  while (me->next) {
+    me = me->next;
+    if (n++ == rank)
+      return me;
+  }
+  if (count)
+    *count = n;
+  return NULL;
+}
+#endif
+
+/* ======================================================================
+Function: metrics_layout_key
+Purpose : résume ce qui détermine les lignes du texte
+Input   : -
+Output  : clé, différente si le texte doit être reconstruit
+Comments: index et intensités présents, nombre de noeuds RF exposés
+====================================================================== */
+uint32_t metrics_layout_key(void)
+{
+  uint32_t key = 0;
+  uint8_t i;
+
+  for (i=0; i<METRICS_NB_INDEX; i++)
+    if (metrics_tinfo(metrics_index[i], NULL))
+      key |= 1UL << i;
+
+  for (i=0; i<4; i++)
+    if (metrics_tinfo(metrics_iinst[i], NULL))
+      key |= 1UL << (METRICS_NB_INDEX+i);
+
+  #ifdef MOD_RF69
+    metrics_rf_node(255, &i);
+    if (i > METRICS_RF_NODES)
+      i = METRICS_RF_NODES;
+    key |= (uint32_t) i << 16;
+  #endif
+
+  return key;
+}
+
+/* ======================================================================
+Function: metrics_add
+Purpose : ajoute une ligne au texte
+Input   : origine de la valeur (M_NONE pour une ligne de commentaire),
+          argument, format printf du nom et ses arguments
+Output  : -
+Comments: la ligne entière ou rien, le texte est marqué plein sinon
+====================================================================== */
+void metrics_add(uint8_t id, uint8_t arg, const char * fmt, ...)
+{
+  char buff[112];
+  va_list args;
+  int len;
+
+  if (metrics_full)
+    return;
+
+  va_start(args, fmt);
+  len = vsnprintf(buff, sizeof(buff) - METRICS_WIDTH - 2, fmt, args);
+  va_end(args);
+
+  if (len >= (int) sizeof(buff) - METRICS_WIDTH - 2 ||
+      metrics_len + len + METRICS_WIDTH + 2 > METRICS_SIZE ||
+      (id != M_NONE && metrics_nb_slots >= METRICS_SLOTS)) {
+    metrics_full = true;
+    return;
+  }
+
+  // Place de la valeur, remplie à chaque lecture
+  if (id != M_NONE) {
+    buff[len++] = ' ';
+    metrics_slots[metrics_nb_slots].pos = metrics_len + len;
+    metrics_slots[metrics_nb_slots].id = id;
+    metrics_slots[metrics_nb_slots].arg = arg;
+    metrics_nb_slots++;
+    memset(buff+len, '0', METRICS_WIDTH);
+    len += METRICS_WIDTH;
+  }
+  buff[len++] = '\n';
+
+  memcpy(metrics_buf+metrics_len, buff, len);
+  metrics_len += len;
+}
+
+/* ======================================================================
+Function: metrics_build
+Purpose : construit le texte, sans les valeurs
+Input   : clé de la disposition
+Output  : -
+Comments: -
+====================================================================== */
+void metrics_build(uint32_t layout)
+{
+  uint8_t i;
+
+  metrics_len = 0;
+  metrics_nb_slots = 0;
+  metrics_full = false;
+  metrics_layout = layout;
+
+  metrics_add(M_NONE, 0, "# TYPE remora_uptime_seconds counter");
+  metrics_add(M_UPTIME, 0, "remora_uptime_seconds");
+  metrics_add(M_NONE, 0, "# TYPE remora_heap_free_bytes gauge");
+  metrics_add(M_HEAP, 0, "remora_heap_free_bytes");
+  #if defined (ESP8266) && defined (METRICS_HEAP_FRAG)
+    metrics_add(M_NONE, 0, "# TYPE remora_heap_fragmentation_percent gauge");
+    metrics_add(M_HEAP_FRAG, 0, "remora_heap_fragmentation_percent");
+  #endif
+  metrics_add(M_NONE, 0, "# HELP remora_loop_max_microseconds Plus long tour de boucle depuis la lecture precedente");
+  metrics_add(M_NONE, 0, "# TYPE remora_loop_max_microseconds gauge");
+  metrics_add(M_LOOP_MAX, 0, "remora_loop_max_microseconds");
+  metrics_add(M_NONE, 0, "# TYPE remora_loops_total counter");
+  metrics_add(M_LOOPS, 0, "remora_loops_total");
+
+  #ifdef MOD_TELEINFO
+    metrics_add(M_NONE, 0, "# TYPE remora_tinfo_updated_frames_total counter");
+    metrics_add(M_TINFO_FRAMES, 0, "remora_tinfo_updated_frames_total");
+    metrics_add(M_NONE, 0, "# TYPE remora_tinfo_energy_wh_total counter");
+    for (i=0; i<METRICS_NB_INDEX; i++)
+      if (layout & (1UL << i))
+        metrics_add(M_INDEX, i, "remora_tinfo_energy_wh_total{tarif=\"%s\"}", metrics_index[i]);
+    metrics_add(M_NONE, 0, "# TYPE remora_tinfo_iinst_amperes gauge");
+    for (i=0; i<4; i++)
+      if (layout & (1UL << (METRICS_NB_INDEX+i)))
+        metrics_add(M_IINST, i, "remora_tinfo_iinst_amperes{phase=\"%d\"}", i ? i : 1);
+    metrics_add(M_NONE, 0, "# TYPE remora_tinfo_papp_va gauge");
+    metrics_add(M_PAPP, 0, "remora_tinfo_papp_va");
+    metrics_add(M_NONE, 0, "# TYPE remora_tinfo_isousc_amperes gauge");
+    metrics_add(M_ISOUSC, 0, "remora_tinfo_isousc_amperes");
+  #endif
+
+  metrics_add(M_NONE, 0, "# HELP remora_fp_mode 0=C 1=E 2=H 3=A 4=1 5=2 6=D");
+  metrics_add(M_NONE, 0, "# TYPE remora_fp_mode gauge");
+  for (i=0; i<NB_FILS_PILOTES; i++)
+    metrics_add(M_FP, i, "remora_fp_mode{zone=\"%d\"}", i+1);
+  metrics_add(M_NONE, 0, "# TYPE remora_delest_level gauge");
+  metrics_add(M_DELEST, 0, "remora_delest_level");
+  metrics_add(M_NONE, 0, "# TYPE remora_delest_total counter");
+  metrics_add(M_DELESTAGES, 0, "remora_delest_total");
+  metrics_add(M_NONE, 0, "# TYPE remora_relest_total counter");
+  metrics_add(M_RELESTAGES, 0, "remora_relest_total");
+  metrics_add(M_NONE, 0, "# HELP remora_ramp_pending Zones en attente de montee en charge");
+  metrics_add(M_NONE, 0, "# TYPE remora_ramp_pending gauge");
+  metrics_add(M_RAMP, 0, "remora_ramp_pending");
+  #ifndef REMORA_BOARD_V10
+    metrics_add(M_NONE, 0, "# TYPE remora_relais_state gauge");
+    metrics_add(M_RELAIS, 0, "remora_relais_state");
+  #endif
+
+  #ifdef MOD_RF69
+  {
+    uint8_t count = layout >> 16;
+    NodeList * me;
+
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_rx_max_microseconds gauge");
+    metrics_add(M_RF_RX_MAX, 0, "remora_rf_rx_max_microseconds");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_rx_over_budget_total counter");
+    metrics_add(M_RF_RX_OVER, 0, "remora_rf_rx_over_budget_total");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_rx_dropped_total counter");
+    metrics_add(M_RF_RX_DROPPED, 0, "remora_rf_rx_dropped_total");
+    metrics_add(M_NONE, 0, "# HELP remora_rf_reply_latency_ms Delai entre reception et envoi ACK/PINGBACK");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_reply_latency_ms histogram");
+    for (uint8_t i=0; i<RF_REPLY_BUCKETS; i++)
+      metrics_add(M_RF_REPLY, i, "remora_rf_reply_latency_ms_bucket{le=\"%d\"}", rf_reply_bounds[i]);
+    metrics_add(M_RF_REPLY, RF_REPLY_BUCKETS, "remora_rf_reply_latency_ms_bucket{le=\"+Inf\"}");
+    metrics_add(M_RF_REPLY_SUM, 0, "remora_rf_reply_latency_ms_sum");
+    metrics_add(M_RF_REPLY, RF_REPLY_BUCKETS, "remora_rf_reply_latency_ms_count");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_reply_expired_total counter");
+    metrics_add(M_RF_REPLY_EXPIRED, 0, "remora_rf_reply_expired_total");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_rssi_dbm gauge");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_RSSI, i, "remora_rf_rssi_dbm{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_packets_total counter");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_PACKETS, i, "remora_rf_packets_total{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_last_seen_seconds gauge");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_SEEN, i, "remora_rf_last_seen_seconds{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# HELP remora_rf_lost_total Paquets manquants d'apres les numeros de sequence");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_lost_total counter");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_LOST, i, "remora_rf_lost_total{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# HELP remora_rf_duplicates_total Retransmissions deja recues (ACK perdu)");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_duplicates_total counter");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_DUPS, i, "remora_rf_duplicates_total{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# HELP remora_rf_downlink_pending Messages en attente de l'ACK de la prochaine trame du noeud");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_downlink_pending gauge");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_DOWN, i, "remora_rf_downlink_pending{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_downlink_delivered_total counter");
+    metrics_add(M_RF_DOWN_DELIVERED, 0, "remora_rf_downlink_delivered_total");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_downlink_dropped_total counter");
+    metrics_add(M_RF_DOWN_DROPPED, 0, "remora_rf_downlink_dropped_total");
+    metrics_add(M_NONE, 0, "# HELP remora_rf_dhcp_leases Identifiants de noeud attribues et non expires");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_dhcp_leases gauge");
+    metrics_add(M_RF_LEASES, 0, "remora_rf_dhcp_leases");
+    metrics_add(M_NONE, 0, "# HELP remora_rf_ota_state Mise a jour radio 0=aucune 1=proposee 2,3=en cours 4=faite 5=echec");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_ota_state gauge");
+    metrics_add(M_RF_OTA_STATE, 0, "remora_rf_ota_state");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_ota_blocks_resent gauge");
+    metrics_add(M_RF_OTA_RESENT, 0, "remora_rf_ota_blocks_resent");
+    metrics_add(M_NONE, 0, "# HELP remora_rf_ota_goodput_bps Debit utile de la derniere mise a jour, a comparer au debit radio");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_ota_goodput_bps gauge");
+    metrics_add(M_RF_OTA_GOODPUT, 0, "remora_rf_ota_goodput_bps");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_bitrate_bps gauge");
+    metrics_add(M_RF_OTA_BITRATE, 0, "remora_rf_bitrate_bps");
+    metrics_add(M_NONE, 0, "# HELP remora_rf_tx_power_dbm Puissance d'emission demandee au noeud, selon RSSI et pertes");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_tx_power_dbm gauge");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_POWER, i, "remora_rf_tx_power_dbm{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# HELP remora_rf_link_bitrate_bps Debit radio le plus rapide que permet la liaison du noeud");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_link_bitrate_bps gauge");
+    for (i=0; i<count && (me = metrics_rf_node(i, NULL)); i++)
+      metrics_add(M_RF_LINK_BITRATE, i, "remora_rf_link_bitrate_bps{group=\"%d\",node=\"%d\"}", me->groupid, me->nodeid);
+    metrics_add(M_NONE, 0, "# HELP remora_rf_network_bitrate_bps Debit radio le plus rapide possible pour tous les noeuds actifs");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_network_bitrate_bps gauge");
+    metrics_add(M_RF_NET_BITRATE, 0, "remora_rf_network_bitrate_bps");
+    #ifdef MOD_RF_BATCH
+    metrics_add(M_NONE, 0, "# HELP remora_rf_batch_readings_total Valeurs decodees des trames RF");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_batch_readings_total counter");
+    metrics_add(M_RF_BATCH_READINGS, 0, "remora_rf_batch_readings_total");
+    metrics_add(M_NONE, 0, "# HELP remora_rf_batch_merged_total Valeurs ayant remplace celle du meme noeud et type dans le lot");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_batch_merged_total counter");
+    metrics_add(M_RF_BATCH_MERGED, 0, "remora_rf_batch_merged_total");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_batch_sent_total counter");
+    metrics_add(M_RF_BATCH_SENT, 0, "remora_rf_batch_sent_total");
+    metrics_add(M_NONE, 0, "# TYPE remora_rf_batch_bytes_total counter");
+    metrics_add(M_RF_BATCH_BYTES, 0, "remora_rf_batch_bytes_total");
+    #endif
+  }
+  #endif
+
+  if (metrics_full)
+    Serial.println(F("metrics_build : texte tronque, augmenter METRICS_SIZE"));
+}
+
+/* ======================================================================
+Function: metrics_value
+Purpose : valeur actuelle d'une ligne
+Input   : ligne
+Output  : valeur
+Comments: les valeurs signées (RSSI) sont rendues en complément à 2
+====================================================================== */
+uint32_t metrics_value(metrics_slot_t * s)
+{
+  long value = 0;
+
+  switch (s->id) {
+    case M_UPTIME:       return uptime;
+    #if defined (SPARK)
+    case M_HEAP:         return System.freeMemory();
+    #elif defined (ESP8266)
+    case M_HEAP:         return ESP.getFreeHeap();
+    #endif
+    #if defined (ESP8266) && defined (METRICS_HEAP_FRAG)
+    case M_HEAP_FRAG:    return ESP.getHeapFragmentation();
+    #endif
+    case M_LOOP_MAX:     return metrics_loop_max;
+    case M_LOOPS:        return metrics_loops;
+    #ifdef MOD_TELEINFO
+    case M_TINFO_FRAMES: return tinfo_json_seq;
+    case M_INDEX:        metrics_tinfo(metrics_index[s->arg], &value); return value;
+    case M_IINST:        metrics_tinfo(metrics_iinst[s->arg], &value); return value;
+    case M_PAPP:         return mypApp;
+    case M_ISOUSC:       return myisousc;
+    #endif
+    case M_FP:           return strchr("CEHA12D", etatFP[s->arg]) - "CEHA12D";
+    case M_DELEST:       return nivDelest;
+    case M_DELESTAGES:   return nbDelestages;
+    case M_RELESTAGES:   return nbRelestages;
+    case M_RAMP:         return rampCount;
+    #ifndef REMORA_BOARD_V10
+    case M_RELAIS:       return etatrelais;
+    #endif
+    #ifdef MOD_RF69
+    case M_RF_RX_MAX:    return driver.rxTimeMax();
+    case M_RF_RX_OVER:   return rf_rx_over_budget;
+    case M_RF_RX_DROPPED: return driver.rxDropped();
+    case M_RF_REPLY:
+    {
+      // Buckets Prometheus cumulés
+      uint32_t sum = 0;
+
+      for (uint8_t i=0; i<=s->arg; i++)
+        sum += rf_reply_hist[i];
+      return sum;
+    }
+    case M_RF_REPLY_SUM:     return rf_reply_sum;
+    case M_RF_REPLY_EXPIRED: return rf_reply_expired;
+    case M_RF_DOWN_DELIVERED: return rf_down_delivered;
+    case M_RF_DOWN_DROPPED:   return rf_down_dropped;
+    case M_RF_LEASES:         return rfm_dhcp_leases();
+    case M_RF_OTA_STATE:      return rfota.state;
+    case M_RF_OTA_RESENT:     return rfota.resent;
+    case M_RF_OTA_GOODPUT:    return rfota_goodput();
+    case M_RF_OTA_BITRATE:    return driver.bitRate();
+    case M_RF_NET_BITRATE:    return rflink_network_bitrate();
+    #ifdef MOD_RF_BATCH
+    case M_RF_BATCH_READINGS: return rfbatch_readings;
+    case M_RF_BATCH_MERGED:   return rfbatch_merged;
+    case M_RF_BATCH_SENT:     return rfbatch_sent;
+    case M_RF_BATCH_BYTES:    return rfbatch_bytes;
+    #endif
+    case M_RF_RSSI:
+    case M_RF_PACKETS:
+    case M_RF_SEEN:
+    case M_RF_LOST:
+    case M_RF_DUPS:
+    case M_RF_DOWN:
+    case M_RF_POWER:
+    case M_RF_LINK_BITRATE:
+    {
+      NodeList * me = metrics_rf_node(s->arg, NULL);
+
+      if (!me)
+        return 0;
+      if (s->id == M_RF_RSSI)
+        return (int32_t) me->rssi;
+      if (s->id == M_RF_PACKETS)
+        return me->packets;
+      if (s->id == M_RF_LOST)
+        return me->lost;
+      if (s->id == M_RF_DUPS)
+        return me->dups;
+      if (s->id == M_RF_DOWN)
+        return rfm_downlink_pending(me->nodeid);
+      if (s->id == M_RF_POWER)
+        return (int32_t) me->power;
+      if (s->id == M_RF_LINK_BITRATE)
+        return rflink_bitrate(me);
+      return uptime - me->lastseen;
+    }
+    #endif
+  }
+  return 0;
+}
+
+/* ======================================================================
+Function: metrics_text
+Purpose : met à jour les valeurs et retourne le texte
+Input   : taille du texte
+Output  : texte, valide jusqu'au prochain appel
+Comments: reconstruit seulement si les lignes ont changé
+====================================================================== */
+const char * metrics_text(uint16_t * len)
+{
+  char tmp[METRICS_WIDTH+2];
+  uint32_t layout = metrics_layout_key();
+  uint32_t value;
+  metrics_slot_t * s;
+
+  if (layout != metrics_layout)
+    metrics_build(layout);
+
+  for (uint8_t i=0; i<metrics_nb_slots; i++) {
+    s = &metrics_slots[i];
+    value = metrics_value(s);
+    if (s->id == M_RF_RSSI)
+      snprintf(tmp, sizeof(tmp), "%0*ld", METRICS_WIDTH, (long) (int32_t) value);
+    else
+      snprintf(tmp, sizeof(tmp), "%0*lu", METRICS_WIDTH, (unsigned long) value);
+    memcpy(metrics_buf + s->pos, tmp, METRICS_WIDTH);
+  }
+
+  metrics_loop_max = 0;
+  *len = metrics_len;
+  return metrics_buf;
+}
+
+#endif
@@ -0,0 +1,53 @@
+// **********************************************************************************
+// Exposition Prometheus header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Métriques au format texte Prometheus (/metrics) : téléinfo,
+//           zones, délestage, noeuds RF et fonctionnement interne
+//
+// **********************************************************************************
+#ifndef METRICS_h
+#define METRICS_h
+
+#include "remora.h"
+
+// Le texte est construit une seule fois avec des champs numériques de
+// largeur fixe, seuls les chiffres sont réécrits à chaque lecture. Il
+// n'est reconstruit que si les étiquettes téléinfo présentes ou le nombre
+// de noeuds RF changent
+#define METRICS_WIDTH       10  // Chiffres (et signe) d'une valeur
+
+// Taille du texte d'après ses lignes : une partie fixe (téléinfo triphasée
+// avec tous les index, RF et lots compris), une ligne par zone et 8 par
+// noeud RF. Les noeuds au-delà de METRICS_RF_NODES ne sont pas exposés
+#define METRICS_RF_NODES      8
+#define METRICS_FIXED_SIZE 6000
+#define METRICS_FP_SIZE      38   // Ligne d'une zone
+#define METRICS_NODE_SIZE   480   // Lignes d'un noeud RF
+#define METRICS_SIZE  (METRICS_FIXED_SIZE + NB_FILS_PILOTES*METRICS_FP_SIZE + \
+                       METRICS_RF_NODES*METRICS_NODE_SIZE)
+
+// Nombre maximal de valeurs, même découpage
+#define METRICS_SLOTS (64 + NB_FILS_PILOTES + 8*METRICS_RF_NODES)
+
+// Fragmentation du tas, nécessite le core ESP8266 2.5 ou plus
+//#define METRICS_HEAP_FRAG
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+
+// Une valeur du texte
+typedef struct
+{
+  uint16_t pos;     // Position des chiffres dans le texte
+  uint8_t  id;      // metrics_id_e
+  uint8_t  arg;     // Zone, phase, tarif ou rang du noeud RF
+} metrics_slot_t;
+
+// Function exported for other source file
+// =======================================
+void metrics_loop(void);
+const char * metrics_text(uint16_t * len);
+
+#endif
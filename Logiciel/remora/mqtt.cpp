@@ -0,0 +1,509 @@
+// **********************************************************************************
+// Client MQTT pour remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Publication MQTT (3.1.1, QoS 0) de la téléinfo, de l'état des
+//           zones et des capteurs RF
+//
+//           remora/tinfo/<ETIQUETTE>  valeur de l'étiquette
+//           remora/fp/<zone>          état de la zone (C, A, E, H, 1, 2, D)
+//           remora/delest             niveau de délestage
+//           remora/relais             état du relais
+//           remora/rf/batch           lot binaire des relevés RF (MOD_RF_BATCH,
+//                                     voir rfbatch.h)
+//           remora/rf/<node>          dernière trame du capteur (JSON), sans
+//                                     MOD_RF_BATCH
+//           remora/status             online / offline (testament)
+//
+//           Un topic n'est publié que si sa valeur change ou toutes les
+//           MQTT_HEARTBEAT ms. Les messages sont conservés (retain).
+//           Les lots RF sont publiés à chaque envoi, sans retain
+//
+// **********************************************************************************
+
+#include "mqtt.h"
+
+#ifdef MOD_MQTT
+
+#ifdef SPARK
+  TCPClient mqtt_client;
+#endif
+#ifdef ESP8266
+  WiFiClient mqtt_client;
+#endif
+
+uint8_t  mqtt_state = MQTT_DISCONNECTED;
+uint32_t mqtt_dropped = 0;            // Messages perdus, file pleine
+unsigned long mqtt_timer = 0;         // Dernière tentative ou CONNACK attendu
+unsigned long mqtt_last_ping = 0;     // Dernier PINGREQ
+unsigned long mqtt_last_rx = 0;       // Dernière réception du broker
+unsigned long mqtt_zones_timer = 0;   // Dernière scrutation des zones
+
+// File des paquets PUBLISH encodés, tampon circulaire
+uint8_t  mqtt_queue[MQTT_QUEUE_SIZE];
+uint16_t mqtt_head = 0;               // Prochain octet écrit
+uint16_t mqtt_tail = 0;               // Premier octet à envoyer
+uint16_t mqtt_used = 0;               // Octets dans la file
+
+mqtt_topic_t mqtt_topics[MQTT_TOPICS];
+
+/* ======================================================================
+Function: mqtt_hash
+Purpose : hash FNV-1a d'une chaîne
+Input   : chaîne
+Output  : hash, jamais 0
+Comments: -
+====================================================================== */
+uint32_t mqtt_hash(const char * str)
+{
+  uint32_t h = 2166136261UL;
+
+  while (*str) {
+    h ^= (uint8_t) *str++;
+    h *= 16777619UL;
+  }
+  return h ? h : 1;
+}
+
+/* ======================================================================
+Function: mqtt_changed
+Purpose : indique si un topic doit être publié
+Input   : hash du topic et de la valeur
+Output  : true si la valeur a changé ou si le heartbeat est dû
+Comments: la valeur est alors considérée comme publiée
+====================================================================== */
+bool mqtt_changed(uint32_t topic, uint32_t value)
+{
+  mqtt_topic_t * free_entry = NULL;
+  mqtt_topic_t * t;
+
+  for (uint8_t i=0; i<MQTT_TOPICS; i++) {
+    t = &mqtt_topics[i];
+    if (t->topic == topic) {
+      if (t->value == value && millis()-t->last < MQTT_HEARTBEAT)
+        return false;
+      t->value = value;
+      t->last = millis();
+      return true;
+    }
+    if (!t->topic && !free_entry)
+      free_entry = t;
+  }
+
+  // Nouveau topic, sans place il est publié à chaque fois
+  if (free_entry) {
+    free_entry->topic = topic;
+    free_entry->value = value;
+    free_entry->last = millis();
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: mqtt_peek
+Purpose : lit un octet de la file
+Input   : position depuis le début de la file
+Output  : octet
+Comments: -
+====================================================================== */
+uint8_t mqtt_peek(uint16_t pos)
+{
+  return mqtt_queue[(mqtt_tail + pos) % MQTT_QUEUE_SIZE];
+}
+
+/* ======================================================================
+Function: mqtt_packet_len
+Purpose : taille d'un paquet de la file
+Input   : position du paquet depuis le début de la file
+Output  : taille totale du paquet, entête fixe compris
+Comments: -
+====================================================================== */
+uint16_t mqtt_packet_len(uint16_t pos)
+{
+  uint16_t len = 0;
+  uint8_t i = 1, b;
+
+  // Longueur restante codée sur 1 ou 2 octets (paquets < 16Ko)
+  do {
+    b = mqtt_peek(pos+i);
+    len |= (b & 0x7F) << (7*(i-1));
+    i++;
+  } while ((b & 0x80) && i < 3);
+
+  return len + i;
+}
+
+/* ======================================================================
+Function: mqtt_enqueue
+Purpose : ajoute un paquet à la file
+Input   : paquet et taille
+Output  : -
+Comments: les paquets les plus anciens sont supprimés si la place manque
+====================================================================== */
+void mqtt_enqueue(const uint8_t * pkt, uint16_t len)
+{
+  uint16_t n;
+
+  if (len > MQTT_QUEUE_SIZE)
+    return;
+
+  while (MQTT_QUEUE_SIZE - mqtt_used < len) {
+    n = mqtt_packet_len(0);
+    mqtt_tail = (mqtt_tail + n) % MQTT_QUEUE_SIZE;
+    mqtt_used -= n;
+    mqtt_dropped++;
+  }
+
+  while (len) {
+    n = min(len, MQTT_QUEUE_SIZE - mqtt_head);
+    memcpy(mqtt_queue + mqtt_head, pkt, n);
+    mqtt_head = (mqtt_head + n) % MQTT_QUEUE_SIZE;
+    mqtt_used += n;
+    pkt += n;
+    len -= n;
+  }
+}
+
+/* ======================================================================
+Function: mqtt_string
+Purpose : encode une chaîne MQTT (longueur sur 2 octets puis données)
+Input   : tampon, chaîne
+Output  : nombre d'octets écrits
+Comments: -
+====================================================================== */
+uint16_t mqtt_string(uint8_t * buf, const char * str)
+{
+  uint16_t len = strlen(str);
+
+  buf[0] = len >> 8;
+  buf[1] = len & 0xFF;
+  memcpy(buf+2, str, len);
+  return len + 2;
+}
+
+/* ======================================================================
+Function: mqtt_header
+Purpose : encode l'entête fixe d'un paquet
+Input   : tampon, type et flags, longueur restante
+Output  : nombre d'octets écrits
+Comments: -
+====================================================================== */
+uint8_t mqtt_header(uint8_t * buf, uint8_t type, uint16_t len)
+{
+  uint8_t n = 1;
+
+  buf[0] = type;
+  do {
+    buf[n] = len & 0x7F;
+    len >>= 7;
+    if (len)
+      buf[n] |= 0x80;
+    n++;
+  } while (len);
+
+  return n;
+}
+
+/* ======================================================================
+Function: mqtt_publish
+Purpose : publie une valeur si elle a changé
+Input   : topic sous le préfixe (ex: "tinfo/PAPP") et valeur
+Output  : true si le message a été mis en file
+Comments: envoyé par mqtt_loop, y compris après une reconnexion
+====================================================================== */
+bool mqtt_publish(const char * topic, const char * value)
+{
+  char full[MQTT_TOPIC_SIZE];
+
+  snprintf(full, sizeof(full), "%s/%s", MQTT_PREFIX, topic);
+
+  if (!mqtt_changed(mqtt_hash(full), mqtt_hash(value)))
+    return false;
+
+  return mqtt_publish_raw(topic, (const uint8_t *) value, strlen(value), true);
+}
+
+/* ======================================================================
+Function: mqtt_publish_raw
+Purpose : publie un message quelconque, même inchangé
+Input   : topic sous le préfixe, données et taille, retenu par le broker
+Output  : true si le message a été mis en file
+Comments: pour les données binaires (lots de rfbatch)
+====================================================================== */
+bool mqtt_publish_raw(const char * topic, const uint8_t * value, uint16_t vlen, bool retain)
+{
+  char full[MQTT_TOPIC_SIZE];
+  uint8_t pkt[MQTT_TX_SIZE];
+  uint16_t tlen;
+  uint8_t n;
+
+  snprintf(full, sizeof(full), "%s/%s", MQTT_PREFIX, topic);
+
+  tlen = strlen(full);
+  if (tlen + vlen + 2 + 3 > sizeof(pkt))
+    return false;
+
+  // PUBLISH QoS 0
+  n = mqtt_header(pkt, retain ? 0x31 : 0x30, tlen + 2 + vlen);
+  n += mqtt_string(pkt+n, full);
+  memcpy(pkt+n, value, vlen);
+
+  mqtt_enqueue(pkt, n + vlen);
+  return true;
+}
+
+/* ======================================================================
+Function: mqtt_tinfo
+Purpose : publie les étiquettes d'une trame téléinfo
+Input   : liste des étiquettes
+Output  : -
+Comments: seules les étiquettes modifiées sont mises en file
+====================================================================== */
+void mqtt_tinfo(ValueList * me)
+{
+  char topic[MQTT_TOPIC_SIZE];
+
+  while (me->next) {
+    me = me->next;
+    if (me->name && me->value) {
+      snprintf(topic, sizeof(topic), "tinfo/%s", me->name);
+      mqtt_publish(topic, me->value);
+    }
+  }
+}
+
+/* ======================================================================
+Function: mqtt_zones
+Purpose : publie l'état des zones, du délestage et du relais
+Input   : -
+Output  : -
+Comments: seuls les changements sont mis en file
+====================================================================== */
+void mqtt_zones(void)
+{
+  char topic[16];
+  char value[8];
+
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    sprintf(topic, "fp/%d", i+1);
+    value[0] = etatFP[i];
+    value[1] = '\0';
+    mqtt_publish(topic, value);
+  }
+
+  sprintf(value, "%d", nivDelest);
+  mqtt_publish("delest", value);
+
+  #ifndef REMORA_BOARD_V10
+    sprintf(value, "%d", etatrelais);
+    mqtt_publish("relais", value);
+  #endif
+}
+
+/* ======================================================================
+Function: mqtt_connect
+Purpose : ouvre la connexion TCP et envoie le CONNECT
+Input   : -
+Output  : true si la connexion TCP est ouverte
+Comments: l'ouverture TCP est bloquante, d'où MQTT_RETRY
+====================================================================== */
+bool mqtt_connect(void)
+{
+  uint8_t pkt[128];
+  uint8_t var[128];
+  uint16_t len = 0;
+  uint8_t flags = 0x02 | 0x04 | 0x20; // Clean session, testament conservé
+  uint8_t n;
+
+  Serial.print("MQTT connexion a ");
+  Serial.print(MQTT_BROKER);
+  Serial.print("...");
+
+  if (!mqtt_client.connect(MQTT_BROKER, MQTT_PORT)) {
+    Serial.println("Echec");
+    return false;
+  }
+
+  #ifdef MQTT_USER
+    flags |= 0x80 | 0x40;
+  #endif
+
+  // Entête variable : protocole, niveau 4 (3.1.1), flags, keepalive
+  len += mqtt_string(var+len, "MQTT");
+  var[len++] = 4;
+  var[len++] = flags;
+  var[len++] = 0;
+  var[len++] = MQTT_KEEPALIVE;
+
+  // Charge : identifiant, testament, authentification
+  len += mqtt_string(var+len, MQTT_CLIENT_ID);
+  len += mqtt_string(var+len, MQTT_PREFIX "/status");
+  len += mqtt_string(var+len, "offline");
+  #ifdef MQTT_USER
+    len += mqtt_string(var+len, MQTT_USER);
+    len += mqtt_string(var+len, MQTT_PASS);
+  #endif
+
+  n = mqtt_header(pkt, 0x10, len);
+  memcpy(pkt+n, var, len);
+  mqtt_client.write(pkt, n + len);
+
+  Serial.println("OK");
+  return true;
+}
+
+/* ======================================================================
+Function: mqtt_flush
+Purpose : envoie les messages en file
+Input   : -
+Output  : false si l'écriture a échoué
+Comments: autant de paquets complets que possible par écriture TCP, ils
+          ne sont retirés de la file qu'une fois écrits
+====================================================================== */
+bool mqtt_flush(void)
+{
+  uint8_t tx[MQTT_TX_SIZE];
+  uint16_t len, n;
+
+  while (mqtt_used) {
+    len = 0;
+
+    // Paquets complets qui tiennent dans le tampon d'envoi
+    while (len < mqtt_used) {
+      n = mqtt_packet_len(len);
+      if (len + n > MQTT_TX_SIZE)
+        break;
+      for (uint16_t i=0; i<n; i++)
+        tx[len+i] = mqtt_peek(len+i);
+      len += n;
+    }
+
+    if (mqtt_client.write(tx, len) != len)
+      return false;
+
+    mqtt_tail = (mqtt_tail + len) % MQTT_QUEUE_SIZE;
+    mqtt_used -= len;
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: mqtt_disconnect
+Purpose : ferme la connexion
+Input   : -
+Output  : -
+Comments: une nouvelle tentative est faite après MQTT_RETRY
+====================================================================== */
+void mqtt_disconnect(void)
+{
+  mqtt_client.stop();
+  mqtt_state = MQTT_DISCONNECTED;
+  mqtt_timer = millis();
+}
+
+/* ======================================================================
+Function: mqtt_setup
+Purpose : prépare le client
+Input   : -
+Output  : -
+Comments: la connexion est ouverte par mqtt_loop
+====================================================================== */
+void mqtt_setup(void)
+{
+  memset(mqtt_topics, 0, sizeof(mqtt_topics));
+  mqtt_state = MQTT_DISCONNECTED;
+  mqtt_timer = millis() - MQTT_RETRY;
+}
+
+/* ======================================================================
+Function: mqtt_loop
+Purpose : gère la connexion et envoie les messages en file
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void mqtt_loop(void)
+{
+  unsigned long now = millis();
+
+  // Etat des zones, une fois par seconde
+  if (now - mqtt_zones_timer >= 1000) {
+    mqtt_zones_timer = now;
+    mqtt_zones();
+  }
+
+  if (mqtt_state == MQTT_DISCONNECTED) {
+    if (now - mqtt_timer < MQTT_RETRY)
+      return;
+
+    mqtt_timer = now;
+    if (mqtt_connect())
+      mqtt_state = MQTT_CONNECTING;
+    return;
+  }
+
+  if (!mqtt_client.connected()) {
+    Serial.println("MQTT connexion perdue");
+    mqtt_disconnect();
+    return;
+  }
+
+  // Attente du CONNACK : 0x20 0x02 flags code retour
+  if (mqtt_state == MQTT_CONNECTING) {
+    if (mqtt_client.available() >= 4) {
+      uint8_t ack[4];
+
+      for (uint8_t i=0; i<4; i++)
+        ack[i] = mqtt_client.read();
+
+      if (ack[0] != 0x20 || ack[3] != 0) {
+        Serial.print("MQTT refuse, code ");
+        Serial.println(ack[3]);
+        mqtt_disconnect();
+        return;
+      }
+
+      mqtt_state = MQTT_CONNECTED;
+      mqtt_last_rx = mqtt_last_ping = now;
+
+      // Le testament est remplacé, hors file pour passer en premier
+      uint8_t pkt[MQTT_TOPIC_SIZE];
+      uint8_t n = mqtt_header(pkt, 0x31, 2 + strlen(MQTT_PREFIX "/status") + 6);
+      n += mqtt_string(pkt+n, MQTT_PREFIX "/status");
+      memcpy(pkt+n, "online", 6);
+      mqtt_client.write(pkt, n + 6);
+    } else if (now - mqtt_timer > MQTT_CONNACK) {
+      Serial.println("MQTT pas de CONNACK");
+      mqtt_disconnect();
+    }
+    return;
+  }
+
+  // On ne reçoit que des PINGRESP, la connexion est vivante
+  while (mqtt_client.available()) {
+    mqtt_client.read();
+    mqtt_last_rx = now;
+  }
+
+  if (!mqtt_flush()) {
+    Serial.println("MQTT erreur d'envoi");
+    mqtt_disconnect();
+    return;
+  }
+
+  // PINGREQ à mi-keepalive, le PINGRESP prouve que le broker répond
+  if (now - mqtt_last_ping > MQTT_KEEPALIVE * 500UL) {
+    uint8_t ping[2] = { 0xC0, 0x00 };
+
+    mqtt_client.write(ping, 2);
+    mqtt_last_ping = now;
+  }
+  if (now - mqtt_last_rx > MQTT_KEEPALIVE * 1500UL) {
+    Serial.println("MQTT broker muet");
+    mqtt_disconnect();
+  }
+}
+
+#endif // MOD_MQTT
@@ -0,0 +1,63 @@
+// **********************************************************************************
+// Client MQTT header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Publication MQTT (3.1.1, QoS 0) de la téléinfo, de l'état des
+//           zones et des capteurs RF
+//
+// **********************************************************************************
+#ifndef MQTT_h
+#define MQTT_h
+
+#include "remora.h"
+
+// Broker, à adapter
+#define MQTT_BROKER     "192.168.1.2"
+#define MQTT_PORT       1883
+#define MQTT_CLIENT_ID  "remora"
+#define MQTT_PREFIX     "remora"    // Préfixe de tous les topics
+//#define MQTT_USER     "user"
+//#define MQTT_PASS     "password"
+
+#define MQTT_KEEPALIVE    60        // Secondes, PINGREQ à la moitié
+#define MQTT_RETRY     30000        // Délai entre 2 tentatives de connexion (ms)
+#define MQTT_CONNACK    5000        // Attente maximale du CONNACK (ms)
+#define MQTT_HEARTBEAT 300000       // Republication d'une valeur inchangée (ms)
+
+// Les messages sont mis en file, quelques centaines de messages sont
+// gardés tant que le broker est injoignable, les plus anciens sont perdus
+// au delà. Plusieurs messages sont envoyés par écriture TCP
+#define MQTT_QUEUE_SIZE  2048
+#define MQTT_TX_SIZE      512
+#define MQTT_TOPIC_SIZE    64
+
+// Dernière valeur publiée de chaque topic, pour ne publier que les
+// changements
+#define MQTT_TOPICS        64
+
+typedef struct
+{
+  uint32_t      topic;    // Hash du topic, 0 si libre
+  uint32_t      value;    // Hash de la dernière valeur publiée
+  unsigned long last;     // Date de la dernière publication (millis)
+} mqtt_topic_t;
+
+// Etat de la connexion
+enum mqtt_state_e { MQTT_DISCONNECTED, MQTT_CONNECTING, MQTT_CONNECTED };
+
+// Variables exported to other source file
+// ========================================
+extern uint8_t  mqtt_state;
+extern uint32_t mqtt_dropped;
+
+// Function exported for other source file
+// =======================================
+void mqtt_setup(void);
+void mqtt_loop(void);
+bool mqtt_publish(const char * topic, const char * value);
+bool mqtt_publish_raw(const char * topic, const uint8_t * value, uint16_t vlen, bool retain);
+void mqtt_tinfo(ValueList * me);
+
+#endif
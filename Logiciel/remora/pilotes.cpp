@@ -12,28 +12,27 @@
 
 #include "pilotes.h"
 
-#if defined (REMORA_BOARD_V10)
-  int SortiesFP[NB_FILS_PILOTES*2] = { FP1,FP2,FP3,FP4,FP5,FP6,FP7 };
-#else
-  int SortiesFP[NB_FILS_PILOTES*2] = { FP1,FP2,FP3,FP4,FP5,FP6 };
-#endif
 char etatFP[NB_FILS_PILOTES+1] = "";
 char memFP[NB_FILS_PILOTES+1] = ""; //Commandes des fils pilotes mémorisées (utile pour le délestage/relestage)
 int nivDelest = 0; // Niveau de délestage actuel (par défaut = 0, pas de délestage)
+uint32_t nbDelestages = 0; // Zones délestées depuis le démarrage
+uint32_t nbRelestages = 0; // Zones relestées depuis le démarrage
 // Correspond au nombre de fils pilotes délestés (entre 0 et nombre de zones)
 uint8_t plusAncienneZoneDelestee = 1;
 // Numéro de la zone qui est délestée depuis le plus de temps (entre 1 et nombre de zones)
 // C'est la première zone à être délestée
 unsigned long timerDelestRelest = 0; // Timer de délestage/relestage
 
-unsigned long counterHighStateFP[NB_FILS_PILOTES]; //Compteur de secondes dans l'état haut uniquement
-unsigned long counterLowStateFP[NB_FILS_PILOTES];  //Compteur de secondes dans l'état bas uniquement
+// Générateur Confort-1/-2, un seul timer armé sur le prochain front
+unsigned long fp_edge[NB_FILS_PILOTES]; // Date du prochain front (millis)
+bool fp_wave[NB_FILS_PILOTES];          // Zone en Confort-1/-2
+bool fp_high[NB_FILS_PILOTES];          // Niveau haut (1/1) en cours
 
 #ifdef SPARK
-  Timer* ptConfort12Timer; //Timer pour la mise à jour des compteurs toutes les secondes
+  Timer* ptConfort12Timer = NULL; //Timer du prochain front Confort-1/-2
 #endif
 #ifdef ESP8266
-  os_timer_t* ptConfort12Timer; //Timer pour la mise à jour des compteurs toutes les secondes
+  os_timer_t* ptConfort12Timer = NULL; //Timer du prochain front Confort-1/-2
 #endif
 
 #if defined (REMORA_BOARD_V12)
@@ -41,66 +40,484 @@ unsigned long counterLowStateFP[NB_FILS_PILOTES];  //Compteur de secondes dans l
   Adafruit_MCP23017 mcp;
 #endif
 
+// Etat sauvegardé en RAM qui survit aux resets (RTC ESP8266, backup
+// SRAM Particle), rafraichi à chaque changement, délestage et phase des
+// modes Confort-1/-2 compris. L'EEPROM, qui ne garde que les ordres,
+// prend le relais en cas de coupure secteur
+#ifdef SPARK
+  retained fp_persist_t fp_retained;
+#endif
+#ifdef ESP8266
+  union {
+    fp_persist_t p;
+    uint32_t     raw[(sizeof(fp_persist_t)+3)/4];
+  } fp_rtc;
+  // Mémoire RTC utilisateur : blocs de 4 octets 64 à 191
+  static_assert(PERSIST_RTC_BLOCK*4 + sizeof(fp_rtc) <= 768,
+                "Etat des fils pilotes plus grand que la memoire RTC");
+#endif
+// Ordres temporisés : échéance (millis, 0 si aucune) et ordre à remettre
+unsigned long fp_expire[NB_FILS_PILOTES];
+char fp_revert[NB_FILS_PILOTES];
+
+// Montée en charge : zones en attente de passage en confort
+unsigned long rampInterval = RAMP_INTERVAL;
+unsigned long rampLast = 0;              // Date du dernier passage en confort
+uint8_t rampQueue[NB_FILS_PILOTES];      // File des zones, dans l'ordre des demandes
+uint8_t rampCount = 0;
+bool rampPending[NB_FILS_PILOTES];       // Zone dans la file
+unsigned long rampSince[NB_FILS_PILOTES]; // Date de mise en file de la zone
+
+fp_persist_t fp_eeprom;             // Dernier état écrit en EEPROM
+static_assert(PERSIST_EEPROM_ADDR + sizeof(fp_persist_t) <= EEPROM_SIZE,
+              "Etat des fils pilotes plus grand que EEPROM_SIZE");
+unsigned long fp_eeprom_timer = 0;  // Date du dernier changement à sauver
+
+/* ======================================================================
+Function: fpWrite
+Purpose : positionne les 2 sorties d'un fil pilote
+Input   : index de la zone (0 à NB_FILS_PILOTES-1) et niveaux a et b
+Output  : -
+Comments: hors mise à jour groupée (FpIO::batchBegin) la sortie est
+          écrite immédiatement
+====================================================================== */
+void fpWrite(uint8_t i, uint8_t levelA, uint8_t levelB)
+{
+  FpIO::pinWrite(fpZoneExp(i), fpZonePinA(i), levelA);
+  FpIO::pinWrite(fpZoneExp(i), fpZonePinB(i), levelB);
+}
+
+/* ======================================================================
+Function: fpWaveArm
+Purpose : arme le timer sur le prochain front Confort-1/-2
+Input   : -
+Output  : -
+Comments: le timer est arrêté si aucune zone n'est en Confort-1/-2
+====================================================================== */
+void fpWaveArm(void)
+{
+  unsigned long now = millis();
+  long wait = -1;
+  long delta;
+
+  if (!ptConfort12Timer)
+    return;
+
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    if (fp_wave[i]) {
+      delta = (long) (fp_edge[i] - now);
+      if (delta < 1)
+        delta = 1;
+      if (wait < 0 || delta < wait)
+        wait = delta;
+    }
+  }
+
+  #ifdef SPARK
+    if (wait < 0)
+      ptConfort12Timer->stop();
+    else
+      ptConfort12Timer->changePeriod(wait);
+  #endif
+  #ifdef ESP8266
+    os_timer_disarm(ptConfort12Timer);
+    if (wait >= 0)
+      os_timer_arm(ptConfort12Timer, wait, false);
+  #endif
+}
+
+/* ======================================================================
+Function: fpWaveStart
+Purpose : démarre le signal Confort-1/-2 d'une zone
+Input   : index de la zone (0 à NB_FILS_PILOTES-1)
+Output  : -
+Comments: la 1ere impulsion est calée sur le créneau de la zone, les
+          zones sont décalées de FP_STAGGER pour ne pas commuter ensemble
+====================================================================== */
+void fpWaveStart(uint8_t i)
+{
+  unsigned long now = millis();
+  unsigned long pos = (now - i*FP_STAGGER) % FP_CONFORT_PERIOD;
+
+  fp_wave[i] = true;
+  fp_high[i] = false;
+  fp_edge[i] = now + (pos ? FP_CONFORT_PERIOD - pos : 0);
+  fpWaveArm();
+}
+
+/* ======================================================================
+Function: updateFPWave
+Purpose : change d'état les fils pilotes en mode Confort-1 et Confort-2
+Input   : -
+Output  : -
+Comments: appelée par le timer au prochain front, tous les fronts
+          échus ou proches sont écrits en une seule fois puis le timer
+          est réarmé sur le suivant
+====================================================================== */
+void updateFPWave(_timer_callback_arg)
+{
+  unsigned long now = millis();
+  bool batch = false;
+
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    if (!fp_wave[i] || (long) (fp_edge[i] - now) > FP_EDGE_TOLERANCE)
+      continue;
+
+    if (!batch) {
+      FpIO::batchBegin();
+      batch = true;
+    }
+
+    if (fp_high[i]) {
+      // Fin de l'impulsion, Confort jusqu'à la période suivante
+      fp_high[i] = false;
+      fp_edge[i] += FP_CONFORT_PERIOD - (etatFP[i]=='1' ? FP_CONFORT1_HIGH : FP_CONFORT2_HIGH);
+      fpWrite(i, LOW, LOW);
+    } else {
+      // Impulsion Eco de 3s ou 7s
+      fp_high[i] = true;
+      fp_edge[i] += etatFP[i]=='1' ? FP_CONFORT1_HIGH : FP_CONFORT2_HIGH;
+      fpWrite(i, HIGH, HIGH);
+    }
+  }
+
+  if (batch)
+    FpIO::batchEnd();
+
+  fpWaveArm();
+}
+
+/* ======================================================================
+Function: fp_number
+Purpose : décode un nombre décimal
+Input   : début et fin de la chaine, valeur décodée
+Output  : pointeur après le nombre, NULL si pas de chiffre ou trop grand
+Comments: -
+====================================================================== */
+const char * fp_number(const char * p, const char * end, uint16_t * value)
+{
+  const char * start = p;
+  uint32_t v = 0;
+
+  while (p < end && *p >= '0' && *p <= '9') {
+    v = v*10 + (*p++ - '0');
+    if (v > 0xFFFF)
+      return NULL;
+  }
+  *value = v;
+  return p==start ? NULL : p;
+}
+
+/* ======================================================================
+Function: fp_parse
+Purpose : décode une commande de plusieurs zones sans allocation
+Input   : commande et sa longueur
+          tableau de NB_FILS_PILOTES ordres à remplir
+Output  : nombre de zones concernées, -1 si la commande est incorrecte
+Comments: liste séparée par des virgules de <zones><ordre>[/<minutes>]
+          zones : numéro ou intervalle, ordre : C A E H 1 2
+          ex: 1C         => FP1 confort
+              1C,3E,5-7H => FP1 confort, FP3 éco, FP5 à FP7 hors gel
+              2E/90      => FP2 éco pendant 90 minutes puis retour à
+                            l'ordre précédent
+          La commande est entièrement vérifiée, rien n'est appliqué ici
+====================================================================== */
+int fp_parse(const char * cmd, int len, fp_order_t * orders)
+{
+  const char * p = cmd;
+  const char * end = cmd + len;
+  const char * item, * stop, * slash;
+  uint16_t first, last, minutes;
+  char ordre;
+  int nb = 0;
+
+  memset(orders, 0, NB_FILS_PILOTES * sizeof(fp_order_t));
+
+  while (p <= end) {
+    // Un élément, sans les espaces autour
+    stop = p;
+    while (stop < end && *stop != ',')
+      stop++;
+    item = p;
+    p = stop + 1;
+    while (item < stop && *item == ' ')
+      item++;
+    while (stop > item && *(stop-1) == ' ')
+      stop--;
+
+    // Durée optionnelle
+    minutes = 0;
+    slash = (const char *) memchr(item, '/', stop - item);
+    if (slash) {
+      if (fp_number(slash+1, stop, &minutes) != stop || !minutes || minutes > FP_MAX_MINUTES)
+        return -1;
+      stop = slash;
+    }
+
+    // Au moins une zone et un ordre
+    if (stop - item < 2)
+      return -1;
+
+    ordre = toupper(*--stop);
+    if (ordre!='C' && ordre!='E' && ordre!='H' && ordre!='A' && ordre!='1' && ordre!='2')
+      return -1;
+
+    // Zone ou intervalle de zones
+    item = fp_number(item, stop, &first);
+    if (!item)
+      return -1;
+    last = first;
+    if (item < stop && *item == '-')
+      item = fp_number(item+1, stop, &last);
+    if (item != stop || first < 1 || last < first || last > NB_FILS_PILOTES)
+      return -1;
+
+    for (uint16_t i=first-1; i<last; i++) {
+      // Une même zone commandée 2 fois est ambigüe
+      if (orders[i].ordre)
+        return -1;
+      orders[i].ordre   = ordre;
+      orders[i].minutes = minutes;
+      nb++;
+    }
+  }
+
+  return nb;
+}
+
+/* ======================================================================
+Function: rampTurnOn
+Purpose : indique si un ordre fait passer une zone en confort
+Input   : état actuel et nouvel ordre
+Output  : true si la zone passe de éco/hors-gel/arrêt à confort
+Comments: ce sont ces passages qui provoquent l'appel de courant
+====================================================================== */
+bool rampTurnOn(char actuel, char ordre)
+{
+  return (ordre=='C' || ordre=='1' || ordre=='2') &&
+         (actuel!='C' && actuel!='1' && actuel!='2' && actuel!='D');
+}
+
+/* ======================================================================
+Function: rampAdd
+Purpose : met une zone en attente de passage en confort
+Input   : index de la zone (0 à NB_FILS_PILOTES-1)
+Output  : -
+Comments: l'ordre mémorisé (memFP) sera appliqué à son tour
+====================================================================== */
+void rampAdd(uint8_t i)
+{
+  if (rampPending[i])
+    return;
+
+  rampPending[i] = true;
+  rampSince[i] = millis();
+  rampQueue[rampCount++] = i;
+}
+
+/* ======================================================================
+Function: rampRemove
+Purpose : retire une zone de la file de montée en charge
+Input   : index de la zone (0 à NB_FILS_PILOTES-1)
+Output  : -
+Comments: les zones suivantes gardent leur ordre. Une zone n'est jamais
+          deux fois dans la file, rampCount reste <= NB_FILS_PILOTES
+====================================================================== */
+void rampRemove(uint8_t i)
+{
+  uint8_t j;
+
+  if (!rampPending[i])
+    return;
+
+  rampPending[i] = false;
+  for (j=0; j<rampCount && rampQueue[j]!=i; j++)
+    ;
+  if (j == rampCount)
+    return;
+
+  rampCount--;
+  memmove(&rampQueue[j], &rampQueue[j+1], rampCount - j);
+}
+
+/* ======================================================================
+Function: rampReady
+Purpose : indique si on peut passer une zone de plus en confort
+Input   : -
+Output  : true si c'est possible
+Comments: il faut que le délai depuis le passage précédent soit écoulé,
+          qu'aucun délestage ne soit en cours et, avec la téléinfo, que
+          l'intensité mesurée depuis le passage précédent laisse de la
+          marge (sous le seuil de relestage). Passé RAMP_MAX_WAIT pour
+          la 1ère zone en attente, seul le délai compte
+====================================================================== */
+bool rampReady(void)
+{
+  if (!rampInterval)
+    return true;
+
+  if (rampLast && millis() - rampLast < rampInterval)
+    return false;
+
+  if (rampCount && millis() - rampSince[rampQueue[0]] >= RAMP_MAX_WAIT)
+    return true;
+
+  if (nivDelest > 0)
+    return false;
+
+  #ifdef MOD_TELEINFO
+    if (status & STATUS_TINFO) {
+      // Attendre une trame qui mesure l'effet du passage précédent
+      if (rampLast && (long) (tinfo_last_frame - rampLast) < 0)
+        return false;
+      if (myiInst >= myRelestLimit)
+        return false;
+    }
+  #endif
+
+  return true;
+}
+
+/* ======================================================================
+Function: rampStep
+Purpose : passe en confort la prochaine zone en attente
+Input   : -
+Output  : -
+Comments: appelée depuis pilotes_loop
+====================================================================== */
+void rampStep(void)
+{
+  uint8_t i;
+
+  while (rampCount && rampReady()) {
+    i = rampQueue[0];
+    rampRemove(i);
+
+    // Délestée entre temps, elle sera remise en route au relestage
+    if (etatFP[i] == 'D')
+      continue;
+
+    Serial.print("Montee en charge FP");
+    Serial.println(i+1);
+
+    setfp_interne(i+1, memFP[i]);
+    rampLast = millis() ? millis() : 1;
+    return;
+  }
+}
+
+/* ======================================================================
+Function: fp_apply
+Purpose : applique des ordres décodés
+Input   : tableau de NB_FILS_PILOTES ordres
+Output  : -
+Comments: toutes les sorties sont modifiées en une seule fois.
+          Comme pour setfp l'ordre est toujours mémorisé mais n'est pas
+          appliqué sur une zone délestée, il le sera au relestage.
+          Les passages en confort sont espacés de rampInterval
+====================================================================== */
+void fp_apply(fp_order_t * orders)
+{
+  FpIO::batchBegin();
+
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    if (!orders[i].ordre)
+      continue;
+
+    if (orders[i].minutes) {
+      // On garde l'ordre d'origine si un ordre temporisé est déjà en cours
+      if (!fp_expire[i])
+        fp_revert[i] = memFP[i] ? memFP[i] : 'H';
+      fp_expire[i] = millis() + orders[i].minutes * 60000UL;
+      if (!fp_expire[i])
+        fp_expire[i] = 1;
+    } else {
+      fp_expire[i] = 0;
+    }
+
+    memFP[i] = orders[i].ordre;
+    rampRemove(i);
+    if (etatFP[i] == 'D')
+      continue;
+
+    // Les passages en confort attendent leur tour, sauf un seul
+    // si aucun autre n'a eu lieu depuis rampInterval
+    if (rampTurnOn(etatFP[i], orders[i].ordre) && (rampCount || !rampReady())) {
+      rampAdd(i);
+      continue;
+    }
+    if (rampTurnOn(etatFP[i], orders[i].ordre))
+      rampLast = millis() ? millis() : 1;
+
+    setfp_interne(i+1, orders[i].ordre);
+  }
+
+  FpIO::batchEnd();
+}
+
 /* ======================================================================
 Function: setfp
-Purpose : selectionne le mode d'un des fils pilotes
-Input   : commande numéro du fil pilote + commande optionelle
+Purpose : selectionne le mode d'un ou plusieurs fils pilotes
+Input   : commande, voir setfp_cmd
+Output  : voir setfp_cmd
+Comments: exposée par l'API spark donc attaquable par requête HTTP(S)
+====================================================================== */
+int setfp(String command)
+{
+  return setfp_cmd(command.c_str(), command.length());
+}
+
+/* ======================================================================
+Function: setfp_cmd
+Purpose : selectionne le mode d'un ou plusieurs fils pilotes
+Input   : commande et sa longueur
+          numéro du fil pilote + commande optionelle
           C=Confort, A=Arrêt, E=Eco, H=Hors gel, 1=Confort-1, 2=Confort-2
           ex: 1A => FP1 Arrêt
               41 => FP4 confort -1
               6C => FP6 confort
               72 => FP7 confort -2
+              1C,3E,5-7H => plusieurs zones d'un coup, voir fp_parse
+              2E/90 => FP2 éco pendant 90 minutes
           Si la commande est absente la fonction retourne l'état du FP
-          ex: 1 => si état FP1 est "arret" retourne code ASCII du "A" (65)
+          ex: 1  => si état FP1 est "arret" retourne code ASCII du "A" (65)
+              1? => idem, quel que soit le nombre de chiffres
 Output  : 0 ou etat commande, si ok -1 sinon
-Comments: exposée par l'API spark donc attaquable par requête HTTP(S)
+Comments: aucune allocation, la commande n'est pas copiée
 ====================================================================== */
-int setfp(String command)
+int setfp_cmd(const char * cmd, int len)
 {
-  command.trim();
-  command.toUpperCase();
+  fp_order_t orders[NB_FILS_PILOTES];
+  uint16_t zone;
 
   Serial.print("setfp=");
-  Serial.println(command);
-
-  int returnValue = -1;
+  Serial.write((const uint8_t *) cmd, len);
+  Serial.println();
 
-  // Vérifier que l'on demande l'état d'un seul fil pilote
-  if (command.length() == 1)
-  {
-    uint8_t fp = command[0]-'0';
+  // Sans les espaces autour
+  while (len && *cmd == ' ') {
+    cmd++;
+    len--;
+  }
+  while (len && cmd[len-1] == ' ')
+    len--;
 
-    // demande valide
-    // retourner l'état du fil pilote (char)
-    if (fp >= 1 && fp <= NB_FILS_PILOTES)
-      returnValue = (etatFP[fp-1])  ;
+  // Demande de l'état d'un seul fil pilote
+  if (len == 1 || (len > 1 && cmd[len-1] == '?')) {
+    if (fp_number(cmd, cmd + len - (len > 1), &zone) == cmd + len - (len > 1) &&
+        zone >= 1 && zone <= NB_FILS_PILOTES)
+      return etatFP[zone-1];
+    return -1;
   }
-  else if (command.length() == 2)
-  {
-    // numéro du fil pilote concerné, avec conversion ASCII > entier
-    // la commande est vérifiée dans fpC, pas besoin de traiter ici
-    uint8_t fp = command[0]-'0';
-    char cOrdre= command[1];
-    if ( (fp < 1 || fp > NB_FILS_PILOTES) ||
-        (cOrdre!='C' && cOrdre!='E' && cOrdre!='H' && cOrdre!='A' && cOrdre!='1' && cOrdre!='2' ))
-    {
-        // erreur
-        Serial.println("Argument incorrect");
-    }
-    else
-    {
-      memFP[fp-1] = cOrdre; // On mémorise toujours la commande demandée
-      char cOrdreEnCours = etatFP[fp-1]; // Quel est l'état actuel du fil pilote?
-      if (cOrdreEnCours != 'D')
-      {
-        // Si un délestage est en cours sur ce fil pilote, on n'exécute pas la commande
-        // La commande est néanmoins mémorisé
-        // Elle sera appliquée lors du relestage
-        returnValue = setfp_interne(fp, cOrdre);
-      }
-    }
+
+  // Vérification de toute la commande avant de l'appliquer
+  if (fp_parse(cmd, len, orders) <= 0) {
+    Serial.println("Argument incorrect");
+    return -1;
   }
-  return(returnValue);
+
+  fp_apply(orders);
+  return 0;
 }
 
 /* ======================================================================
@@ -141,6 +558,16 @@ int setfp_interne(uint8_t fp, char cOrdre)
     // Commande à passer
     uint8_t fpcmd1, fpcmd2;
 
+    #ifdef MOD_FLASHLOG
+      // On trace uniquement les changements d'état
+      if (etatFP[fp-1] != cOrdre)
+        flashlog_fp(fp, cOrdre);
+    #endif
+    #ifdef MOD_WEBAPI
+      if (etatFP[fp-1] != cOrdre)
+        webapi_event("fp", "{\"zone\":%d,\"etat\":\"%c\"}", fp, cOrdre);
+    #endif
+
     // tableau d'index de 0 à 6 pas de 1 à 7
     // on en profite pour Sauver l'état
     etatFP[fp-1]=cOrdre;
@@ -157,16 +584,13 @@ int setfp_interne(uint8_t fp, char cOrdre)
         case 'H': fpcmd1=HIGH; fpcmd2=LOW;  break;
         // Arrêt => Commande 0/1
         case 'A': fpcmd1=LOW;  fpcmd2=HIGH; break;
-        // Confort - 1 => 1/1 pendant 3 secondes puis 0/0 pendant 257 secondes
+        // Confort - 1 => 1/1 pendant 3 secondes puis 0/0 pendant 297 secondes
         case '1':
-        // Confort - 2 => 1/1 pendant 7 secondes puis 0/0 pendant 253 secondes
+        // Confort - 2 => 1/1 pendant 7 secondes puis 0/0 pendant 293 secondes
         case '2':
         {
-          // on commence par un niveau haut
-          fpcmd1=HIGH; fpcmd2=HIGH;
-
-          counterHighStateFP[fp-1] = 1;
-          counterLowStateFP[fp-1]  = 0;
+          // Confort jusqu'à la 1ere impulsion, dans le créneau de la zone
+          fpcmd1=LOW; fpcmd2=LOW;
         }
         break;
         // Délestage => Hors gel => Commande 1/0
@@ -174,107 +598,36 @@ int setfp_interne(uint8_t fp, char cOrdre)
     }
 
     // On positionne les sorties physiquement
-    _digitalWrite(SortiesFP[2*(fp-1)], fpcmd1);
-    _digitalWrite(SortiesFP[2*(fp-1)+1], fpcmd2);
+    fpWrite(fp-1, fpcmd1, fpcmd2);
+
+    // Démarrage ou arrêt du signal Confort-1/-2
+    if (cOrdre=='1' || cOrdre=='2') {
+      if (!fp_wave[fp-1])
+        fpWaveStart(fp-1);
+    } else if (fp_wave[fp-1]) {
+      fp_wave[fp-1] = false;
+      fpWaveArm();
+    }
     return (0);
   }
 }
 
 /* ======================================================================
-Function: updateFPCounter
-Purpose : met à jour les compteurs et change d'état les fils pilotes en mode Confort-1 et Confort-2
+Function: startFPTimer
+Purpose : crée le timer de gestion des modes Confort-1 et Confort-2
 Input   : -
 Output  : -
-Comments: -
+Comments: il n'est armé que lorsqu'une zone passe en Confort-1/-2
 ====================================================================== */
-void updateFPCounter(_timer_callback_arg)
+void startFPTimer(void)
 {
-  for (uint8_t i=0; i<NB_FILS_PILOTES; i+=1)
-  {
-    switch (etatFP[i])
-    {
-        // Confort - 1
-        case '1':
-        {
-          if ( counterLowStateFP[i] > 0)
-          { // si on est dans l'état bas
-            if ( counterLowStateFP[i] >= 297)
-            { // si on a atteint le temps de la periode basse, passage en periode haute
-              _digitalWrite(SortiesFP[2*i]  , HIGH);
-              _digitalWrite(SortiesFP[2*i+1], HIGH);
-
-              counterHighStateFP[i] = 1;
-              counterLowStateFP[i]  = 0;
-            }
-            else
-            { // sinon incrémentation du compteur bas
-              counterHighStateFP[i]  = 0;
-              counterLowStateFP[i]  += 1;
-            }
-          }
-          else
-          { // sinon on est dans l'état haut
-            if ( counterHighStateFP[i] >= 3)
-            { // si on a atteint le temps de la periode haute, passage en periode basse
-              _digitalWrite(SortiesFP[2*i]  , LOW);
-              _digitalWrite(SortiesFP[2*i+1], LOW);
-
-              counterHighStateFP[i] = 0;
-              counterLowStateFP[i]  = 1;
-            }
-            else
-            { // sinon incrémentation du compteur haut
-              counterHighStateFP[i] += 1;
-              counterLowStateFP[i]   = 0;
-            }
-          }
-        }
-        break;
-        // Confort - 2
-        case '2':
-        {
-          if ( counterLowStateFP[i] > 0)
-          { // si on est dans l'état bas
-            if ( counterLowStateFP[i] >= 293)
-            { // si on a atteint le temps de la periode basse, passage en periode haute
-              _digitalWrite(SortiesFP[2*i]  , HIGH);
-              _digitalWrite(SortiesFP[2*i+1], HIGH);
-
-              counterHighStateFP[i] = 1;
-              counterLowStateFP[i]  = 0;
-            }
-            else
-            { // sinon incrémentation du compteur bas
-              counterHighStateFP[i]  = 0;
-              counterLowStateFP[i]  += 1;
-            }
-          }
-          else
-          { // sinon on est dans l'état haut
-            if ( counterHighStateFP[i] >= 7)
-            { // si on a atteint le temps de la periode haute, passage en periode basse
-              _digitalWrite(SortiesFP[2*i]  , LOW);
-              _digitalWrite(SortiesFP[2*i+1], LOW);
-
-              counterHighStateFP[i] = 0;
-              counterLowStateFP[i]  = 1;
-            }
-            else
-            { // sinon incrémentation du compteur haut
-              counterHighStateFP[i] += 1;
-              counterLowStateFP[i]   = 0;
-            }
-          }
-        }
-        break;
-        default:
-        { // on réinitialise dans les autres modes
-          counterHighStateFP[i] = 0;
-          counterLowStateFP[i]  = 0;
-        }
-        break;
-    }
-  }
+  #ifdef SPARK
+    ptConfort12Timer = new Timer(FP_CONFORT_PERIOD, updateFPWave, true);
+  #endif
+  #ifdef ESP8266
+    ptConfort12Timer = new os_timer_t;
+    os_timer_setfn(ptConfort12Timer, updateFPWave, NULL);
+  #endif
 }
 
 /* ======================================================================
@@ -286,30 +639,279 @@ Comments: -
 ====================================================================== */
 void initFP(void)
 {
-  // buffer contenant la commande à passer à setFP
-  char cmd[] = "xH" ;
+  fp_order_t orders[NB_FILS_PILOTES];
 
-  // On positionne tous les FP en Hors-Gel et on initialise les compteurs à 0
-  for (uint8_t i=1; i<=NB_FILS_PILOTES; i+=1)
+  // On positionne tous les FP en Hors-Gel
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i+=1)
   {
-    cmd[0]='0' + i;
-    setfp(cmd);
+    orders[i].ordre   = 'H';
+    orders[i].minutes = 0;
+  }
+  fp_apply(orders);
+}
+
+/* ======================================================================
+Function: persistCRC
+Purpose : calcule la somme de contrôle d'un état sauvegardé
+Input   : état sauvegardé
+Output  : somme de contrôle (Fletcher 16)
+Comments: porte sur tout l'état sauf l'entête magic/crc
+====================================================================== */
+uint16_t persistCRC(fp_persist_t * p)
+{
+  uint8_t * data = (uint8_t *) p + 4;
+  uint16_t sum1 = 0, sum2 = 0;
+
+  for (uint16_t i=0; i<sizeof(fp_persist_t)-4; i++) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+/* ======================================================================
+Function: persistValid
+Purpose : vérifie un état sauvegardé
+Input   : état sauvegardé
+Output  : true si l'état est cohérent
+Comments: -
+====================================================================== */
+bool persistValid(fp_persist_t * p)
+{
+  if (p->magic != PERSIST_MAGIC || p->crc != persistCRC(p))
+    return false;
+
+  if (p->nivDelest > NB_FILS_PILOTES ||
+      p->plusAncienneZoneDelestee < 1 || p->plusAncienneZoneDelestee > NB_FILS_PILOTES)
+    return false;
+
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    if (!strchr("CEHA12D", p->etatFP[i]) || !strchr("CEHA12", p->memFP[i]))
+      return false;
+    if (p->revert[i] && (!strchr("CEHA12", p->revert[i]) || p->remain[i] > FP_MAX_MINUTES))
+      return false;
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: persistBuild
+Purpose : construit l'état à sauvegarder à partir de l'état courant
+Input   : état à remplir
+          true pour l'état complet en RAM sauvegardée (délestage, montée
+          en charge et phase des modes Confort-1/-2 compris), false pour
+          les ordres seuls en EEPROM
+Output  : -
+Comments: sans délestage l'EEPROM n'est écrite que sur une commande, le
+          délestage est recalculé avec la téléinfo après une coupure
+====================================================================== */
+void persistBuild(fp_persist_t * p, bool phase)
+{
+  memset(p, 0, sizeof(fp_persist_t));
+  p->magic = PERSIST_MAGIC;
+  memcpy(p->etatFP, phase ? etatFP : memFP, NB_FILS_PILOTES);
+  memcpy(p->memFP,  memFP,  NB_FILS_PILOTES);
+  p->nivDelest = phase ? nivDelest : 0;
+  p->plusAncienneZoneDelestee = phase ? plusAncienneZoneDelestee : 1;
+  p->relais = etatrelais;
 
-    counterHighStateFP[i-1] = 0;
-    counterLowStateFP[i-1]  = 0;
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    if (fp_expire[i])
+      p->revert[i] = fp_revert[i];
   }
 
-  // lancement du timer pour la gestion des modes Confort-1 et Confort-2
+  if (phase) {
+    for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+      if (fp_wave[i]) {
+        long remain = (long) (fp_edge[i] - millis());
+        p->phase[i] = (remain > 0 ? remain/1000 : 0) | (fp_high[i] ? 0x8000 : 0);
+      }
+      // Minute entamée comptée, 0 si l'échéance est passée
+      if (fp_expire[i]) {
+        long remain = (long) (fp_expire[i] - millis());
+        p->remain[i] = remain > 0 ? (remain + 59999) / 60000 : 0;
+      }
+    }
+  }
+  p->crc = persistCRC(p);
+}
+
+/* ======================================================================
+Function: pilotes_restore
+Purpose : restaure l'état des fils pilotes au démarrage
+Input   : -
+Output  : PERSIST_WARM si restauré depuis la RAM sauvegardée (reset),
+          PERSIST_COLD si restauré depuis l'EEPROM (coupure secteur),
+          PERSIST_NONE si rien de valide, tout est en hors-gel
+Comments: à appeler juste après pilotes_setup, avant tout ce qui peut
+          bloquer (connexion Wifi, cloud, téléinfo)
+====================================================================== */
+uint8_t pilotes_restore(void)
+{
+  fp_persist_t * p = NULL;
+  uint8_t ret = PERSIST_NONE;
+
+  #ifdef ESP8266
+    EEPROM.begin(EEPROM_SIZE);
+  #endif
+  EEPROM.get(PERSIST_EEPROM_ADDR, fp_eeprom);
+
+  // La RAM sauvegardée est la plus à jour (phase comprise)
   #ifdef SPARK
-    ptConfort12Timer = new Timer(1000, updateFPCounter );
-    ptConfort12Timer->start();
+    if (persistValid(&fp_retained)) {
+      p = &fp_retained;
+      ret = PERSIST_WARM;
+    }
   #endif
   #ifdef ESP8266
-    ptConfort12Timer = new os_timer_t;
-    os_timer_setfn(ptConfort12Timer, updateFPCounter, NULL);
-    os_timer_arm(ptConfort12Timer, 1000, true);
+    if (system_rtc_mem_read(PERSIST_RTC_BLOCK, fp_rtc.raw, sizeof(fp_rtc.raw)) && persistValid(&fp_rtc.p)) {
+      p = &fp_rtc.p;
+      ret = PERSIST_WARM;
+    }
+  #endif
+
+  if (!p && persistValid(&fp_eeprom)) {
+    p = &fp_eeprom;
+    ret = PERSIST_COLD;
+  }
+
+  if (!p) {
+    Serial.println("Pas d'etat sauvegarde, FP en hors-gel");
+    initFP();
+    return ret;
+  }
+
+  Serial.print(ret==PERSIST_WARM ? "Restauration RAM : " : "Restauration EEPROM : ");
+
+  // Les ordres et l'état du délestage
+  memcpy(memFP, p->memFP, NB_FILS_PILOTES);
+  memFP[NB_FILS_PILOTES] = '\0';
+  etatFP[NB_FILS_PILOTES] = '\0';
+  nivDelest = p->nivDelest;
+  plusAncienneZoneDelestee = p->plusAncienneZoneDelestee;
+
+  FpIO::batchBegin();
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    char etat = p->etatFP[i];
+
+    // Ordre temporisé : après un reset il reprend pour le temps restant.
+    // Après une coupure secteur on ne sait pas combien de temps elle a
+    // duré, on revient tout de suite à l'ordre d'origine
+    if (p->revert[i]) {
+      if (ret==PERSIST_WARM) {
+        fp_revert[i] = p->revert[i];
+        fp_expire[i] = millis() + p->remain[i] * 60000UL;
+        if (!fp_expire[i])
+          fp_expire[i] = 1;
+      } else {
+        memFP[i] = p->revert[i];
+        if (etat != 'D')
+          etat = p->revert[i];
+      }
+    }
+
+    // Après une coupure secteur, tous les radiateurs redémarreraient
+    // ensemble, les zones en confort passent par la montée en charge
+    if (ret==PERSIST_COLD && rampTurnOn('H', etat)) {
+      setfp_interne(i+1, 'H');
+      rampAdd(i);
+      continue;
+    }
+
+    setfp_interne(i+1, etat);
+
+    // Montée en charge qui était en cours lors du reset
+    if (etat != memFP[i] && rampTurnOn(etat, memFP[i]))
+      rampAdd(i);
+
+    // On reprend la phase Confort-1/-2 là où elle en était
+    if (ret==PERSIST_WARM && fp_wave[i] && p->phase[i]) {
+      fp_high[i] = p->phase[i] & 0x8000 ? true : false;
+      fp_edge[i] = millis() + (p->phase[i] & 0x7FFF) * 1000UL;
+      if (fp_high[i]) {
+        fpWrite(i, HIGH, HIGH);
+      }
+    }
+  }
+  FpIO::batchEnd();
+  fpWaveArm();
+
+  // Le relais
+  #ifndef REMORA_BOARD_V10
+    relais_interne(p->relais);
   #endif
 
+  Serial.println(etatFP);
+
+  return ret;
+}
+
+/* ======================================================================
+Function: pilotes_loop
+Purpose : gère la fin des ordres temporisés, la montée en charge et
+          sauvegarde l'état des fils pilotes lorsqu'il change
+Input   : -
+Output  : true si l'EEPROM a été écrite
+Comments: la RAM sauvegardée est mise à jour de suite (pas d'usure),
+          l'EEPROM seulement PERSIST_DELAY après le dernier changement
+====================================================================== */
+bool pilotes_loop(void)
+{
+  fp_persist_t state;
+  fp_order_t orders[NB_FILS_PILOTES];
+  bool expired = false;
+
+  // Fin des ordres temporisés, retour à l'ordre précédent
+  for (uint8_t i=0; i<NB_FILS_PILOTES; i++) {
+    orders[i].ordre   = 0;
+    orders[i].minutes = 0;
+    if (fp_expire[i] && (long) (millis() - fp_expire[i]) >= 0) {
+      orders[i].ordre = fp_revert[i];
+      expired = true;
+    }
+  }
+  if (expired)
+    fp_apply(orders);
+
+  // Zones en attente de passage en confort
+  rampStep();
+
+  // RAM qui survit au reset, phase comprise
+  #ifdef SPARK
+    persistBuild(&fp_retained, true);
+  #endif
+  #ifdef ESP8266
+    persistBuild(&state, true);
+    if (memcmp(&state, &fp_rtc.p, sizeof(state))) {
+      fp_rtc.p = state;
+      system_rtc_mem_write(PERSIST_RTC_BLOCK, fp_rtc.raw, sizeof(fp_rtc.raw));
+    }
+  #endif
+
+  // EEPROM avec les ordres seuls, elle ne change donc que sur une commande
+  persistBuild(&state, false);
+  if (!memcmp(&state, &fp_eeprom, sizeof(state))) {
+    fp_eeprom_timer = 0;
+    return false;
+  }
+
+  // Changement détecté, on attend que ça se stabilise
+  if (!fp_eeprom_timer) {
+    fp_eeprom_timer = millis() ? millis() : 1;
+    return false;
+  }
+  if (millis() - fp_eeprom_timer < PERSIST_DELAY)
+    return false;
+
+  fp_eeprom = state;
+  fp_eeprom_timer = 0;
+  EEPROM.put(PERSIST_EEPROM_ADDR, fp_eeprom);
+  #ifdef ESP8266
+    EEPROM.commit();
+  #endif
+
+  Serial.println("Etat FP sauvegarde en EEPROM");
+  return true;
 }
 
 /* ======================================================================
@@ -331,8 +933,13 @@ void delester1zone(void)
   if (nivDelest < NB_FILS_PILOTES) // On s'assure que l'on n'est pas au niveau max
   {
     nivDelest += 1;
+    nbDelestages++;
     numFp = ((plusAncienneZoneDelestee-1 + nivDelest-1) % NB_FILS_PILOTES)+1;
     setfp_interne(numFp, 'D');
+
+    #ifdef MOD_WEBAPI
+      webapi_event("delest", "{\"nivdelest\":%d,\"delestee\":%d}", nivDelest, numFp);
+    #endif
   }
 
   Serial.print("delester1zone() : apres : nivDelest=");
@@ -360,10 +967,15 @@ void relester1zone(void)
   if (nivDelest > 0) // On s'assure qu'un délestage est en cours
   {
     nivDelest -= 1;
+    nbRelestages++;
     numFp = plusAncienneZoneDelestee;
     char cOrdreMemorise = memFP[numFp-1]; //On récupére la dernière valeur de commande pour cette zone
     setfp_interne(numFp,cOrdreMemorise);
     plusAncienneZoneDelestee = (plusAncienneZoneDelestee % NB_FILS_PILOTES) + 1;
+
+    #ifdef MOD_WEBAPI
+      webapi_event("delest", "{\"nivdelest\":%d,\"relestee\":%d}", nivDelest, numFp);
+    #endif
   }
 
   Serial.print("relester1zone() : apres : nivDelest=");
@@ -403,57 +1015,67 @@ void decalerDelestage(void)
 /* ======================================================================
 Function: fp
 Purpose : selectionne le mode d'un ou plusieurs les fils pilotes d'un coup
-Input   : liste des commandes
+Input   : liste des commandes, voir fp_cmd
+Output  : 0 si ok -1 sinon
+Comments: exposée par l'API spark donc attaquable par requête HTTP(S)
+====================================================================== */
+int fp(String command)
+{
+  return fp_cmd(command.c_str(), command.length());
+}
+
+/* ======================================================================
+Function: fp_cmd
+Purpose : selectionne le mode d'un ou plusieurs les fils pilotes d'un coup
+Input   : commande et sa longueur
           -=rien, C=Confort, A=Arrêt, E=Eco, H=Hors gel, 1=Confort-1, 2=Confort-2,
-          ex: 1A => FP1 Arrêt
-              CCCCCCC => Commande tous les fils pilote en mode confort (ON)
+          ex: CCCCCCC => Commande tous les fils pilote en mode confort (ON)
               AAAAAAA => Commande tous les fils pilote en mode arrêt
               EEEEEEE => Commande tous les fils pilote en mode éco
               CAAAAAA => Tous OFF sauf le fil pilote 1 en confort
               A-AAAAA => Tous OFF sauf le fil pilote 2 inchangé
               E-CHA12 => FP2 Eco  , FP2 inchangé, FP3 confort, FP4 hors gel
                         FP5 arrêt, FP6 Confort-1    , FP7 Confort-2
+          ou la syntaxe par zones de setfp_cmd (1C,3E,5-7H, 2E/90)
 Output  : 0 si ok -1 sinon
-Comments: exposée par l'API spark donc attaquable par requête HTTP(S)
+Comments: toute la commande est vérifiée avant d'être appliquée, un
+          caractère incorrect ne modifie plus aucune zone
 ====================================================================== */
-int fp(String command)
+int fp_cmd(const char * cmd, int len)
 {
-  command.trim();
-  command.toUpperCase();
+  fp_order_t orders[NB_FILS_PILOTES];
+  bool positional = true;
+  char c;
 
   Serial.print("fp=");
-  Serial.println(command);
-
+  Serial.write((const uint8_t *) cmd, len);
+  Serial.println();
 
-  // Vérifier que l'on a la commande de tous les fils pilotes
-  if (command.length() != NB_FILS_PILOTES)
-  {
-      return(-1) ;
+  while (len && *cmd == ' ') {
+    cmd++;
+    len--;
   }
-  else
-  {
-    int8_t returnValue = 0; // Init à 0 => OK
-    char   cmd[] = "xx" ; // buffer contenant la commande à passer à setFP
+  while (len && cmd[len-1] == ' ')
+    len--;
 
-    // envoyer les commandes pour tous les fils pilotes
-    for (uint8_t i=1; i<=NB_FILS_PILOTES; i++)
-    {
-      cmd[0] = '0' + i ;
-      cmd[1] = command[i-1]; // l'index de la chaine commence à 0 donc i-1
-
-      // Si on ne doit pas laisser le fil pilote inchangé
-      if (cmd[1] != '-' )
-      {
-        // ok ici au cas ou la commande setFP n'est pas bonne
-        // on positionne le code de retour à -1 mais on
-        // continue le traitement, les suivantes sont
-        // peut-être correctes
-        if (setfp(cmd) == -1)
-          returnValue = -1;
-      }
+  // Un caractère par fil pilote ?
+  if (len == NB_FILS_PILOTES) {
+    for (uint8_t i=0; i<NB_FILS_PILOTES && positional; i++) {
+      c = toupper(cmd[i]);
+      if (c!='-' && c!='C' && c!='E' && c!='H' && c!='A' && c!='1' && c!='2')
+        positional = false;
+      orders[i].ordre   = c=='-' ? 0 : c;
+      orders[i].minutes = 0;
     }
-    return returnValue;
+  } else {
+    positional = false;
   }
+
+  if (!positional && fp_parse(cmd, len, orders) <= 0)
+    return -1;
+
+  fp_apply(orders);
+  return 0;
 }
 
 /* ======================================================================
@@ -465,18 +1087,56 @@ Comments: exposée par l'API spark donc attaquable par requête HTTP(S)
 ====================================================================== */
 int relais(String command)
 {
-  command.trim();
-  uint8_t cmd = command[0];
+  return relais_cmd(command.c_str(), command.length());
+}
 
+/* ======================================================================
+Function: relais_cmd
+Purpose : selectionne l'état du relais
+Input   : commande et sa longueur, "0" ouvert, "1" fermé
+Output  : etat du relais (0 ou 1), -1 si commande incorrecte
+Comments: -
+====================================================================== */
+int relais_cmd(const char * cmd, int len)
+{
   Serial.print("relais=");
-  Serial.println(command);
+  Serial.write((const uint8_t *) cmd, len);
+  Serial.println();
+
+  while (len && *cmd == ' ') {
+    cmd++;
+    len--;
+  }
+  while (len && cmd[len-1] == ' ')
+    len--;
 
   // Vérifier que l'on a la commande d'un seul caractère
-  if (command.length()!=1 || (cmd!='1' && cmd!='0'))
+  if (len!=1 || (*cmd!='1' && *cmd!='0'))
     return (-1);
 
-  // Conversion en 0,1 numerique
-  etatrelais= cmd - '0';
+  relais_interne(*cmd - '0');
+  return (etatrelais);
+}
+
+/* ======================================================================
+Function: relais_interne
+Purpose : positionne le relais
+Input   : état du relais (0 ouvert, 1 fermé)
+Output  : -
+Comments: -
+====================================================================== */
+void relais_interne(uint8_t etat)
+{
+  #ifdef MOD_FLASHLOG
+    if (etatrelais != etat)
+      flashlog_relais(etat);
+  #endif
+  #ifdef MOD_WEBAPI
+    if (etatrelais != etat)
+      webapi_event("relais", "{\"etatrelais\":%d}", etat);
+  #endif
+
+  etatrelais = etat;
 
     // Allumer/Etteindre le relais et la LED
   #ifdef RELAIS_PIN
@@ -485,8 +1145,6 @@ int relais(String command)
   #ifdef LED_PIN
     _digitalWrite(LED_PIN, etatrelais);
   #endif
-
-  return (etatrelais);
 }
 
 /* ======================================================================
@@ -498,18 +1156,18 @@ Comments: -
 ====================================================================== */
 bool pilotes_setup(void)
 {
+  // Timer du signal Confort-1/-2
+  startFPTimer();
+
   // Cartes Version 1.0 et 1.1 pilotage part port I/O du spark
   #if defined (REMORA_BOARD_V10) || defined (REMORA_BOARD_V11)
-
-    // 2*nbFilPilotes car 2 pins pour commander 1 fil pilote
-    for (uint8_t i=0; i < (NB_FILS_PILOTES*2); i++)
-      _pinMode(SortiesFP[i], OUTPUT); // Chaque commande de fil pilote est une sortie
+    FpIO::begin();
 
     #ifdef RELAIS_PIN
-      _pinMode(RELAIS_PIN, OUTPUT);
+      pinMode(RELAIS_PIN, OUTPUT);
     #endif
     #ifdef LED_PIN
-      _pinMode(LED_PIN, OUTPUT);
+      pinMode(LED_PIN, OUTPUT);
     #endif
 
   // Cartes Version 1.2+ pilotage part I/O Expander
@@ -517,27 +1175,16 @@ bool pilotes_setup(void)
     Serial.print("Initializing MCP23017...Searching...");
     Serial.flush();
 
-    // Détection du MCP23017
-    if (!i2c_detect(MCP23017_ADDRESS))
+    // Détection et initialisation des MCP23017
+    if (!FpIO::begin())
     {
       Serial.println("Not found!");
       Serial.flush();
       return (false);
     }
-    else
-    {
-      Serial.print("Setup...");
-      Serial.flush();
-
-      // et l'initialiser
-      mcp.begin();
 
-      // Mettre les 16 I/O PIN en sortie
-      mcp.writeRegister(MCP23017_IODIRA,0x00);
-      mcp.writeRegister(MCP23017_IODIRB,0x00);
-      Serial.println("OK!");
-      Serial.flush();
-    }
+    Serial.println("OK!");
+    Serial.flush();
   #endif
 
   // ou l'a trouvé
@@ -15,8 +15,8 @@
 
 #include "remora.h"
 
-// Fils pilotes
-#define NB_FILS_PILOTES 7
+// Fils pilotes câblés sur la carte
+#define NB_FP_CARTE 7
 
 // Cartes Version 1.0 et 1.1
 #if defined (REMORA_BOARD_V10) || defined (REMORA_BOARD_V11)
@@ -39,8 +39,8 @@
   #if defined (REMORA_BOARD_V10)
   #define FP7 A0,A1
   #else
-  #undef NB_FILS_PILOTES
-  #define NB_FILS_PILOTES 6
+  #undef NB_FP_CARTE
+  #define NB_FP_CARTE 6
   #endif
 #else
   // Les fils pilotes sont connectés de la façon suivante sur l'I/O expander
@@ -64,29 +64,118 @@
 
   #define RELAIS_PIN  9
   #define LED_PIN     8
+
+  // I/O expanders MCP23017 supplémentaires (adresses 0x21 à 0x27) pour
+  // 8 zones de plus chacun, câblées dans l'ordre des broches
+  // # Fil Pilote    MCP IO/Port   Digital Port
+  // FPn+1 (a et b) -> GPA0, GPA1  ->  0/1
+  // ...
+  // FPn+8 (a et b) -> GPB6, GPB7  ->  14/15
+  #ifndef MCP_NB
+  #define MCP_NB 1  // Nombre total d'I/O expanders, carte comprise (1 à 8)
+  #endif
+  #if MCP_NB < 1 || MCP_NB > 8
+  #error "MCP_NB doit etre compris entre 1 et 8"
+  #endif
 #endif
 
+// Nombre total de zones, carte puis expanders ajoutés
+#if defined (REMORA_BOARD_V12)
+  #define NB_FILS_PILOTES (NB_FP_CARTE + 8*(MCP_NB-1))
+#else
+  #define NB_FILS_PILOTES NB_FP_CARTE
+#endif
+
+// Accès aux sorties selon la carte
+#include "fpio.h"
+
+// Signal Confort-1/-2 : Eco (1/1) pendant 3s (Confort-1) ou 7s (Confort-2)
+// puis Confort (0/0) jusqu'à la fin d'une période de 300s
+#define FP_CONFORT_PERIOD  300000UL // ms
+#define FP_CONFORT1_HIGH     3000UL
+#define FP_CONFORT2_HIGH     7000UL
+// Les fronts à moins de FP_EDGE_TOLERANCE ms sont écrits ensemble
+#define FP_EDGE_TOLERANCE      20
+// Décalage des impulsions d'une zone à l'autre
+#define FP_STAGGER         (FP_CONFORT_PERIOD/NB_FILS_PILOTES)
+
+// Montée en charge progressive : délai minimum (ms) entre 2 zones
+// qui passent en confort, 0 pour tout appliquer d'un coup
+#define RAMP_INTERVAL  10000
+// Attente maximale d'une zone (ms), elle passe ensuite en confort même si
+// l'intensité reste haute, le délestage prend alors le relais
+#define RAMP_MAX_WAIT  600000
+
+// Sauvegarde de l'état des fils pilotes
+// Délai avant écriture en EEPROM après le dernier changement (ms)
+// pour ne pas user la flash lors d'une rafale de commandes
+#define PERSIST_DELAY     10000
+#define PERSIST_MAGIC     0x5046 // "FP"
+#define PERSIST_EEPROM_ADDR   0
+#define PERSIST_RTC_BLOCK    64  // 1er bloc utilisateur de la RTC ESP8266
+
+// Résultat de la restauration au démarrage
+enum persist_e { PERSIST_NONE, PERSIST_COLD, PERSIST_WARM };
+
+// Etat sauvegardé. En EEPROM etatFP est memFP, sans délestage ni phase
+typedef struct
+{
+  uint16_t magic;
+  uint16_t crc;
+  char     etatFP[NB_FILS_PILOTES];
+  char     memFP[NB_FILS_PILOTES];
+  uint8_t  nivDelest;
+  uint8_t  plusAncienneZoneDelestee;
+  uint8_t  relais;
+  uint8_t  pad;
+  uint16_t phase[NB_FILS_PILOTES]; // Confort-1/-2 : secondes avant le prochain
+                                   // front, bit 15 à 1 si niveau haut
+  uint16_t remain[NB_FILS_PILOTES];// Ordre temporisé : minutes restantes (RAM
+                                   // seulement, l'EEPROM ne change qu'aux commandes)
+  char     revert[NB_FILS_PILOTES];// Ordre temporisé : ordre à remettre, 0 si aucun
+} fp_persist_t;
+
+// Durée maximale d'un ordre temporisé (minutes), 1 semaine
+#define FP_MAX_MINUTES  10080
+
+// Un ordre issu du décodage d'une commande, un par zone
+typedef struct
+{
+  char     ordre;     // 0 si la zone n'est pas concernée
+  uint16_t minutes;   // 0 si l'ordre n'est pas temporisé
+} fp_order_t;
+
 // Variables exported to other source file
 // ========================================
 extern Adafruit_MCP23017 mcp;
-extern int SortiesFP[];
 extern char etatFP[];
 extern char memFP[];
 extern int nivDelest;
+extern uint32_t nbDelestages;
+extern uint32_t nbRelestages;
 extern uint8_t plusAncienneZoneDelestee;
 extern unsigned long timerDelestRelest;
+extern unsigned long rampInterval;
+extern uint8_t rampCount;
 
 // Function exported for other source file
 // =======================================
 bool pilotes_setup(void);
 bool pilotes_loop(void);
+uint8_t pilotes_restore(void);
 void delester1zone(void);
 void relester1zone(void);
 void decalerDelestage(void);
 void initFP(void);
 int setfp(String);
+int setfp_cmd(const char * cmd, int len);
 int setfp_interne(uint8_t fp, char cOrdre);
 int fp(String);
+int fp_cmd(const char * cmd, int len);
+int fp_parse(const char * cmd, int len, fp_order_t * orders);
+void fp_apply(fp_order_t * orders);
 int relais(String);
+int relais_cmd(const char * cmd, int len);
+void relais_interne(uint8_t etat);
 
 #endif
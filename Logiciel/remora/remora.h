@@ -26,7 +26,18 @@
 #define MOD_RF69      /* Module RF  */
 #define MOD_OLED      /* Afficheur  */
 #define MOD_TELEINFO  /* Teleinfo   */
+#define MOD_FLASHLOG  /* Journal en flash (ESP8266 uniquement) */
+#define MOD_WEBAPI    /* API HTTP locale */
+//#define MOD_MCAST     /* Diffusion multicast des trames téléinfo */
+//#define MOD_MQTT      /* Publication MQTT, broker à définir dans mqtt.h */
+//#define MOD_METRICS   /* Métriques Prometheus sur /metrics */
 //#define MOD_RF_OREGON   /* Reception des sondes orégon */
+#define MOD_RF_BATCH  /* Relevés RF envoyés par lots (voir rfbatch.h), en UDP ou MQTT au lieu de la liaison série */
+
+// Taille de l'EEPROM (émulée en flash sur ESP8266) : état des fils
+// pilotes en PERSIST_EEPROM_ADDR, baux RF en RF_DHCP_EEPROM_ADDR juste
+// après. Avec MCP_NB=8 il faut 464 + 776 octets
+#define EEPROM_SIZE   1536
 
 // Librairies du projet remora Pour Particle
 #ifdef SPARK
@@ -41,9 +52,18 @@
   #include "i2c.h"
   #include "pilotes.h"
   #include "rfm.h"
+  #include "rfota.h"
   #include "tinfo.h"
+  #include "stats.h"
+  #include "flashlog.h"
   #include "linked_list.h"
+  #include "rflink.h"
+  #include "rfbatch.h"
   #include "route.h"
+  #include "webapi.h"
+  #include "mcast.h"
+  #include "mqtt.h"
+  #include "metrics.h"
   #include "RadioHead.h"
   #include "RH_RF69.h"
   #include "RHDatagram.h"
@@ -52,6 +72,9 @@
   //#include "OLED_local.h"
   //#include "mfGFX_local.h"
 
+  // Pas de flash libre pour le journal sur Particle
+  #undef MOD_FLASHLOG
+
   #define _yield()  Particle.process()
   #define _timer_callback_arg void
 #endif
@@ -70,6 +93,8 @@
   #define DEFAULT_HOSTNAME  "remora"
   #include "Arduino.h"
   #include "user_interface.h" // pour les os_timer_t
+  #include <ESP8266WebServer.h>
+  #include <EEPROM.h>
   #include "./MCP23017.h"
   //#include "./RFM69registers.h"
   //#include "./RFM69.h"
@@ -82,13 +107,44 @@
   #define _timer_callback_arg void *pArg
 #endif
 
+// Simulation sur PC du module RF seul (voir Logiciel/host/rfsim)
+#ifdef REMORA_HOST
+  #undef MOD_OLED
+  #undef MOD_TELEINFO
+  #undef MOD_FLASHLOG
+  #undef MOD_WEBAPI
+  #undef MOD_MCAST
+  #undef MOD_MQTT
+  #undef MOD_METRICS
+  #undef MOD_RF_OREGON
+
+  #include "Arduino.h"
+  #include "ULPNode_RF_Protocol.h"
+  #include "RHReliableDatagram.h"
+
+  #define _yield()
+  #define _timer_callback_arg void
+#endif
+
 // Includes du projets remora
 #include "linked_list.h"
 #include "i2c.h"
 #include "rfm.h"
+#include "rfota.h"
+#include "rflink.h"
+#include "rfbatch.h"
+#ifndef REMORA_HOST
 #include "display.h"
 #include "pilotes.h"
 #include "tinfo.h"
+#include "stats.h"
+#include "flashlog.h"
+#include "route.h"
+#include "webapi.h"
+#include "mcast.h"
+#include "mqtt.h"
+#include "metrics.h"
+#endif
 
 // RGB LED related MACROS
 #if defined (SPARK)
@@ -125,6 +181,10 @@
   // RFM69 Pin mapping
   #define RF69_CS   15
   #define RF69_IRQ  2
+
+#elif defined (REMORA_HOST)
+  #define LedRGBOFF() {}
+  #define LedRGBON(x) {}
 #endif
 
 // Ces modules ne sont pas disponibles sur les carte 1.0 et 1.1
@@ -132,28 +192,23 @@
   #undef MOD_RF69
   #undef MOD_OLED
   #undef MOD_RF_OREGON
+  #undef MOD_RF_BATCH
 
   // en revanche le relais l'est sur la carte 1.1
   #ifdef REMORA_BOARD_V11
     #define RELAIS_PIN A1
   #endif
 
-  // Creation macro unique et indépendante du type de
-  // carte pour le controle des I/O
-  #define _digitalWrite(p,v)  digitalWrite(p,v)
-  #define _pinMode(p,v)       pinMode(p,v)
-
 // Carte 1.2+
 #else
   #define LED_PIN    8
   #define RELAIS_PIN 9
-
-  // Creation macro unique et indépendante du type de
-  // carte pour le controle des I/O
-  #define _digitalWrite(p,v)  mcp.digitalWrite(p,v)
-  #define _pinMode(p,v)       mcp.pinMode(p,v)
 #endif
 
+// Creation macro unique et indépendante du type de carte pour le
+// controle des I/O, relais et LED sont sur le 1er expander (fpio.h)
+#define _digitalWrite(p,v)  FpIO::pinWrite(0,p,v)
+
 // Masque de bits pour le status global de l'application
 #define STATUS_MCP    0x0001 // I/O expander detecté
 #define STATUS_OLED   0x0002 // Oled detecté
@@ -185,5 +240,6 @@ extern uint16_t status; // status global de l'application
 // Function exported for other source file
 // =======================================
 char * timeAgo(unsigned long);
+uint16_t bootId(void);
 
 #endif
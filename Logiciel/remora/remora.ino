@@ -31,8 +31,14 @@
   #include "pilotes.h"
   #include "rfm.h"
   #include "tinfo.h"
+  #include "stats.h"
+  #include "flashlog.h"
   #include "linked_list.h"
   #include "route.h"
+  #include "webapi.h"
+  #include "mcast.h"
+  #include "mqtt.h"
+  #include "metrics.h"
   #include "RadioHead.h"
   #include "RH_RF69.h"
   #include "RHDatagram.h"
@@ -47,6 +53,7 @@
   #include <WiFiUDP.h>
   #include <Wire.h>
   #include <SPI.h>
+  #include <EEPROM.h>
   #include "./MCP23017.h"
   #include "./SSD1306.h"
   #include "./GFX.h"
@@ -54,11 +61,21 @@
   #include "./LibTeleinfo.h"
 #endif
 
+#ifdef SPARK
+  // setup() démarre sans attendre la connexion au cloud, les fils
+  // pilotes sont ainsi commandés dès la mise sous tension
+  SYSTEM_THREAD(ENABLED);
+  // Mémoire sauvegardée pour l'état des fils pilotes (variables retained)
+  STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY));
+#endif
+
 // Variables globales
 // ==================
 // status global de l'application
 uint16_t status = 0;
 unsigned long uptime = 0;
+// Fin du test du relais au démarrage
+unsigned long relais_test_timer = 0;
 // Nombre de deconexion cloud detectée
 int my_cloud_disconnect = 0;
 
@@ -106,6 +123,9 @@ void spark_expose_cloud(void)
     // Récupération des valeurs d'étiquettes :
     Particle.variable("tinfo", mytinfo, STRING);
 
+    // Agrégats de consommation (dernière minute, heure et jour en cours)
+    Particle.variable("stats", mystats, STRING);
+
   #endif
 
   // Déclaration des fonction "cloud" (4 fonctions au maximum)
@@ -123,6 +143,11 @@ void spark_expose_cloud(void)
     Particle.function("relais", relais);
     Particle.variable("etatrelais", &etatrelais, INT);
   #endif
+
+  // Message pour un noeud RF, envoyé avec l'ACK de sa prochaine trame
+  #ifdef MOD_RF69
+    Particle.function("rfsend", rfsend);
+  #endif
 }
 #endif
 
@@ -148,6 +173,14 @@ void CheckOTAUpdate(void)
     int port = OTA.parseInt();
     int size = OTA.parseInt();
 
+    // Updater writes where the image of a node update is stored
+    #ifdef MOD_RF69
+      if (rfota_busy()) {
+        Serial.println(F("Update refused, RF node update running"));
+        return;
+      }
+    #endif
+
     LedRGBON(COLOR_MAGENTA);
 
     Serial.print(F("Update Start: ip:"));
@@ -291,6 +324,24 @@ char * timeAgo(unsigned long sec)
   return buff;
 }
 
+/* ======================================================================
+Function: bootId
+Purpose : identifiant aléatoire du démarrage
+Input   : -
+Output  : identifiant
+Comments: pris au générateur matériel de nombres aléatoires, micros() à
+          un même point du setup donne presque la même valeur à chaque
+          démarrage
+====================================================================== */
+uint16_t bootId(void)
+{
+  #ifdef SPARK
+    return HAL_RNG_GetRandomNumber();
+  #else
+    return ESP.random();
+  #endif
+}
+
 
 /* ======================================================================
 Function: setup
@@ -302,6 +353,23 @@ Comments: -
 void setup()
 {
   uint8_t rf_version = 0;
+  uint8_t persist;
+
+  // Init bus I2C
+  i2c_init();
+
+  // Init des fils pilotes et restauration de leur état en tout premier,
+  // avant ce qui peut prendre du temps (Wifi, cloud, téléinfo)
+  if (pilotes_setup())
+    status |= STATUS_MCP ;
+
+  #ifdef MOD_FLASHLOG
+    // Reprise du journal en flash, quelques lectures seulement, pour
+    // que les ordres restaurés y soient tracés
+    flashlog_setup();
+  #endif
+
+  persist = pilotes_restore();
 
   #ifdef SPARK
     bool start = false;
@@ -379,10 +447,43 @@ void setup()
 
     // Connection au Wifi ou Vérification
     WifiHandleConn();
+
+    // Routes du serveur WEB
+    server.on("/json", sendJSON);
+    server.on("/tinfojsontbl", tinfoJSONTable);
+    server.on("/stats", handleStats);
+    #ifdef MOD_METRICS
+    server.on("/metrics", handleMetrics);
+    #endif
+    #ifdef MOD_FLASHLOG
+    server.on("/log", handleLog);
+    #endif
+    #ifdef MOD_RF69
+    server.on("/rfota", HTTP_GET, handleRfOta);
+    server.on("/rfota", HTTP_POST, handleRfOta, handleRfOtaUpload);
+    #endif
+    #ifdef MOD_RF_BATCH
+    server.on("/rfbatch", handleRfBatch);
+    #endif
+    server.onNotFound(handleNotFound);
+
+    // Pour répondre 304 à /json quand la trame n'a pas changé
+    const char * headerkeys[] = { "If-None-Match" };
+    server.collectHeaders(headerkeys, 1);
+
+    // start the webserver
+    server.begin();
   #endif
 
-  // Init bus I2C
-  i2c_init();
+  #if defined (MOD_MCAST) && defined (MOD_TELEINFO)
+    // Diffusion des trames téléinfo, démarrée dans la boucle avec le réseau
+    mcast_setup();
+  #endif
+
+  #ifdef MOD_MQTT
+    // Publication MQTT, la connexion est établie dans la boucle
+    mqtt_setup();
+  #endif
 
   Serial.print("Compile avec les fonctions : ");
 
@@ -398,13 +499,24 @@ void setup()
   #ifdef MOD_RF69
     Serial.print("RFM69 ");
   #endif
+  #ifdef MOD_RF_BATCH
+    Serial.print("RFBATCH ");
+  #endif
+  #ifdef MOD_WEBAPI
+    Serial.print("WEBAPI ");
+  #endif
+  #ifdef MOD_MCAST
+    Serial.print("MCAST ");
+  #endif
+  #ifdef MOD_MQTT
+    Serial.print("MQTT ");
+  #endif
+  #ifdef MOD_METRICS
+    Serial.print("METRICS ");
+  #endif
 
   Serial.println();
 
-  // Init des fils pilotes
-  if (pilotes_setup())
-    status |= STATUS_MCP ;
-
   #ifdef MOD_OLED
     // Initialisation de l'afficheur
     if (display_setup())
@@ -422,38 +534,24 @@ void setup()
   #endif
 
   #ifdef MOD_TELEINFO
-    // Initialiser la téléinfo et attente d'une trame valide
-    // Le status est mis à jour dans les callback de la teleinfo
-    tinfo_setup(true);
-  #endif
+    // Agrégats de consommation alimentés par la téléinfo
+    stats_setup();
 
-  // Led verte durant le test
-  LedRGBON(COLOR_GREEN);
+    // Initialiser la téléinfo sans attendre de trame valide, elle
+    // sera détectée dans la boucle principale par ses callback
+    tinfo_setup(false);
+  #endif
 
-  // Enclencher le relais 1 seconde
-  // si dispo sur la carte
+  // Test du relais au premier démarrage uniquement, il est
+  // relaché dans la boucle principale sans bloquer
   #ifndef REMORA_BOARD_V10
-    Serial.print("Relais=ON   ");
-    relais("1");
-    for (uint8_t i=0; i<20; i++)
-    {
-      delay(10);
-      // Ne pas bloquer la reception et
-      // la gestion de la téléinfo
-      #ifdef MOD_TELEINFO
-        tinfo_loop();
-      #endif
+    if (persist == PERSIST_NONE) {
+      Serial.println("Relais=ON");
+      relais_interne(1);
+      relais_test_timer = millis();
     }
-    Serial.println("Relais=OFF");
-    relais("0");
   #endif
 
-  // nous avons fini, led Jaune
-  LedRGBON(COLOR_YELLOW);
-
-  // Hors gel, désactivation des fils pilotes
-  initFP();
-
   // On etteint la LED embarqué du core
   LedRGBOFF();
 
@@ -471,9 +569,16 @@ void loop()
 {
   static bool refreshDisplay = false;
   static bool lastcloudstate;
+  static bool lastnetstate = false;
   static unsigned long previousMillis = 0;  // last time update
   unsigned long currentMillis = millis();
   bool currentcloudstate ;
+  bool currentnetstate ;
+
+  #ifdef MOD_METRICS
+    // Durée des tours de boucle
+    metrics_loop();
+  #endif
 
   // Gérer notre compteur de secondes
   if ( millis()-previousMillis > 1000) {
@@ -483,6 +588,16 @@ void loop()
     refreshDisplay = true ;
   }
 
+  // Fin du test du relais de démarrage
+  if (relais_test_timer && millis()-relais_test_timer >= 200) {
+    Serial.println("Relais=OFF");
+    relais_interne(0);
+    relais_test_timer = 0;
+  }
+
+  // Sauvegarde de l'état des fils pilotes
+  pilotes_loop();
+
   #ifdef MOD_TELEINFO
     // Vérification de la reception d'une 1ere trame téléinfo
     tinfo_loop();
@@ -557,6 +672,47 @@ void loop()
   // Connection au Wifi ou Vérification
   #ifdef ESP8266
   WifiHandleConn();
+
+  // Traitement des requêtes WEB
+  server.handleClient();
+  #endif
+
+  // Réseau local prêt ? Sur Particle le Wifi n'est pas encore connecté
+  // dans setup() (SYSTEM_THREAD), et une reconnexion perd les sockets
+  #if defined (SPARK)
+  currentnetstate = WiFi.ready();
+  #elif defined (ESP8266)
+  currentnetstate = WiFi.status()==WL_CONNECTED ? true:false;
+  #endif
+
+  if (lastnetstate != currentnetstate)
+  {
+    lastnetstate = currentnetstate;
+
+    // on vient de se connecter, (re)démarrage des services locaux
+    if (currentnetstate)
+    {
+      #ifdef MOD_WEBAPI
+        // API HTTP locale, sans passer par le cloud
+        webapi_setup();
+      #endif
+
+      #if defined (MOD_MCAST) && defined (MOD_TELEINFO)
+        // Diffusion des trames téléinfo sur le réseau local
+        mcast_start();
+      #endif
+    }
+  }
+
+  #ifdef MOD_WEBAPI
+  // Requêtes de l'API locale
+  if (currentnetstate)
+    webapi_loop();
+  #endif
+
+  #ifdef MOD_MQTT
+  // Envoi des publications MQTT en attente
+  mqtt_loop();
   #endif
 
 }
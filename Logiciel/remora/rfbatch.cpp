@@ -0,0 +1,184 @@
+// **********************************************************************************
+// Envoi par lots des relevés des capteurs RF pour remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Les valeurs décodées des trames RF sont regroupées dans un lot
+//           binaire, envoyé quand il est plein ou trop vieux en UDP, en
+//           MQTT et lisible en HTTP sur /rfbatch. Un noeud qui envoie
+//           plusieurs trames pendant la durée d'un lot n'y occupe pas plus
+//           de place, seule sa dernière valeur de chaque type est gardée
+//
+// **********************************************************************************
+
+#include "rfbatch.h"
+
+#ifdef MOD_RF_BATCH
+
+#ifdef RFBATCH_UDP
+  #ifdef SPARK
+    UDP rfbatch_udp;
+  #endif
+  #ifdef ESP8266
+    WiFiUDP rfbatch_udp;
+  #endif
+  IPAddress rfbatch_host(RFBATCH_UDP_HOST);
+#endif
+
+// Lot en cours de remplissage, date de chaque relevé à côté
+uint8_t  rfbatch_buf[sizeof(rfbatch_hdr_t) + RFBATCH_SIZE * sizeof(rfbatch_rec_t)];
+unsigned long rfbatch_time[RFBATCH_SIZE];
+unsigned long rfbatch_start;  // Date du premier relevé du lot (millis)
+
+// Dernier lot envoyé, pour /rfbatch
+uint8_t  rfbatch_prev[sizeof(rfbatch_buf)];
+uint16_t rfbatch_prev_len = 0;
+
+uint16_t rfbatch_boot;        // Identifiant du démarrage
+uint32_t rfbatch_seq = 0;     // Dernier lot envoyé
+
+// Compteurs
+uint32_t rfbatch_readings = 0;  // Relevés reçus
+uint32_t rfbatch_merged = 0;    // Relevés qui en ont remplacé un autre
+uint32_t rfbatch_sent = 0;      // Lots envoyés
+uint32_t rfbatch_bytes = 0;     // Taille des lots envoyés
+
+/* ======================================================================
+Function: rfbatch_add
+Purpose : ajoute un relevé au lot
+Input   : noeud, RSSI de la trame, code et valeur brute
+Output  : -
+Comments: callback de decode_received_data. Le relevé remplace celui du
+          même noeud et du même code s'il est déjà dans le lot, le lot
+          est envoyé dès qu'il est plein
+====================================================================== */
+void rfbatch_add(uint8_t nodeid, int8_t rssi, uint8_t code, int32_t value)
+{
+  rfbatch_hdr_t * hdr = (rfbatch_hdr_t *) rfbatch_buf;
+  rfbatch_rec_t * rec = (rfbatch_rec_t *) (rfbatch_buf + sizeof(rfbatch_hdr_t));
+  uint8_t i;
+
+  rfbatch_readings++;
+
+  for (i=0; i<hdr->count; i++) {
+    if (rec[i].nodeid == nodeid && rec[i].code == code) {
+      rfbatch_merged++;
+      break;
+    }
+  }
+
+  if (i == hdr->count) {
+    if (!hdr->count)
+      rfbatch_start = millis();
+    hdr->count++;
+  }
+
+  rec[i].nodeid = nodeid;
+  rec[i].code   = code;
+  rec[i].rssi   = rssi;
+  rec[i].value  = value;
+  rfbatch_time[i] = millis();
+
+  if (hdr->count == RFBATCH_SIZE)
+    rfbatch_flush();
+}
+
+/* ======================================================================
+Function: rfbatch_flush
+Purpose : envoie le lot en cours
+Input   : -
+Output  : -
+Comments: rien si le lot est vide
+====================================================================== */
+void rfbatch_flush(void)
+{
+  rfbatch_hdr_t * hdr = (rfbatch_hdr_t *) rfbatch_buf;
+  rfbatch_rec_t * rec = (rfbatch_rec_t *) (rfbatch_buf + sizeof(rfbatch_hdr_t));
+  uint16_t len = sizeof(rfbatch_hdr_t) + hdr->count * sizeof(rfbatch_rec_t);
+  unsigned long age;
+
+  if (!hdr->count)
+    return;
+
+  hdr->magic   = RFBATCH_MAGIC;
+  hdr->version = RFBATCH_VERSION;
+  hdr->boot    = rfbatch_boot;
+  hdr->seq     = ++rfbatch_seq;
+  hdr->uptime  = uptime;
+
+  for (uint8_t i=0; i<hdr->count; i++) {
+    age = (millis() - rfbatch_time[i]) / 1000;
+    rec[i].age = age > 255 ? 255 : age;
+  }
+
+  #ifdef RFBATCH_UDP
+    #ifdef SPARK
+      rfbatch_udp.sendPacket(rfbatch_buf, len, rfbatch_host, RFBATCH_UDP_PORT);
+    #endif
+    #ifdef ESP8266
+      rfbatch_udp.beginPacket(rfbatch_host, RFBATCH_UDP_PORT);
+      rfbatch_udp.write(rfbatch_buf, len);
+      rfbatch_udp.endPacket();
+    #endif
+  #endif
+
+  #ifdef MOD_MQTT
+    mqtt_publish_raw(RFBATCH_MQTT, rfbatch_buf, len, false);
+  #endif
+
+  memcpy(rfbatch_prev, rfbatch_buf, len);
+  rfbatch_prev_len = len;
+
+  rfbatch_sent++;
+  rfbatch_bytes += len;
+  hdr->count = 0;
+}
+
+/* ======================================================================
+Function: rfbatch_last
+Purpose : dernier lot envoyé
+Input   : pointeur sur la taille
+Output  : lot, NULL si aucun lot n'a encore été envoyé
+Comments: -
+====================================================================== */
+const uint8_t * rfbatch_last(uint16_t * len)
+{
+  *len = rfbatch_prev_len;
+  return rfbatch_prev_len ? rfbatch_prev : NULL;
+}
+
+/* ======================================================================
+Function: rfbatch_loop
+Purpose : envoie le lot quand son premier relevé est trop vieux
+Input   : -
+Output  : -
+Comments: appelé par rfm_loop
+====================================================================== */
+void rfbatch_loop(void)
+{
+  if (((rfbatch_hdr_t *) rfbatch_buf)->count && millis() - rfbatch_start >= RFBATCH_AGE)
+    rfbatch_flush();
+}
+
+/* ======================================================================
+Function: rfbatch_setup
+Purpose : prépare les lots
+Input   : -
+Output  : -
+Comments: les relevés sont pris au décodage des trames RF
+====================================================================== */
+void rfbatch_setup(void)
+{
+  // Les récepteurs distinguent ainsi un redémarrage d'une perte de lots
+  rfbatch_boot = bootId();
+  ((rfbatch_hdr_t *) rfbatch_buf)->count = 0;
+
+  #if defined (RFBATCH_UDP) && defined (SPARK)
+    rfbatch_udp.begin(RFBATCH_UDP_PORT);
+  #endif
+
+  decode_set_callback(rfbatch_add);
+}
+
+#endif // MOD_RF_BATCH
@@ -0,0 +1,79 @@
+// **********************************************************************************
+// Envoi par lots des relevés des capteurs RF header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Les valeurs décodées des trames RF sont regroupées dans un lot
+//           binaire, envoyé quand il est plein ou trop vieux en UDP, en
+//           MQTT et lisible en HTTP sur /rfbatch. Dans un lot, un nouveau
+//           relevé d'un noeud remplace le précédent de même type
+//
+// **********************************************************************************
+#ifndef RFBATCH_h
+#define RFBATCH_h
+
+#include "remora.h"
+
+// Envoi du lot
+#define RFBATCH_SIZE    58      // Relevés par lot, un lot tient dans un datagramme
+#define RFBATCH_AGE     10000   // Age maximal du premier relevé d'un lot (ms)
+
+// Destinations, à adapter
+//#define RFBATCH_UDP           // Datagramme UDP
+#define RFBATCH_UDP_HOST 192,168,1,2
+#define RFBATCH_UDP_PORT 7081
+#define RFBATCH_MQTT    "rf/batch" // Topic sous MQTT_PREFIX, si MOD_MQTT
+
+// Pas de réseau dans la simulation sur PC, le lot y est seulement compté
+#ifdef REMORA_HOST
+  #undef RFBATCH_UDP
+#endif
+
+// Sans UDP ni MQTT le lot est seulement lisible sur /rfbatch, les trames
+// restent alors aussi envoyées en JSON sur la liaison série
+#if defined (RFBATCH_UDP) || defined (MOD_MQTT)
+  #define RFBATCH_PUSH
+#endif
+
+#define RFBATCH_CONTENT_TYPE "application/octet-stream"
+
+// Format des lots
+#define RFBATCH_MAGIC   0x4252  // "RB"
+#define RFBATCH_VERSION 1
+
+// Entête du lot, little endian
+typedef struct __attribute__((packed))
+{
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  count;     // Nombre de relevés qui suivent
+  uint16_t boot;      // Change à chaque démarrage de la carte
+  uint32_t seq;       // Numéro du lot, +1 à chaque lot envoyé
+  uint32_t uptime;    // Secondes depuis le démarrage, à l'envoi
+} rfbatch_hdr_t;
+
+// Un relevé, valeur brute envoyée par le noeud (voir ULPNode_RF_Protocol.h,
+// ex: température en 1/100 de degré)
+typedef struct __attribute__((packed))
+{
+  uint8_t  nodeid;
+  uint8_t  code;      // RF_DAT_xxx avec l'index (0x25 = temp1), RF_DAT_STATUS
+  int8_t   rssi;
+  uint8_t  age;       // Secondes entre le relevé et l'envoi, 255 au plus
+  int32_t  value;
+} rfbatch_rec_t;
+
+// Function exported for other source file
+// =======================================
+extern uint32_t rfbatch_readings;
+extern uint32_t rfbatch_merged;
+extern uint32_t rfbatch_sent;
+extern uint32_t rfbatch_bytes;
+
+void rfbatch_setup(void);
+void rfbatch_loop(void);
+void rfbatch_flush(void);
+const uint8_t * rfbatch_last(uint16_t * len);
+
+#endif
@@ -0,0 +1,236 @@
+// **********************************************************************************
+// RF link adaptation of ULPNodes source file for remora project
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : TX power and modem config chosen from each node link quality
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include <math.h>
+#include "./ULPNode_RF_Protocol.h"
+#include "./RH_RF69.h"
+#include "./rfm.h"
+#include "./rflink.h"
+
+// GFSK modem configs from RH_RF69 table, slowest first
+// GFSK_Rb55555Fd50 is only there for RFM69 library nodes
+const RFLinkModem rflink_modems[RF_LINK_MODEMS] = {
+  { RH_RF69::GFSK_Rb2Fd5,       2000 },
+  { RH_RF69::GFSK_Rb2_4Fd4_8,   2400 },
+  { RH_RF69::GFSK_Rb4_8Fd9_6,   4800 },
+  { RH_RF69::GFSK_Rb9_6Fd19_2,  9600 },
+  { RH_RF69::GFSK_Rb19_2Fd38_4, 19200 },
+  { RH_RF69::GFSK_Rb38_4Fd76_8, 38400 },
+  { RH_RF69::GFSK_Rb57_6Fd120,  57600 },
+  { RH_RF69::GFSK_Rb125Fd125,   125000 },
+  { RH_RF69::GFSK_Rb250Fd250,   250000 }
+};
+
+/* ======================================================================
+Function: rflink_sensitivity
+Purpose : receiver sensitivity for a bit rate
+Input   : bit rate (bps)
+Output  : sensitivity (dBm)
+Comments: -
+====================================================================== */
+int16_t rflink_sensitivity(uint32_t bitrate)
+{
+  if (bitrate < RF_LINK_SENS_BITRATE)
+    return RF_LINK_SENS_REF;
+
+  return RF_LINK_SENS_REF + (int16_t) lroundf(10.0f * log10f((float) bitrate / RF_LINK_SENS_BITRATE));
+}
+
+/* ======================================================================
+Function: rflink_best
+Purpose : fastest modem config a node link can take
+Input   : node entry
+Output  : rflink_modems[] index
+Comments: with node at full power, keeping RF_LINK_MARGIN, one slower
+          than current config if node can't keep losses low at full power
+====================================================================== */
+uint8_t rflink_best(NodeList * me, uint8_t loss)
+{
+  int16_t rssi = me->rssi_avg / 16 + RF_LINK_POWER_MAX - me->power;
+  uint8_t i;
+
+  for (i=RF_LINK_MODEMS-1; i>0; i--)
+    if (rssi - rflink_sensitivity(rflink_modems[i].bitrate) >= RF_LINK_MARGIN)
+      break;
+
+  // Margin looks good but frames are lost anyway
+  if (me->power >= RF_LINK_POWER_MAX && loss > RF_LINK_LOSS_TARGET) {
+    uint32_t bitrate = driver.bitRate();
+
+    while (i > 0 && rflink_modems[i].bitrate >= bitrate)
+      i--;
+  }
+  return i;
+}
+
+/* ======================================================================
+Function: rflink_receive
+Purpose : update node link statistics, adapt its TX power
+Input   : node entry returned by ll_Add (after rfm_seq_check)
+Output  : -
+Comments: new power waits in the downlink queue for node next ACK,
+          nothing new asked while a message is waiting for this node.
+          Node entry only changes once node got it, see rflink_delivered
+====================================================================== */
+void rflink_receive(NodeList * me)
+{
+  RFLinkConfigPayload cfg;
+  uint16_t bad;
+  uint8_t loss;
+  int16_t margin;
+  int16_t power;
+
+  // Shared by all nodes waiting for an ID
+  if (!me || me->nodeid == RF_DEFAULT_NODE_ID)
+    return;
+
+  // Average over 8 frames, in 1/16 dB
+  me->rssi_avg += ((int16_t) me->rssi * 16 - me->rssi_avg) / 8;
+
+  if (++me->window < RF_LINK_WINDOW)
+    return;
+
+  // Frames lost after all retries and ACKs lost, over window
+  bad = (uint16_t) (me->lost + me->dups) - me->window_bad;
+  loss = (uint32_t) bad * 100 / (me->window + bad);
+  me->window = 0;
+  me->window_bad = me->lost + me->dups;
+
+  margin = me->rssi_avg / 16 - rflink_sensitivity(driver.bitRate());
+  power = me->power;
+
+  if (margin < RF_LINK_MARGIN) {
+    power += constrain(RF_LINK_MARGIN - margin, 0, RF_LINK_STEP_UP);
+  } else if (loss > RF_LINK_LOSS_TARGET) {
+    // Strong link losing frames, that's collisions, more power won't help
+    if (margin < RF_LINK_MARGIN_LOSS)
+      power += RF_LINK_STEP_UP / 2;
+  } else if (margin > RF_LINK_MARGIN + RF_LINK_HYSTERESIS) {
+    power -= constrain(margin - RF_LINK_MARGIN, 0, RF_LINK_STEP_DOWN);
+  }
+  power = constrain(power, RF_LINK_POWER_MIN, RF_LINK_POWER_MAX);
+
+  me->modem = rflink_best(me, loss);
+
+  if (power == me->power || rfm_downlink_pending(me->nodeid))
+    return;
+
+  cfg.command = RF_PL_OTA_CONFIG;
+  cfg.type    = ULPN_CONFIG_TYPE_LINK;
+  cfg.power   = power;
+  cfg.modem   = RFM69_MODEMCFG;
+  rfm_downlink(me->nodeid, RF_LINK_PRIO, (uint8_t *) &cfg, sizeof(cfg));
+}
+
+/* ======================================================================
+Function: rflink_delivered
+Purpose : node got a message of the downlink queue
+Input   : node ID, message and size
+Output  : -
+Comments: called by rfm_downlink_next when node sends a new frame after
+          the ACK that carried it. A link config is in use from this
+          frame on, so gateway moves to the new power only now
+====================================================================== */
+void rflink_delivered(uint8_t nodeid, const uint8_t * buf, uint8_t len)
+{
+  RFLinkConfigPayload * cfg = (RFLinkConfigPayload *) buf;
+  NodeList * me = rflink_node(nodeid);
+
+  if (!me || len < sizeof(RFLinkConfigPayload) ||
+      cfg->command != RF_PL_OTA_CONFIG || cfg->type != ULPN_CONFIG_TYPE_LINK)
+    return;
+
+  #ifdef RF_DEBUG_VERBOSE
+    Serial.print(F("\r\n# -> "));
+    Serial.print(nodeid, DEC);
+    Serial.print(F(" TX power "));
+    Serial.print(me->power, DEC);
+    Serial.print(F(" -> "));
+    Serial.print(cfg->power, DEC);
+    Serial.println(F("dBm"));
+  #endif
+
+  // Next frames come with new power, don't wait average to catch up
+  me->rssi_avg += (cfg->power - me->power) * 16;
+  me->power = cfg->power;
+}
+
+/* ======================================================================
+Function: rflink_node
+Purpose : node entry of a node ID of our network
+Input   : node ID
+Output  : node entry, NULL if unknown or shared default ID
+Comments: -
+====================================================================== */
+NodeList * rflink_node(uint8_t nodeid)
+{
+  NodeList * me = &nodes_list;
+
+  if (nodeid == RF_DEFAULT_NODE_ID)
+    return NULL;
+
+  while ((me = me->next)) {
+    if (me->nodeid == nodeid && me->groupid == RFM69_NETWORKID)
+      return me;
+  }
+  return NULL;
+}
+
+/* ======================================================================
+Function: rflink_tx_power
+Purpose : gateway TX power for a frame to a node
+Input   : node ID
+Output  : power (dBm)
+Comments: same as node power, link is the same both ways
+====================================================================== */
+int8_t rflink_tx_power(uint8_t nodeid)
+{
+  NodeList * me = rflink_node(nodeid);
+
+  if (me)
+    return constrain(me->power, RF_LINK_GW_POWER_MIN, RF_LINK_GW_POWER_MAX);
+  return RF_LINK_GW_POWER_MAX;
+}
+
+/* ======================================================================
+Function: rflink_bitrate
+Purpose : fastest bit rate of a node link
+Input   : node entry
+Output  : bit rate (bps)
+Comments: -
+====================================================================== */
+uint32_t rflink_bitrate(NodeList * me)
+{
+  return rflink_modems[me->modem].bitrate;
+}
+
+/* ======================================================================
+Function: rflink_network_bitrate
+Purpose : fastest bit rate all nodes could use
+Input   : -
+Output  : bit rate (bps), current one if no node seen lately
+Comments: slowest node link seen in the last RF_LINK_ACTIVE seconds
+====================================================================== */
+uint32_t rflink_network_bitrate(void)
+{
+  NodeList * me = &nodes_list;
+  uint32_t bitrate = 0;
+
+  while ((me = me->next)) {
+    if (me->nodeid == RF_DEFAULT_NODE_ID || uptime - me->lastseen > RF_LINK_ACTIVE)
+      continue;
+    if (!bitrate || rflink_bitrate(me) < bitrate)
+      bitrate = rflink_bitrate(me);
+  }
+  return bitrate ? bitrate : driver.bitRate();
+}
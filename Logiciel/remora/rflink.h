@@ -0,0 +1,85 @@
+// **********************************************************************************
+// RF link adaptation of ULPNodes headers file for remora project
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : TX power and modem config chosen from each node link quality
+//
+// Gateway keeps an RSSI average of each node and counts lost frames
+// (sequence gaps) and lost ACKs (duplicates) over a window of frames.
+// At the end of each window the node TX power is moved to keep
+// RF_LINK_MARGIN dB over the receiver sensitivity of the modem config
+// in use, and raised when losses go over RF_LINK_LOSS_TARGET. New power
+// goes to the node in an ACK (RF_PL_OTA_CONFIG, ULPN_CONFIG_TYPE_LINK,
+// see rfm_downlink), gateway ACKs to that node use the same power once
+// the node confirmed it got it by sending its next frame.
+//
+// Gateway has one radio listening on one modem config, so a node can't
+// use a config of its own. For each node we compute the fastest config
+// its link would keep under the loss target at full power, the slowest
+// of them is the fastest config the whole network could use.
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef RFLINK_h
+#define RFLINK_h
+
+#include "remora.h"
+
+// Defined in linked_list.h, which may come after us in remora.h
+typedef struct _NodeList NodeList;
+
+// Link targets
+#define RF_LINK_WINDOW        32    // Frames between two decisions
+#define RF_LINK_LOSS_TARGET   5     // Max % of frames or ACKs lost
+#define RF_LINK_MARGIN        10    // dB over sensitivity to aim for
+#define RF_LINK_HYSTERESIS    3     // dB over margin before lowering power
+#define RF_LINK_MARGIN_LOSS   20    // dB margin over which losses are collisions
+#define RF_LINK_STEP_UP       6     // Max dB up at once
+#define RF_LINK_STEP_DOWN     3     // Max dB down at once
+#define RF_LINK_ACTIVE        3600  // s, nodes not seen since are left out
+#define RF_LINK_PRIO          0x40  // Downlink priority of link configs
+
+// Node TX power, node keeps it in what its module can do (RFM69W up
+// to +13dBm, RFM69HW +14 to +20dBm)
+#define RF_LINK_POWER_MIN     -18
+#define RF_LINK_POWER_MAX     20
+#define RF_LINK_POWER_DEFAULT RFM69_TXPWR  // Until node got a link config
+
+// Gateway is a RFM69HW, PA0 below +14dBm is not wired
+#define RF_LINK_GW_POWER_MIN  14
+#define RF_LINK_GW_POWER_MAX  20
+
+// RFM69 sensitivity is -120dBm at 1.2kbps and loses 10*log10 of the
+// bit rate increase (noise bandwidth)
+#define RF_LINK_SENS_REF      -120
+#define RF_LINK_SENS_BITRATE  1200
+
+// GFSK modem configs from RH_RF69 table, slowest first
+typedef struct
+{
+  uint8_t  modem;    /* RH_RF69::ModemConfigChoice */
+  uint32_t bitrate;  /* bps */
+} RFLinkModem;
+
+#define RF_LINK_MODEMS        9
+
+// Variables exported to other source file
+// ========================================
+extern const RFLinkModem rflink_modems[RF_LINK_MODEMS];
+
+// Function exported for other source file
+// =======================================
+void rflink_receive(NodeList * me);
+void rflink_delivered(uint8_t nodeid, const uint8_t * buf, uint8_t len);
+NodeList * rflink_node(uint8_t nodeid);
+int8_t rflink_tx_power(uint8_t nodeid);
+int16_t rflink_sensitivity(uint32_t bitrate);
+uint32_t rflink_bitrate(NodeList * me);
+uint32_t rflink_network_bitrate(void);
+
+#endif
@@ -16,11 +16,40 @@
 #include "./linked_list.h"
 #include "./ULPNode_RF_Protocol.h"
 #include "./rfm.h"
-#include "./RH_RF69.h"
+#include "./rfota.h"
+#include "./rflink.h"
 
 
 unsigned long rf_rgb_led_timer = 0;
 
+// Packets that took more than RF_RX_BUDGET_US to read
+uint32_t rf_rx_over_budget = 0;
+
+// Replies waiting to be sent
+RFTxData rf_tx_queue[RF_TX_QUEUE];
+uint8_t rf_tx_head = 0;
+uint8_t rf_tx_tail = 0;
+int8_t  rf_tx_power = 0;     // Power radio is set to (dBm)
+
+// Reply latency histogram, last slot is for replies later than ACK_TIME
+const uint8_t rf_reply_bounds[RF_REPLY_BUCKETS] = { 1, 2, 5, 10, 20, ACK_TIME };
+uint32_t rf_reply_hist[RF_REPLY_BUCKETS+1];
+uint32_t rf_reply_sum = 0;      // Sum of latencies (ms)
+uint32_t rf_reply_expired = 0;  // Dropped, too late or queue full
+
+// Messages waiting for nodes
+RFDownData rf_down[RF_DOWN_SLOTS];
+uint32_t rf_down_order = 0;
+uint32_t rf_down_delivered = 0; // Node moved on after getting it
+uint32_t rf_down_dropped = 0;   // Pushed out by higher priority ones
+
+// Node ID leases
+RFLeaseTable rf_leases;
+static_assert(RF_DHCP_EEPROM_ADDR + sizeof(RFLeaseTable) <= EEPROM_SIZE,
+              "RF lease table does not fit in EEPROM_SIZE");
+unsigned long rf_dhcp_dirty = 0;  // millis() of first unsaved change, 0 if saved
+unsigned long rf_dhcp_day = 0;    // uptime of last lease clock tick
+
 // data received by RF module
 // independent from module received (RF12 or RF69)
 // used to display or send to serial
@@ -33,7 +62,10 @@ NodeList nodes_list;
 //RH_RF69     rf69_drv(RF69_CS, RF69_IRQ);// instance of the radio driver
 //RHDatagram  rf69(rf69_drv);         // Manage message delivery and receipt
 //RH_RF69 * prf69_drv = &rf69_drv;
-#ifdef ESP8266
+#if defined (REMORA_HOST)
+  // simulated radio
+  RH_VirtualRF driver;
+#elif defined (ESP8266)
   #ifdef RH_RF69_IRQLESS
     RH_RF69 driver(RF69_CS, RF69_IRQ);// instance of the radio driver
   #else
@@ -45,6 +77,533 @@ NodeList nodes_list;
   RH_RF69 driver(RF69_CS, RF69_IRQ);
 #endif
 
+/* ======================================================================
+Function: rfm_tx_queue
+Purpose : queue a reply to a received packet
+Input   : destination node, our address, sequence id, header flags,
+          data and size, reception time, delay before sending (ms),
+          downlink message carried by this reply (NULL if none)
+Output  : false if queue is full (reply dropped)
+Comments: sent later by rfm_tx_loop, never blocks. The message is marked
+          sent only when the reply goes on air
+====================================================================== */
+bool rfm_tx_queue(uint8_t to, uint8_t from, uint8_t id, uint8_t flags,
+                  const uint8_t * buf, uint8_t len, unsigned long rxtime, uint8_t wait,
+                  RFDownData * down)
+{
+  RFTxData * tx;
+
+  if ((uint8_t) (rf_tx_head - rf_tx_tail) >= RF_TX_QUEUE || len > sizeof(tx->buffer)) {
+    // Message is still to be sent
+    if (down)
+      down->sent = false;
+    rf_reply_expired++;
+    return false;
+  }
+
+  tx = &rf_tx_queue[rf_tx_head & (RF_TX_QUEUE-1)];
+  tx->to     = to;
+  tx->from   = from;
+  tx->id     = id;
+  tx->flags  = flags;
+  tx->len    = len;
+  tx->rxtime = rxtime;
+  tx->due    = rxtime + wait;
+  tx->power  = rflink_tx_power(to);
+  tx->down   = down;
+  if (down) {
+    tx->order = down->order;
+    down->queued = true;
+  }
+  memcpy(tx->buffer, buf, len);
+  rf_tx_head++;
+
+  return true;
+}
+
+/* ======================================================================
+Function: rfm_tx_loop
+Purpose : send next queued reply when it's due and radio is free
+Input   : -
+Output  : -
+Comments: transmission is finished by radio interrupt (or by polling in
+          driver.available() on ESP8266), we just check mode
+====================================================================== */
+void rfm_tx_loop(void)
+{
+  RFTxData * tx;
+  RFDownData * down;
+  unsigned long latency;
+  uint8_t b;
+
+  while (rf_tx_tail != rf_tx_head && driver.mode() != RHGenericDriver::RHModeTx) {
+    tx = &rf_tx_queue[rf_tx_tail & (RF_TX_QUEUE-1)];
+    latency = millis() - tx->rxtime;
+
+    // Message slot dropped or reused meanwhile
+    down = tx->down;
+    if (down && (down->nodeid != tx->to || down->order != tx->order))
+      down = NULL;
+
+    // Node is not listening anymore, message is still to be sent
+    if (latency > ACK_TIME) {
+      if (down) {
+        down->queued = false;
+        down->sent = false;
+      }
+      rf_reply_expired++;
+      rf_tx_tail++;
+      continue;
+    }
+
+    // Let node switch to receive
+    if ((long) (millis() - tx->due) < 0)
+      return;
+
+    rfm_tx_power(tx->power);
+    driver.setHeaderTo(tx->to);
+    driver.setHeaderFrom(tx->from);
+    driver.setHeaderId(tx->id);
+    driver.setHeaderFlags(tx->flags, 0xFF);
+    driver.send(tx->buffer, tx->len);
+    rf_tx_tail++;
+
+    // Delivered when node moves on to another frame
+    if (down) {
+      down->queued = false;
+      down->sent = true;
+      down->seqid = tx->id;
+    }
+
+    for (b=0; b<RF_REPLY_BUCKETS && latency>rf_reply_bounds[b]; b++);
+    rf_reply_hist[b]++;
+    rf_reply_sum += latency;
+
+    // One on air at a time
+    return;
+  }
+}
+
+/* ======================================================================
+Function: rfm_tx_power
+Purpose : set radio TX power for next frame
+Input   : power (dBm), see rflink_tx_power
+Output  : -
+Comments: registers are written only when power changes
+====================================================================== */
+void rfm_tx_power(int8_t power)
+{
+  if (power != rf_tx_power) {
+    driver.setTxPower(power);
+    rf_tx_power = power;
+  }
+}
+
+/* ======================================================================
+Function: rfm_tx_idle
+Purpose : check radio is free for another transmission
+Input   : -
+Output  : true if no reply is waiting and radio is not sending
+Comments: for transfers (rfota) that must leave the way to replies
+====================================================================== */
+bool rfm_tx_idle(void)
+{
+  return rf_tx_tail == rf_tx_head && driver.mode() != RHGenericDriver::RHModeTx;
+}
+
+/* ======================================================================
+Function: rfm_downlink
+Purpose : queue a message for a node, sent with the ACK of its next frame
+Input   : node ID, priority (higher sent first), data and size
+Output  : number of messages now waiting for this node, -1 if not queued
+Comments: when pool is full the oldest message of lowest priority is
+          dropped, unless it has higher priority than this one
+====================================================================== */
+int8_t rfm_downlink(uint8_t nodeid, uint8_t prio, const uint8_t * buf, uint8_t len)
+{
+  RFDownData * slot = NULL;
+
+  if (!nodeid || nodeid == RH_BROADCAST_ADDRESS || !len || len > RF_DOWN_SIZE)
+    return -1;
+
+  // Free slot, or the one to drop
+  for (uint8_t i=0; i<RF_DOWN_SLOTS; i++) {
+    RFDownData * s = &rf_down[i];
+
+    if (!s->nodeid) {
+      slot = s;
+      break;
+    }
+    if (!slot || s->prio < slot->prio || (s->prio == slot->prio && s->order < slot->order))
+      slot = s;
+  }
+
+  if (slot->nodeid) {
+    if (slot->prio > prio)
+      return -1;
+    rf_down_dropped++;
+  }
+
+  slot->order  = rf_down_order++;
+  slot->nodeid = nodeid;
+  slot->prio   = prio;
+  slot->queued = false;
+  slot->sent   = false;
+  slot->len    = len;
+  memcpy(slot->buffer, buf, len);
+
+  return rfm_downlink_pending(nodeid);
+}
+
+/* ======================================================================
+Function: rfm_downlink_pending
+Purpose : number of messages waiting for a node
+Input   : node ID
+Output  : count, including the one in last ACK not yet confirmed
+Comments: -
+====================================================================== */
+uint8_t rfm_downlink_pending(uint8_t nodeid)
+{
+  uint8_t count = 0;
+
+  for (uint8_t i=0; i<RF_DOWN_SLOTS; i++)
+    if (nodeid && rf_down[i].nodeid == nodeid)
+      count++;
+
+  return count;
+}
+
+/* ======================================================================
+Function: rfm_downlink_next
+Purpose : message to put in the ACK of a node frame
+Input   : node ID, frame sequence ID
+          set to true if more messages are waiting after this one
+Output  : message or NULL if none
+Comments: a new sequence ID means node got the previous ACK, so the
+          message it carried is delivered. Message is marked sent by
+          rfm_tx_loop when the ACK goes on air
+====================================================================== */
+RFDownData * rfm_downlink_next(uint8_t nodeid, uint8_t seqid, bool * more)
+{
+  RFDownData * again = NULL;
+  RFDownData * next = NULL;
+  uint8_t waiting = 0;
+
+  for (uint8_t i=0; i<RF_DOWN_SLOTS; i++) {
+    RFDownData * s = &rf_down[i];
+
+    // Already in a reply not sent yet
+    if (s->nodeid != nodeid || s->queued)
+      continue;
+
+    if (s->sent) {
+      // ACK was lost, node sends same frame again
+      if (s->seqid == seqid) {
+        again = s;
+      } else {
+        s->nodeid = 0;
+        rf_down_delivered++;
+        rflink_delivered(nodeid, s->buffer, s->len);
+      }
+      continue;
+    }
+
+    waiting++;
+    if (!next || s->prio > next->prio || (s->prio == next->prio && s->order < next->order))
+      next = s;
+  }
+
+  if (again) {
+    *more = waiting > 0;
+    return again;
+  }
+
+  *more = waiting > 1;
+  return next;
+}
+
+/* ======================================================================
+Function: rfsend
+Purpose : queue a message for a node from Particle cloud
+Input   : command, see rfsend_cmd
+Output  : see rfsend_cmd
+Comments: -
+====================================================================== */
+#ifdef SPARK
+int rfsend(String command)
+{
+  return rfsend_cmd(command.c_str(), command.length());
+}
+#endif
+
+/* ======================================================================
+Function: rfsend_cmd
+Purpose : queue a message for a node
+Input   : command and size, "node,priority,hex data"
+          ex: 12,1,0401 => RF_PL_OTA_CONFIG command 01 for node 12
+Output  : number of messages waiting for node, -1 if error
+Comments: -
+====================================================================== */
+int rfsend_cmd(const char * cmd, int len)
+{
+  char str[2*RF_DOWN_SIZE + 12];
+  uint8_t buf[RF_DOWN_SIZE];
+  unsigned int nodeid, prio;
+  uint8_t size = 0;
+  char * p;
+  int n;
+
+  if (len <= 0 || len >= (int) sizeof(str))
+    return -1;
+  memcpy(str, cmd, len);
+  str[len] = '\0';
+
+  if (sscanf(str, "%u,%u,%n", &nodeid, &prio, &n) != 2 || nodeid > 0xFF || prio > 0xFF)
+    return -1;
+
+  for (p = str + n; isxdigit(p[0]) && isxdigit(p[1]) && size < sizeof(buf); p += 2) {
+    char hex[3] = { p[0], p[1], '\0' };
+    buf[size++] = strtoul(hex, NULL, 16);
+  }
+  if (*p && *p != ' ')
+    return -1;
+
+  return rfm_downlink(nodeid, prio, buf, size);
+}
+
+/* ======================================================================
+Function: rfm_dhcp_crc
+Purpose : checksum of lease table
+Input   : lease table
+Output  : checksum (Fletcher 16)
+Comments: on the whole table except magic/crc header
+====================================================================== */
+uint16_t rfm_dhcp_crc(RFLeaseTable * t)
+{
+  uint8_t * data = (uint8_t *) t + 4;
+  uint16_t sum1 = 0, sum2 = 0;
+
+  for (uint16_t i=0; i<sizeof(RFLeaseTable)-4; i++) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+/* ======================================================================
+Function: rfm_dhcp_setup
+Purpose : read lease table from EEPROM
+Input   : -
+Output  : -
+Comments: EEPROM.begin() has been done by pilotes_restore() on ESP8266
+====================================================================== */
+void rfm_dhcp_setup(void)
+{
+  EEPROM.get(RF_DHCP_EEPROM_ADDR, rf_leases);
+
+  if (rf_leases.magic != RF_DHCP_MAGIC || rf_leases.crc != rfm_dhcp_crc(&rf_leases)) {
+    memset(&rf_leases, 0, sizeof(rf_leases));
+    rf_leases.magic = RF_DHCP_MAGIC;
+    Serial.println(F("No RF leases saved"));
+    return;
+  }
+
+  Serial.print(F("RF leases restored : "));
+  Serial.println(rfm_dhcp_leases());
+}
+
+/* ======================================================================
+Function: rfm_dhcp_changed
+Purpose : lease table needs to be saved
+Input   : -
+Output  : -
+Comments: rfm_dhcp_loop() writes it RF_DHCP_SAVE_DELAY later, so a batch
+          of new nodes is one EEPROM write
+====================================================================== */
+void rfm_dhcp_changed(void)
+{
+  if (!rf_dhcp_dirty)
+    rf_dhcp_dirty = millis() ? millis() : 1;
+}
+
+/* ======================================================================
+Function: rfm_dhcp_expired
+Purpose : check if a lease has ended
+Input   : lease table slot
+Output  : true if slot is free or its lease has ended
+Comments: -
+====================================================================== */
+bool rfm_dhcp_expired(uint16_t slot)
+{
+  return !rf_leases.hwid[slot] || (int16_t) (rf_leases.expire[slot] - rf_leases.clock) <= 0;
+}
+
+/* ======================================================================
+Function: rfm_dhcp_find
+Purpose : look for the lease of a hardware ID
+Input   : hardware ID
+          set to slot a new lease can take, -1 if table is full
+Output  : slot of the lease, -1 if none
+Comments: open addressing, slots are never emptied again so probing
+          stops at the first never used one. A never used slot is
+          preferred to an expired one, node may still come back
+====================================================================== */
+int16_t rfm_dhcp_find(uint32_t hwid, int16_t * freeslot)
+{
+  uint16_t slot = (uint32_t) (hwid * 2654435761UL) >> (32 - RF_DHCP_BITS);
+
+  *freeslot = -1;
+  for (uint16_t n=0; n<RF_DHCP_LEASES; n++, slot = (slot+1) & (RF_DHCP_LEASES-1)) {
+    if (rf_leases.hwid[slot] == hwid)
+      return slot;
+
+    if (!rf_leases.hwid[slot]) {
+      *freeslot = slot;
+      return -1;
+    }
+
+    if (*freeslot < 0 && rfm_dhcp_expired(slot))
+      *freeslot = slot;
+  }
+  return -1;
+}
+
+/* ======================================================================
+Function: rfm_dhcp_request
+Purpose : give a node ID to a hardware ID
+Input   : hardware ID
+Output  : node ID, 0 if no ID left
+Comments: same ID as before if node has (or had) a lease, lease is renewed
+====================================================================== */
+uint8_t rfm_dhcp_request(uint32_t hwid)
+{
+  int16_t slot, freeslot;
+  uint16_t expire = rf_leases.clock + RF_DHCP_LEASE_DAYS;
+
+  if (!hwid)
+    return 0;
+
+  slot = rfm_dhcp_find(hwid, &freeslot);
+  if (slot < 0) {
+    if (freeslot < 0)
+      return 0;
+
+    slot = freeslot;
+    rf_leases.hwid[slot] = hwid;
+    rfm_dhcp_changed();
+  }
+
+  if (rf_leases.expire[slot] != expire) {
+    rf_leases.expire[slot] = expire;
+    rfm_dhcp_changed();
+  }
+
+  return RF_DHCP_FIRST_ID + slot;
+}
+
+/* ======================================================================
+Function: rfm_dhcp_seen
+Purpose : renew lease of a node
+Input   : node ID
+Output  : -
+Comments: nothing to do for manual IDs or IDs not leased
+====================================================================== */
+void rfm_dhcp_seen(uint8_t nodeid)
+{
+  uint16_t slot = nodeid - RF_DHCP_FIRST_ID;
+  uint16_t expire = rf_leases.clock + RF_DHCP_LEASE_DAYS;
+
+  if (nodeid < RF_DHCP_FIRST_ID || slot >= RF_DHCP_LEASES || !rf_leases.hwid[slot])
+    return;
+
+  if (rf_leases.expire[slot] != expire) {
+    rf_leases.expire[slot] = expire;
+    rfm_dhcp_changed();
+  }
+}
+
+/* ======================================================================
+Function: rfm_dhcp_leases
+Purpose : number of leases in use
+Input   : -
+Output  : count of leases not expired
+Comments: -
+====================================================================== */
+uint8_t rfm_dhcp_leases(void)
+{
+  uint8_t count = 0;
+
+  for (uint16_t slot=0; slot<RF_DHCP_LEASES; slot++)
+    if (!rfm_dhcp_expired(slot))
+      count++;
+
+  return count;
+}
+
+/* ======================================================================
+Function: rfm_dhcp_loop
+Purpose : run lease clock and save lease table when changed
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void rfm_dhcp_loop(void)
+{
+  // One more day of running
+  if (uptime - rf_dhcp_day >= 86400UL) {
+    rf_dhcp_day += 86400UL;
+    rf_leases.clock++;
+    rfm_dhcp_changed();
+  }
+
+  if (!rf_dhcp_dirty || millis() - rf_dhcp_dirty < RF_DHCP_SAVE_DELAY)
+    return;
+
+  rf_dhcp_dirty = 0;
+  rf_leases.crc = rfm_dhcp_crc(&rf_leases);
+  EEPROM.put(RF_DHCP_EEPROM_ADDR, rf_leases);
+  #ifndef SPARK
+    EEPROM.commit();
+  #endif
+
+  Serial.println(F("RF leases saved to EEPROM"));
+}
+
+/* ======================================================================
+Function: rfm_seq_check
+Purpose : track node sequence ID to find duplicates and lost packets
+Input   : node entry returned by ll_Add, received sequence ID
+Output  : true if packet is a retransmission already received
+Comments: node retransmits same ID when our ACK got lost, it still needs
+          the ACK but payload must not be decoded and published twice
+====================================================================== */
+bool rfm_seq_check(NodeList * me, uint8_t seqid)
+{
+  uint8_t gap;
+
+  if (!me)
+    return false;
+
+  // First packet from this node, nothing to compare
+  if (me->packets == 1) {
+    me->seqid = seqid;
+    return false;
+  }
+
+  if (seqid == me->seqid) {
+    me->dups++;
+    return true;
+  }
+
+  // 8 bits ID wraps, so does gap
+  gap = seqid - me->seqid - 1;
+  if (gap && gap <= RF_SEQ_MAX_GAP)
+    me->lost += gap;
+
+  me->seqid = seqid;
+  return false;
+}
+
 /* ======================================================================
 Function: rfm_receive_data
 Purpose : receive data payload on RF and manage ACK
@@ -63,6 +622,7 @@ unsigned long rfm_receive_data(void)
   data.size    = sizeof(data.buffer);
   data.groupid = RFM69_NETWORKID;
   data.ack = '\0';  // default no ack
+  data.dup = false;
 
   // grab the frame received
   if (driver.recv(data.buffer, &data.size)) {
@@ -97,23 +657,21 @@ unsigned long rfm_receive_data(void)
           //DebugF(" Sending ACK to ");
           //Debug(data.nodeid);
 
-          // Header is now ACK response (set) and no more ACK Request (clear)
-          driver.setHeaderFlags(RH_FLAGS_ACK, RF_PAYLOAD_REQ_ACK);
-          driver.setHeaderId(data.seqid);
-          driver.setHeaderTo(data.nodeid);
-          driver.setHeaderFrom(toid);
+          // Header is now ACK response and no more ACK Request
+          // Waiting message for the node takes the place of ack char
+          bool more;
+          RFDownData * down = rfm_downlink_next(data.nodeid, data.seqid, &more);
           data.ack = '!';
 
           // We have powerfull speed CPU, but Wait slave to setup the receiver for
-          // ACK reception
-          #if (RF_GATEWAY_PLATFORM==RF_GATEWAY_PLATFORM_PARTICLE) || defined (ESP8266)
-            delay(1);
-            //delayMicroseconds(100);
-          #endif
-
-          // Send the response packet
-          driver.send(&data.ack, sizeof(data.ack));
-          driver.waitPacketSent();
+          // ACK reception, rfm_tx_loop() will send it when due
+          if (down)
+            rfm_tx_queue(data.nodeid, toid, data.seqid, RH_FLAGS_ACK | (more ? RF_PAYLOAD_PENDING : 0),
+                         down->buffer, down->len, driver.getLastPreambleTime(), RF_ACK_DELAY, down);
+          else
+            rfm_tx_queue(data.nodeid, toid, data.seqid, RH_FLAGS_ACK,
+                         &data.ack, sizeof(data.ack), driver.getLastPreambleTime(), RF_ACK_DELAY);
+          rfm_tx_loop();
 
           // ACK makes led to green
           #if defined (RGB_LED_PIN)
@@ -126,7 +684,10 @@ unsigned long rfm_receive_data(void)
     // Prepare our last seen value
     node_last_seen = uptime;
 
-    ll_Add(&nodes_list, data.groupid, data.nodeid, data.rssi, &node_last_seen);
+    NodeList * me = ll_Add(&nodes_list, data.groupid, data.nodeid, data.rssi, &node_last_seen);
+    data.dup = rfm_seq_check(me, data.seqid);
+    rflink_receive(me);
+    rfm_dhcp_seen(data.nodeid);
     //ll_Dump(&nodes_list, g_second);
 
   } // revcfrom()
@@ -162,7 +723,8 @@ bool rfm_setup(void)
 
     // If you are using a high power RF69, you *must* set a Tx power in the
     // range 14 to 20 like this:
-    driver.setTxPower(20);
+    driver.setTxPower(RF_LINK_GW_POWER_MAX);
+    rf_tx_power = RF_LINK_GW_POWER_MAX;
 
     // set driver parameters
     driver.setThisAddress(RFM69_NODEID);  // filtering address when receiving
@@ -174,6 +736,23 @@ bool rfm_setup(void)
     nodes_list.nodeid   = 0 ;
     nodes_list.rssi     = 0 ;
     nodes_list.lastseen = 0 ;
+    nodes_list.packets  = 0 ;
+    nodes_list.seqid    = 0 ;
+    nodes_list.lost     = 0 ;
+    nodes_list.dups     = 0 ;
+    nodes_list.rssi_avg = 0 ;
+    nodes_list.power    = RF_LINK_POWER_DEFAULT ;
+    nodes_list.modem    = RF_LINK_MODEMS - 1 ;
+    nodes_list.window   = 0 ;
+    nodes_list.window_bad = 0 ;
+
+    // Node IDs given before reboot
+    rfm_dhcp_setup();
+
+    #ifdef MOD_RF_BATCH
+      // Decoded values go to batches
+      rfbatch_setup();
+    #endif
   }
 
   Serial.flush();
@@ -193,25 +772,58 @@ void rfm_loop(void)
 
   static uint8_t got_first = false;
   static unsigned long packet_last_seen=0;// second since last packet received
-  uint8_t packetReceived = 0;
+  static uint16_t rx_dropped = 0;
+  #ifdef RF_DEBUG_VERBOSE
   unsigned long node_last_seen;  // Second since we saw this node
+  #endif
   unsigned long currentMillis = millis();
 
-  // Data received from driver ?
-  if (driver.available()) {
-    node_last_seen = rfm_receive_data();
-    packet_last_seen = uptime;
-    packetReceived = true;
+  // Packets lost because driver queue was full
+  if (driver.rxDropped() != rx_dropped) {
+    Serial.print(F("RF queue full, dropped "));
+    Serial.println((uint16_t) (driver.rxDropped() - rx_dropped));
+    rx_dropped = driver.rxDropped();
   }
 
-  // received data ?
-  if (packetReceived) {
+  // Reply due or radio now free ?
+  rfm_tx_loop();
+
+  // Lease clock and lease table saving
+  rfm_dhcp_loop();
+
+  // Firmware update block to send to a node ?
+  rfota_loop();
+
+  #ifdef MOD_RF_BATCH
+    // Batch of readings too old ?
+    rfbatch_loop();
+  #endif
+
+  // Drain packets queued by the driver, a batch per loop
+  for (uint8_t batch=0; batch<RF_RX_BATCH && driver.available(); batch++) {
+    #ifdef RF_DEBUG_VERBOSE
+      node_last_seen = rfm_receive_data();
+    #else
+      rfm_receive_data();
+    #endif
+    packet_last_seen = uptime;
+
+    // Report packets that held the CPU too long
+    if (driver.rxTimeLast() > RF_RX_BUDGET_US) {
+      rf_rx_over_budget++;
+      #ifdef RF_DEBUG_VERBOSE
+        Serial.print(F("RF receive took "));
+        Serial.print(driver.rxTimeLast());
+        Serial.println(F("us"));
+      #endif
+    }
+
     // command code
     uint8_t cmd = data.buffer[0];
-    unsigned long seen = uptime-node_last_seen;
 
-    #define DEBUG_VERBOSE
-    #ifdef DEBUG_VERBOSE
+    #ifdef RF_DEBUG_VERBOSE
+      unsigned long seen = uptime-node_last_seen;
+
       // Dump Raw packet
       Serial.print(F("# ("));
       Serial.print(uptime);
@@ -220,6 +832,8 @@ void rfm_loop(void)
       if (data.flags & RF_PAYLOAD_REQ_ACK)
         Serial.print(F(" ACKED"));
 
+      if (data.dup)
+        Serial.print(F(" DUP"));
 
       Serial.print(F(" <- node:"));  Serial.print(data.nodeid,DEC);
       Serial.print(F(" size:"));     Serial.print(data.size);
@@ -253,6 +867,12 @@ void rfm_loop(void)
       Serial.println(F(" Bytes free "));
     #endif
 
+    // Retransmission, ACK has been sent again, nothing new to decode,
+    // but a ping or DHCP request retried because answer was lost needs
+    // a new one (new nodes all share RF_DEFAULT_NODE_ID sequence too)
+    if (data.dup && cmd != RF_PL_PING && cmd != RF_PL_DHCP_REQUEST)
+      continue;
+
     // decode format
     // return command code validated by payload type size received
     // so if we had a command and the payload does not match
@@ -269,33 +889,67 @@ void rfm_loop(void)
      ppl->rssi = data.rssi; // RSSI of node
      ppl->status = 0;
 
-     driver.setHeaderId(data.seqid);
-     driver.setHeaderFlags(RH_FLAGS_NONE);
-
      // We're on a fast gateway, let node some time
      // To node to set to receive mode before sending response
-     delay(2);
-     driver.setHeaderTo(data.nodeid);
-     driver.send((uint8_t *) ppl, (uint8_t) sizeof(RFPingPayload)) ;
-     driver.waitPacketSent();
+     rfm_tx_queue(data.nodeid, RFM69_NODEID, data.seqid, RH_FLAGS_NONE,
+                  (uint8_t *) ppl, sizeof(RFPingPayload), driver.getLastPreambleTime(), RF_PING_DELAY);
+     rfm_tx_loop();
 
      // Start line with a # (comment)
      // indicate external parser that it's just debug information
-     Serial.print(F("\r\n# -> "));
-     Serial.print(data.nodeid,DEC);
-     Serial.print(F(" PINGBACK ("));
-     Serial.print(ppl->rssi,DEC);
-     Serial.println(F("dB)"));
+     #ifdef RF_DEBUG_VERBOSE
+       Serial.print(F("\r\n# -> "));
+       Serial.print(data.nodeid,DEC);
+       Serial.print(F(" PINGBACK ("));
+       Serial.print(ppl->rssi,DEC);
+       Serial.println(F("dB)"));
+     #endif
+   }
+
+   // node asking for an ID, offer goes back to requesting address
+   if ( cmd==RF_PL_DHCP_REQUEST ) {
+     RFDhcpOfferPayload offer;
+
+     offer.command = RF_PL_DHCP_OFFER;
+     offer.hwid    = ((RFDhcpRequestPayload *) data.buffer)->hwid;
+     offer.nodeid  = rfm_dhcp_request(offer.hwid);
+     offer.groupid = RFM69_NETWORKID;
+     offer.lease   = RF_DHCP_LEASE_DAYS;
+
+     rfm_tx_queue(data.nodeid, RFM69_NODEID, data.seqid, RH_FLAGS_NONE,
+                  (uint8_t *) &offer, sizeof(offer), driver.getLastPreambleTime(), RF_PING_DELAY);
+     rfm_tx_loop();
+
+     #ifdef RF_DEBUG_VERBOSE
+       Serial.print(F("\r\n# -> "));
+       Serial.print(data.nodeid,DEC);
+       Serial.print(F(" DHCP_OFFER "));
+       Serial.println(offer.nodeid,DEC);
+     #endif
    }
 
+   // node telling which firmware blocks it got
+   if ( cmd==RF_PL_OTA_UPDATE )
+     rfota_receive(data.nodeid, data.buffer, data.size);
+
    // Start blue led
    LedRGBON(COLOR_BLUE);
    rf_rgb_led_timer=millis();
 
-   // known Payload ? send frame to serial
-   if (cmd) {
+   // known Payload ? send frame to serial, not firmware update progress
+   // With batches pushed (RFBATCH_PUSH), decoded values are already in
+   // the batch (rfbatch_add)
+   #if !defined (MOD_RF_BATCH) || !defined (RFBATCH_PUSH)
+   if (cmd && !data.dup && cmd != RF_PL_OTA_UPDATE) {
      Serial.println(json_str);
+
+     #ifdef MOD_MQTT
+       char topic[16];
+       sprintf(topic, "rf/%d", data.nodeid);
+       mqtt_publish(topic, json_str);
+     #endif
    }
+   #endif
 
 
    // Display Results only if something new received
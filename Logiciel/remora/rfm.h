@@ -17,7 +17,18 @@
 #define RFM_h
 
 #include "remora.h"
-#include "RH_RF69.h"
+
+#ifdef REMORA_HOST
+  // Simulated radio on a PC, see Logiciel/host/rfsim
+  #include "RH_VirtualRF.h"
+  // rflink.cpp includes RH_RF69.h for its modem table, before us
+  #undef  RH_RF69_MAX_MESSAGE_LEN
+  #define RH_RF69_MAX_MESSAGE_LEN RH_VIRTUALRF_MAX_MESSAGE_LEN
+  typedef RH_VirtualRF RFDriver;
+#else
+  #include "RH_RF69.h"
+  typedef RH_RF69 RFDriver;
+#endif
 
 // You will need to initialize the radio by telling it what ID it has and what network it's on
 // The NodeID takes values from 1-127, 0 is reserved for sending broadcast messages (send to all nodes)
@@ -38,6 +49,64 @@
 
 #define RF_LED_BLINK_MS  150 // Time of RGB LED blink
 
+// Dump of each packet and reply traces on Serial. Serial TX is also the
+// teleinfo line on ESP8266, so they are left out when readings go out
+// in batches. Define RF_DEBUG_VERBOSE to get them anyway
+#ifndef MOD_RF_BATCH
+  #define RF_DEBUG_VERBOSE
+#endif
+
+// Max time to read a packet out of the radio. On Particle this runs in the
+// RF interrupt handler, teleinfo UART receives a char each 8ms at 1200 bps
+#define RF_RX_BUDGET_US 1000
+
+// Max packets taken from the driver queue per loop, so teleinfo and web
+// server still get their turn when several nodes talk at once
+#define RF_RX_BATCH     4
+
+// Replies (ACK, PINGBACK) are queued with a send time and sent from the
+// loop once the radio is done with the previous one, never waiting for it.
+// A reply still queued after ACK_TIME is dropped, node gave up anyway
+#define RF_TX_QUEUE     4   // Replies waiting, power of 2
+#define RF_ACK_DELAY    1   // ms to let node switch to receive before ACK
+#define RF_PING_DELAY   2   // ms to let node switch to receive before PINGBACK
+
+// Reply latency histogram buckets (ms from reception to send), last one
+// is ACK_TIME, the node listening window
+#define RF_REPLY_BUCKETS 6
+
+// Sequence jump above this is a node restart, not lost packets
+#define RF_SEQ_MAX_GAP  32
+
+// Messages for nodes (downlink) wait here and are sent as payload of the
+// ACK of the node's next frame, battery nodes only listen just after
+// sending. A message is removed once the node sends a new sequence ID,
+// and sent again if it retries the same one (ACK lost). Pool is shared
+// by all nodes, when full the oldest one of lowest priority is dropped
+#define RF_DOWN_SLOTS   8   // Messages waiting, all nodes
+#define RF_DOWN_SIZE    32  // Max message size (RFConfigPayload)
+
+// Automatic node ID (DHCP). A new node sends RF_PL_DHCP_REQUEST from
+// RF_DEFAULT_NODE_ID with its hardware ID and gets an ID of the range
+// below in RF_PL_DHCP_OFFER. Lease table is a hash table on hardware ID
+// where slot number gives the node ID, so lookup is O(1) both ways. Any
+// frame from the node renews its lease, expired ones are given to other
+// nodes only when no never used ID is left. Lease clock counts days the
+// gateway has been running, it is saved with the table to survive reboots
+#define RF_DHCP_BITS        7     // Lease table size, power of 2
+#define RF_DHCP_LEASES      (1<<RF_DHCP_BITS)
+#define RF_DHCP_FIRST_ID    100   // IDs 100 to 227, lower ones are manual
+#define RF_DHCP_LEASE_DAYS  30
+#define RF_DHCP_SAVE_DELAY  10000 // ms after last change before EEPROM write
+#define RF_DHCP_MAGIC       0x4C42 // "LB"
+// Lease table goes after fils pilotes state (fp_persist_t, which grows
+// with MCP_NB), on a 16 bytes boundary. Host simulation has no fils pilotes
+#ifdef REMORA_HOST
+  #define RF_DHCP_EEPROM_ADDR 0
+#else
+  #define RF_DHCP_EEPROM_ADDR ((PERSIST_EEPROM_ADDR + sizeof(fp_persist_t) + 15) & ~15)
+#endif
+
 
 // data received by RF module
 // independent from module received
@@ -52,18 +121,80 @@ typedef struct
   uint8_t  checksum; /* Serial checksum*/
   uint8_t  seqid;    /* Sequence ID  */
   uint8_t  ack;      /* do we ACKED  */
+  uint8_t  dup;      /* already got this sequence ID */
   uint8_t  buffer[RH_RF69_MAX_MESSAGE_LEN];
 } RFData;
 
+// Message waiting for a node
+typedef struct
+{
+  uint32_t order;           /* Queueing order, oldest first */
+  uint8_t  nodeid;          /* Destination, 0 if slot is free */
+  uint8_t  prio;            /* Higher sent first */
+  uint8_t  queued;          /* In an ACK waiting in the reply queue */
+  uint8_t  sent;            /* Has been in an ACK sent on air */
+  uint8_t  seqid;           /* ID of the frame that ACK answered */
+  uint8_t  len;             /* Data Size    */
+  uint8_t  buffer[RF_DOWN_SIZE];
+} RFDownData;
+
+// Reply waiting to be sent
+typedef struct
+{
+  unsigned long rxtime;     /* millis() when request was received */
+  unsigned long due;        /* millis() not to send before */
+  uint8_t  to;              /* Header To    */
+  uint8_t  from;            /* Header From  */
+  uint8_t  id;              /* Header Id    */
+  uint8_t  flags;           /* Header Flags */
+  uint8_t  len;             /* Data Size    */
+  int8_t   power;           /* TX power for this node (dBm) */
+  RFDownData * down;        /* Message carried, NULL if none */
+  uint32_t order;           /* Its queueing order, the slot may be reused */
+  uint8_t  buffer[RH_RF69_MAX_MESSAGE_LEN];
+} RFTxData;
+
+// Node ID lease table, as saved in EEPROM
+typedef struct
+{
+  uint16_t magic;
+  uint16_t crc;
+  uint16_t clock;                    /* Lease clock, gateway running days */
+  uint16_t pad;
+  uint32_t hwid[RF_DHCP_LEASES];     /* Node hardware ID, 0 never leased */
+  uint16_t expire[RF_DHCP_LEASES];   /* Lease clock day when lease ends */
+} RFLeaseTable;
+
 // Variables exported to other source file
 // ========================================
 // define RF var for whole project
 extern unsigned long rf_rgb_led_timer;
-extern RH_RF69 driver;
+extern RFDriver driver;
+extern uint32_t rf_rx_over_budget;
+extern const uint8_t rf_reply_bounds[];
+extern uint32_t rf_reply_hist[];
+extern uint32_t rf_reply_sum;
+extern uint32_t rf_reply_expired;
+extern uint32_t rf_down_delivered;
+extern uint32_t rf_down_dropped;
 
 // Function exported for other source file
 // =======================================
 bool rfm_setup(void);
 void rfm_loop(void);
+bool rfm_tx_queue(uint8_t to, uint8_t from, uint8_t id, uint8_t flags,
+                  const uint8_t * buf, uint8_t len, unsigned long rxtime, uint8_t wait,
+                  RFDownData * down = NULL);
+void rfm_tx_loop(void);
+void rfm_tx_power(int8_t power);
+bool rfm_tx_idle(void);
+int8_t rfm_downlink(uint8_t nodeid, uint8_t prio, const uint8_t * buf, uint8_t len);
+uint8_t rfm_downlink_pending(uint8_t nodeid);
+#ifdef SPARK
+int rfsend(String);
+#endif
+int rfsend_cmd(const char * cmd, int len);
+uint8_t rfm_dhcp_request(uint32_t hwid);
+uint8_t rfm_dhcp_leases(void);
 
 #endif
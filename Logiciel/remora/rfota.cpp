@@ -0,0 +1,393 @@
+// **********************************************************************************
+// RF firmware update of ULPNodes source file for remora project
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : Firmware image streamed to a node with RF_PL_OTA_UPDATE payloads
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "./ULPNode_RF_Protocol.h"
+#include "./rfm.h"
+#include "./rfota.h"
+#include "./rflink.h"
+
+#ifdef ESP8266
+  extern "C" {
+    #include "spi_flash.h"
+  }
+  // End of free sketch space, defined by linker
+  extern "C" uint32_t _SPIFFS_start;
+#endif
+
+// Transfer in progress or last one
+RFOtaState rfota;
+
+/* ======================================================================
+Function: rfota_crc
+Purpose : update CRC16 CCITT with some data
+Input   : CRC so far (0xFFFF to start), data and size
+Output  : new CRC
+Comments: same as avr-libc _crc_ccitt_update() used by node
+====================================================================== */
+uint16_t rfota_crc(uint16_t crc, const uint8_t * buf, uint16_t len)
+{
+  while (len--) {
+    uint8_t x = *buf++ ^ (crc & 0xFF);
+
+    x ^= x << 4;
+    crc = ((((uint16_t) x << 8) | (crc >> 8)) ^ (uint8_t) (x >> 4) ^ ((uint16_t) x << 3));
+  }
+  return crc;
+}
+
+/* ======================================================================
+Function: rfota_busy
+Purpose : is a transfer running
+Input   : -
+Output  : true from offer to end of transfer
+Comments: image storage is read all along, it must not be overwritten
+====================================================================== */
+bool rfota_busy(void)
+{
+  return rfota.state == RFOTA_OFFERED || rfota.state == RFOTA_SENDING || rfota.state == RFOTA_WAITING;
+}
+
+/* ======================================================================
+Function: rfota_start
+Purpose : offer a firmware update to a node
+Input   : node ID, image size and function to read it
+Output  : false if an update is running or image is not valid
+Comments: offer goes in the ACK of the node next frame, transfer starts
+          when node answers with a RF_OTA_STATUS
+====================================================================== */
+bool rfota_start(uint8_t nodeid, uint32_t size, RFOtaReader reader)
+{
+  RFOtaStartPayload offer;
+  uint8_t buf[RF_OTA_BLOCK_SIZE];
+  uint16_t crc = 0xFFFF;
+
+  if (rfota_busy())
+    return false;
+
+  if (!nodeid || !size || size > RF_OTA_MAX_SIZE || !reader)
+    return false;
+
+  // CRC of whole image
+  for (uint32_t offset=0; offset<size; offset+=RF_OTA_BLOCK_SIZE) {
+    uint8_t len = size - offset < RF_OTA_BLOCK_SIZE ? size - offset : RF_OTA_BLOCK_SIZE;
+
+    if (!reader(offset, buf, len))
+      return false;
+    crc = rfota_crc(crc, buf, len);
+    _yield();
+  }
+
+  memset(&rfota, 0, sizeof(rfota));
+  rfota.nodeid  = nodeid;
+  rfota.size    = size;
+  rfota.blocks  = (size + RF_OTA_BLOCK_SIZE - 1) / RF_OTA_BLOCK_SIZE;
+  rfota.crc     = crc;
+  rfota.reader  = reader;
+  rfota.bitrate = driver.bitRate();
+
+  offer.command   = RF_PL_OTA_UPDATE;
+  offer.type      = RF_OTA_START;
+  offer.size      = rfota.size;
+  offer.blocks    = rfota.blocks;
+  offer.crc       = rfota.crc;
+  offer.blocksize = RF_OTA_BLOCK_SIZE;
+  offer.window    = RF_OTA_WINDOW;
+
+  // Before anything else waiting for this node
+  if (rfm_downlink(nodeid, 0xFF, (uint8_t *) &offer, sizeof(offer)) < 0)
+    return false;
+
+  rfota.state = RFOTA_OFFERED;
+  rfota.timer = millis();
+
+  Serial.print(F("RF OTA "));
+  Serial.print(size);
+  Serial.print(F(" bytes offered to node "));
+  Serial.println(nodeid);
+
+  return true;
+}
+
+/* ======================================================================
+Function: rfota_end
+Purpose : end transfer and display its figures
+Input   : final state
+Output  : -
+Comments: -
+====================================================================== */
+void rfota_end(uint8_t state)
+{
+  rfota.state = state;
+  rfota.duration = rfota.start ? millis() - rfota.start : 0;
+
+  Serial.print(F("RF OTA node "));
+  Serial.print(rfota.nodeid);
+  Serial.print(state == RFOTA_DONE ? F(" done, ") : F(" failed, "));
+  Serial.print(rfota.size);
+  Serial.print(F(" bytes in "));
+  Serial.print(rfota.duration);
+  Serial.print(F("ms, "));
+  Serial.print(rfota.sent);
+  Serial.print(F(" blocks sent ("));
+  Serial.print(rfota.resent);
+  Serial.print(F(" again), goodput "));
+  Serial.print(rfota_goodput());
+  Serial.print(F(" of "));
+  Serial.print(rfota.bitrate);
+  Serial.println(F(" bps"));
+}
+
+/* ======================================================================
+Function: rfota_receive
+Purpose : handle RF_OTA_STATUS from node
+Input   : node ID, payload and size
+Output  : -
+Comments: a status that moves base or bitmap restarts retries count,
+          one that does not counts as a retry like a status timeout
+====================================================================== */
+void rfota_receive(uint8_t nodeid, const uint8_t * buf, uint8_t len)
+{
+  RFOtaStatusPayload * st = (RFOtaStatusPayload *) buf;
+
+  if (len != sizeof(RFOtaStatusPayload) || st->type != RF_OTA_STATUS || nodeid != rfota.nodeid)
+    return;
+
+  // Node is answering our offer
+  if (rfota.state == RFOTA_OFFERED) {
+    rfota.start = millis();
+  } else if (rfota.state != RFOTA_SENDING && rfota.state != RFOTA_WAITING) {
+    return;
+  }
+
+  if (st->state == RF_OTA_ST_DONE) {
+    rfota.base = st->base;
+    rfota_end(RFOTA_DONE);
+    return;
+  }
+  if (st->state != RF_OTA_ST_RECEIVING || st->base > rfota.blocks) {
+    rfota_end(RFOTA_FAILED);
+    return;
+  }
+
+  if (st->base != rfota.base || st->bitmap != rfota.bitmap) {
+    rfota.retries = 0;
+  } else if (rfota.state != RFOTA_OFFERED && ++rfota.retries > RF_OTA_RETRIES) {
+    // Node answers but gets none of the window
+    rfota_end(RFOTA_FAILED);
+    return;
+  }
+
+  rfota.base   = st->base;
+  rfota.bitmap = st->bitmap;
+  rfota.next   = 0;
+  rfota.state  = RFOTA_SENDING;
+}
+
+/* ======================================================================
+Function: rfota_missing
+Purpose : next block of window node does not have
+Input   : window index to start from
+Output  : window index, RF_OTA_WINDOW if none
+Comments: -
+====================================================================== */
+uint8_t rfota_missing(uint8_t n)
+{
+  for ( ; n < RF_OTA_WINDOW && rfota.base + n < rfota.blocks; n++)
+    if (!(rfota.bitmap & (1UL << n)))
+      return n;
+
+  return RF_OTA_WINDOW;
+}
+
+/* ======================================================================
+Function: rfota_send
+Purpose : send a block to node
+Input   : block number, true if last one before node status
+Output  : -
+Comments: radio is free, checked by caller. Last block asks node for its
+          status, so a window of a few lost blocks does not wait timeout
+====================================================================== */
+void rfota_send(uint16_t block, bool last)
+{
+  RFOtaBlockPayload pl;
+  uint32_t offset = (uint32_t) block * RF_OTA_BLOCK_SIZE;
+  uint8_t len = rfota.size - offset < RF_OTA_BLOCK_SIZE ? rfota.size - offset : RF_OTA_BLOCK_SIZE;
+
+  if (!rfota.reader(offset, pl.data, len)) {
+    rfota_end(RFOTA_FAILED);
+    return;
+  }
+
+  pl.command = RF_PL_OTA_UPDATE;
+  pl.type    = RF_OTA_BLOCK;
+  pl.block   = block;
+
+  rfm_tx_power(rflink_tx_power(rfota.nodeid));
+  driver.setHeaderTo(rfota.nodeid);
+  driver.setHeaderFrom(RFM69_NODEID);
+  driver.setHeaderId(block);
+  driver.setHeaderFlags(last ? RF_PAYLOAD_RESPONSE : RH_FLAGS_NONE, 0xFF);
+  driver.send((uint8_t *) &pl, offsetof(RFOtaBlockPayload, data) + len);
+
+  rfota.sent++;
+  if (block < rfota.top)
+    rfota.resent++;
+  else
+    rfota.top = block + 1;
+}
+
+/* ======================================================================
+Function: rfota_loop
+Purpose : send next missing block, handle timeouts
+Input   : -
+Output  : -
+Comments: called from rfm_loop, one block per call, replies to other
+          nodes (rfm_tx_loop) go first
+====================================================================== */
+void rfota_loop(void)
+{
+  uint8_t n;
+
+  if (rfota.state == RFOTA_OFFERED) {
+    if (millis() - rfota.timer >= RF_OTA_OFFER_TIMEOUT * 1000UL)
+      rfota_end(RFOTA_FAILED);
+    return;
+  }
+
+  // No status from node, send window again
+  if (rfota.state == RFOTA_WAITING) {
+    if (millis() - rfota.timer < RF_OTA_STATUS_TIMEOUT)
+      return;
+
+    if (++rfota.retries > RF_OTA_RETRIES) {
+      rfota_end(RFOTA_FAILED);
+      return;
+    }
+    rfota.next  = 0;
+    rfota.state = RFOTA_SENDING;
+  }
+
+  if (rfota.state != RFOTA_SENDING || !rfm_tx_idle()) {
+    rfota.idle = 0;
+    return;
+  }
+
+  // Let node store previous block
+  if (!rfota.idle)
+    rfota.idle = millis() ? millis() : 1;
+  if (millis() - rfota.idle < RF_OTA_BLOCK_GAP)
+    return;
+  rfota.idle = 0;
+
+  // Next block of window node does not have
+  n = rfota_missing(rfota.next);
+  if (n < RF_OTA_WINDOW) {
+    rfota.next = n + 1;
+    rfota_send(rfota.base + n, rfota_missing(rfota.next) == RF_OTA_WINDOW);
+    return;
+  }
+
+  // Whole window sent
+  rfota.state = RFOTA_WAITING;
+  rfota.timer = millis();
+}
+
+/* ======================================================================
+Function: rfota_goodput
+Purpose : image bits per second of last transfer
+Input   : -
+Output  : goodput (bps), 0 if no transfer done
+Comments: to compare with modem bit rate (rfota.bitrate), difference is
+          frame overhead, block gap, status turnaround and lost blocks
+====================================================================== */
+uint32_t rfota_goodput(void)
+{
+  if (rfota.state != RFOTA_DONE || !rfota.duration)
+    return 0;
+
+  return (uint64_t) rfota.size * 8 * 1000 / rfota.duration;
+}
+
+#ifdef ESP8266
+/* ======================================================================
+Function: rfota_flash_base
+Purpose : flash address of image storage
+Input   : -
+Output  : address, 0 if free sketch space is too small
+Comments: -
+====================================================================== */
+uint32_t rfota_flash_base(void)
+{
+  if (ESP.getFreeSketchSpace() < RF_OTA_MAX_SIZE + RF_OTA_FLASH_SECTOR)
+    return 0;
+
+  return ((uint32_t) &_SPIFFS_start - 0x40200000) - RF_OTA_MAX_SIZE;
+}
+
+/* ======================================================================
+Function: rfota_flash_write
+Purpose : write part of image in flash storage
+Input   : offset in image, data and size
+Output  : false if out of storage or flash error
+Comments: sectors are erased when write reaches them, offset and size
+          must be multiple of 4 but for the end of the image
+====================================================================== */
+bool rfota_flash_write(uint32_t offset, const uint8_t * buf, uint16_t len)
+{
+  uint32_t base = rfota_flash_base();
+  uint32_t word;
+
+  if (!base || offset + len > RF_OTA_MAX_SIZE || (offset & 3))
+    return false;
+
+  while (len) {
+    uint8_t n = len < 4 ? len : 4;
+
+    if (!(offset % RF_OTA_FLASH_SECTOR) &&
+        spi_flash_erase_sector((base + offset) / RF_OTA_FLASH_SECTOR) != SPI_FLASH_RESULT_OK)
+      return false;
+
+    word = 0xFFFFFFFF;
+    memcpy(&word, buf, n);
+    if (spi_flash_write(base + offset, &word, 4) != SPI_FLASH_RESULT_OK)
+      return false;
+
+    buf += n;
+    len -= n;
+    offset += 4;
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: rfota_flash_read
+Purpose : image reader for rfota_start from flash storage
+Input   : offset in image, buffer and size
+Output  : false on flash error
+Comments: flash reads are 4 bytes aligned, blocks are so
+====================================================================== */
+bool rfota_flash_read(uint32_t offset, uint8_t * buf, uint8_t len)
+{
+  uint32_t words[(RF_OTA_BLOCK_SIZE + 3) / 4];
+  uint32_t base = rfota_flash_base();
+
+  if (!base || (offset & 3) || len > sizeof(words))
+    return false;
+
+  if (spi_flash_read(base + offset, words, (len + 3) & ~3) != SPI_FLASH_RESULT_OK)
+    return false;
+
+  memcpy(buf, words, len);
+  return true;
+}
+#endif
@@ -0,0 +1,94 @@
+// **********************************************************************************
+// RF firmware update of ULPNodes headers file for remora project
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// History : Firmware image streamed to a node with RF_PL_OTA_UPDATE payloads
+//
+// Gateway offers the update in the ACK of a node frame (RF_OTA_START, see
+// rfm_downlink), node stays awake and sends RF_OTA_STATUS: first block it
+// misses and a bitmap of the blocks it already has after that one. Gateway
+// sends the missing blocks of the window starting there, then waits next
+// status, asked by RF_PAYLOAD_RESPONSE flag on the last block sent.
+// Window slides as node gets blocks, lost ones are sent again only.
+// Node checks CRC16 of the whole image once it has all blocks.
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef RFOTA_h
+#define RFOTA_h
+
+#include "remora.h"
+
+// Transfer timings
+#define RF_OTA_BLOCK_GAP        2     // ms between blocks, node stores block
+#define RF_OTA_STATUS_TIMEOUT   300   // ms to wait node status after a window
+#define RF_OTA_RETRIES          10    // windows sent again without progress
+#define RF_OTA_OFFER_TIMEOUT    3600  // s for node to answer RF_OTA_START
+#define RF_OTA_MAX_SIZE         32768 // ATmega328P flash
+
+// Image storage on ESP8266, last RF_OTA_MAX_SIZE bytes of free sketch
+// space (below SPIFFS area used by flashlog). ESP8266 Updater writes new
+// sketch at the end of free space too, so remora OTA is refused while a
+// node transfer runs (rfota_busy) and overwrites a stored image otherwise
+#define RF_OTA_FLASH_SECTOR     4096
+
+// Transfer state
+enum rfota_state_e {
+  RFOTA_IDLE,     // Nothing to do
+  RFOTA_OFFERED,  // RF_OTA_START waiting in node downlink queue
+  RFOTA_SENDING,  // Sending missing blocks of window
+  RFOTA_WAITING,  // Window sent, waiting node status
+  RFOTA_DONE,     // Node got the image with good CRC
+  RFOTA_FAILED    // Node gave up, CRC error or no answer
+};
+
+// Firmware image source, read len bytes at offset into buf
+typedef bool (*RFOtaReader)(uint32_t offset, uint8_t * buf, uint8_t len);
+
+// Transfer in progress or last one
+typedef struct
+{
+  uint8_t  state;         /* rfota_state_e */
+  uint8_t  nodeid;        /* Node updated */
+  uint8_t  retries;       /* Windows sent again without progress */
+  uint8_t  next;          /* Next window index to send */
+  uint16_t blocks;        /* Image size in blocks */
+  uint16_t base;          /* First block node is missing */
+  uint16_t top;           /* Highest block sent + 1 */
+  uint16_t crc;           /* Image CRC16 */
+  uint32_t size;          /* Image size */
+  uint32_t bitmap;        /* Window blocks node already has */
+  unsigned long timer;    /* millis() of offer or end of window */
+  unsigned long idle;     /* millis() radio got free, 0 if not yet */
+  unsigned long start;    /* millis() node accepted the offer */
+  uint32_t duration;      /* Transfer time (ms) */
+  uint32_t sent;          /* Block frames sent */
+  uint32_t resent;        /* Of which were sent again */
+  uint32_t bitrate;       /* Modem bit rate (bps) */
+  RFOtaReader reader;
+} RFOtaState;
+
+// Variables exported to other source file
+// ========================================
+extern RFOtaState rfota;
+
+// Function exported for other source file
+// =======================================
+uint16_t rfota_crc(uint16_t crc, const uint8_t * buf, uint16_t len);
+bool rfota_busy(void);
+bool rfota_start(uint8_t nodeid, uint32_t size, RFOtaReader reader);
+void rfota_receive(uint8_t nodeid, const uint8_t * buf, uint8_t len);
+void rfota_loop(void);
+uint32_t rfota_goodput(void);
+#ifdef ESP8266
+uint32_t rfota_flash_base(void);
+bool rfota_flash_write(uint32_t offset, const uint8_t * buf, uint16_t len);
+bool rfota_flash_read(uint32_t offset, uint8_t * buf, uint8_t len);
+#endif
+
+#endif
@@ -65,55 +65,9 @@ void handleRoot(void)
 
   Serial.print(F("OK!"));
 }
+#endif
 
-/* ======================================================================
-Function: formatNumberJSON
-Purpose : check if data value is full number and send correct JSON format
-Input   : String where to add response
-          char * value to check
-Output  : -
-Comments: 00150 => 150
-          ADCO  => "ADCO"
-          1     => 1
-====================================================================== */
 #ifdef ESP8266
-void formatNumberJSON( String &response, char * value)
-{
-  // we have at least something ?
-  if (value && strlen(value))
-  {
-    boolean isNumber = true;
-    uint8_t c;
-    char * p = value;
-
-    // just to be sure
-    if (strlen(p)<=16) {
-      // check if value is number
-      while (*p && isNumber) {
-        if ( *p < '0' || *p > '9' )
-          isNumber = false;
-        p++;
-      }
-
-      // this will add "" on not number values
-      if (!isNumber) {
-        response += '\"' ;
-        response += value ;
-        response += F("\":") ;
-      } else {
-        // this will remove leading zero on numbers
-        p = value;
-        while (*p=='0' && *(p+1) )
-          p++;
-        response += p ;
-      }
-    } else {
-      Serial.println(F("formatNumberJSON error!"));
-    }
-  }
-}
-
-
 /* ======================================================================
 Function: tinfoJSONTable
 Purpose : dump all teleinfo values in JSON table format for browser
@@ -206,6 +160,7 @@ void tinfoJSONTable(void)
   } else {
     Serial.println(F("sending 404..."));
     server.send ( 404, "text/plain", "No data" );
+    return;
   }
   Serial.print(F("sending..."));
   server.send ( 200, "text/json", response );
@@ -216,124 +171,262 @@ void tinfoJSONTable(void)
 /* ======================================================================
 Function: sendJSON
 Purpose : dump all values in JSON
-Input   : linked list pointer on the concerned data
-          true to dump all values, false for only modified ones
+Input   : -
 Output  : -
-Comments: -
+Comments: JSON is built by tinfo_json_build() only when frame changed,
+          client with matching If-None-Match gets a 304 without body
 ====================================================================== */
 void sendJSON(void)
 {
-  ValueList * me = tinfo.getList();
-  String response = "";
+  // Got at least one frame ?
+  if (!tinfo_json_len) {
+    server.send ( 404, "text/plain", "No data" );
+    return;
+  }
 
-  // Got at least one ?
-  if (me) {
-    // Json start
-    response += F("{\"_UPTIME\":");
-    response += seconds;
+  server.sendHeader("ETag", tinfo_etag);
+  server.sendHeader("Cache-Control", "no-cache");
 
-    // Loop thru the node
-    while (me->next) {
+  // Nothing new since last poll of this client
+  if (server.header("If-None-Match") == tinfo_etag) {
+    server.send ( 304, "text/json", "" );
+    return;
+  }
 
-      // we're there
-      ESP.wdtFeed();
+  // Headers first, then the cached buffer as is, no String copy
+  server.setContentLength(tinfo_json_len);
+  server.send ( 200, "text/json", "" );
+  server.client().write((const uint8_t *) tinfo_json, tinfo_json_len);
+}
 
-      // go to next node
-      me = me->next;
+/* ======================================================================
+Function: handleStats
+Purpose : dump consumption rollups in JSON
+Input   : -
+Output  : -
+Comments: /stats?p=m|h|d&n=count, newest first, default is all minutes
+          "t" is rollup start in seconds of uptime, periods are aligned
+          on uptime, not on wall clock. Periods without teleinfo frame
+          are kept, with "nb":0
+====================================================================== */
+void handleStats(void)
+{
+  char buff[STATS_JSON_SIZE];
+  String response = "";
+  uint8_t level = STATS_MINUTE;
+  int count = 255;
+  stats_t * s;
 
-      response += F(",\"") ;
-      response += me->name ;
-      response += F("\":") ;
-      formatNumberJSON(response, me->value);
+  if (server.hasArg("p")) {
+    if (server.arg("p") == "h") level = STATS_HOUR;
+    if (server.arg("p") == "d") level = STATS_DAY;
+  }
+  if (server.hasArg("n"))
+    count = server.arg("n").toInt();
+
+  // Format each rollup in a small buffer, the whole table
+  // could be too large for a single stack buffer
+  response += '[';
+  for (uint8_t age=0; age<count && (s=stats_get(level, age))!=NULL; age++) {
+    ESP.wdtFeed();
+    if (stats_json_entry(buff, sizeof(buff), s)) {
+      if (age)
+        response += ',';
+      response += buff;
     }
-   // Json end
-   response += F("}\r\n") ;
-
-  } else {
-    server.send ( 404, "text/plain", "No data" );
   }
+  response += F("]\r\n");
+
   server.send ( 200, "text/json", response );
 }
 
 /* ======================================================================
-Function: handleNotFound
-Purpose : default WEB routing when URI is not found
-Input   : linked list pointer on the concerned data
-          true to dump all values, false for only modified ones
+Function: handleMetrics
+Purpose : Prometheus scrape endpoint
+Input   : -
 Output  : -
-Comments: We search is we have a name that match to this URI, if one we
-          return it's pair name/value in json
+Comments: text is patched in place by metrics_text(), sent as is
 ====================================================================== */
-void handleNotFound(void)
+#ifdef MOD_METRICS
+void handleMetrics(void)
 {
-  String response = "";
+  uint16_t len;
+  const char * text = metrics_text(&len);
 
-  // We check for an known label
-  ValueList * me = tinfo.getList();
-  const char * uri;
-  boolean found = false;
+  server.setContentLength(len);
+  server.send ( 200, METRICS_CONTENT_TYPE, "" );
+  server.client().write((const uint8_t *) text, len);
+}
+#endif
 
-  // Led on
-  LedBluON();
+/* ======================================================================
+Function: handleRfBatch
+Purpose : dernier lot de relevés RF envoyé, au format binaire
+Input   : -
+Output  : -
+Comments: 204 tant qu'aucun lot n'a été envoyé (voir rfbatch.h)
+====================================================================== */
+#ifdef MOD_RF_BATCH
+void handleRfBatch(void)
+{
+  uint16_t len;
+  const uint8_t * batch = rfbatch_last(&len);
 
-  // convert uri to char * for compare
-  uri = server.uri().c_str();
+  if (!batch) {
+    server.send ( 204, "text/plain", "" );
+    return;
+  }
 
-  Serial.printf("handleNotFound(%s)\r\n", uri);
+  server.setContentLength(len);
+  server.send ( 200, RFBATCH_CONTENT_TYPE, "" );
+  server.client().write(batch, len);
+}
+#endif
 
-  // Got at least one and consistent URI ?
-  if (me && uri && *uri=='/' && *++uri ) {
+/* ======================================================================
+Function: handleRfOtaUpload
+Purpose : store firmware image for a node, sent with POST /rfota
+Input   : -
+Output  : -
+Comments: written in flash as it comes, see handleRfOta for the end
+====================================================================== */
+#ifdef MOD_RF69
+uint32_t rfota_upload_size = 0;
+bool rfota_upload_ok = false;
 
-    // Loop thru the linked list of values
-    while (me->next && !found) {
+void handleRfOtaUpload(void)
+{
+  HTTPUpload& upload = server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    // Image is read all along the transfer, don't overwrite it
+    rfota_upload_size = 0;
+    rfota_upload_ok = !rfota_busy();
+  } else if (upload.status == UPLOAD_FILE_WRITE && rfota_upload_ok) {
+    rfota_upload_ok = rfota_flash_write(rfota_upload_size, upload.buf, upload.currentSize);
+    rfota_upload_size += upload.currentSize;
+    ESP.wdtFeed();
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    rfota_upload_ok = false;
+  }
+}
 
-      // we're there
-      ESP.wdtFeed();
+/* ======================================================================
+Function: handleRfOta
+Purpose : firmware update of a RF node
+Input   : -
+Output  : -
+Comments: GET /rfota => last transfer state in JSON
+          POST /rfota?node=12 with image file => offered to node 12,
+          sent when it answers. ex:
+          curl -F "image=@firmware.bin" http://remora/rfota?node=12
+====================================================================== */
+void handleRfOta(void)
+{
+  char buff[256];
+  bool ok;
 
-      // go to next node
-      me = me->next;
+  if (server.method() == HTTP_POST) {
+    int node = server.arg("node").toInt();
 
-      //Debugf("compare to '%s' ", me->name);
-      // Do we have this one ?
-      if (stricmp (me->name, uri) == 0 )
-      {
-        // no need to continue
-        found = true;
-
-        // Add to respone
-        response += F("{\"") ;
-        response += me->name ;
-        response += F("\":") ;
-        formatNumberJSON(response, me->value);
-        response += F("}\r\n");
-      }
-    }
+    ok = rfota_upload_ok && node > 0 && node < RH_BROADCAST_ADDRESS &&
+         rfota_start(node, rfota_upload_size, rfota_flash_read);
+    rfota_upload_ok = false;
+
+    server.send ( ok ? 200 : 400, "text/json", ok ? "{\"return_value\":0}\r\n" : "{\"return_value\":-1}\r\n" );
+    return;
   }
 
-  // Got it, send json
-  if (found) {
-    server.send ( 200, "text/json", response );
-  } else {
-    // send error message in plain text
-    String message = "File Not Found\n\n";
-    message += "URI: ";
-    message += server.uri();
-    message += "\nMethod: ";
-    message += ( server.method() == HTTP_GET ) ? "GET" : "POST";
-    message += "\nArguments: ";
-    message += server.args();
-    message += "\n";
-
-    for ( uint8_t i = 0; i < server.args(); i++ ) {
-      message += " " + server.argName ( i ) + ": " + server.arg ( i ) + "\n";
-    }
+  snprintf_P(buff, sizeof(buff),
+             PSTR("{\"node\":%u,\"state\":%u,\"size\":%lu,\"blocks\":%u,\"block\":%u,"
+                  "\"sent\":%lu,\"resent\":%lu,\"duration\":%lu,\"goodput\":%lu,\"bitrate\":%lu}\r\n"),
+             rfota.nodeid, rfota.state, (unsigned long) rfota.size, rfota.blocks, rfota.base,
+             (unsigned long) rfota.sent, (unsigned long) rfota.resent, (unsigned long) rfota.duration,
+             (unsigned long) rfota_goodput(), (unsigned long) rfota.bitrate);
 
-    server.send ( 404, "text/plain", message );
+  server.send ( 200, "text/json", buff );
+}
+#endif
+
+/* ======================================================================
+Function: handleLog
+Purpose : stream flash log records, one JSON object per line
+Input   : -
+Output  : -
+Comments: /log?from=seq, records are read and sent by small chunks so
+          the whole log never sits in RAM
+====================================================================== */
+#ifdef MOD_FLASHLOG
+void handleLog(void)
+{
+  char buff[512];
+  int len = 0;
+  int n;
+  flashlog_cursor_t cur;
+  flashlog_rec_t rec;
+
+  flashlog_rewind(&cur, server.hasArg("from") ? server.arg("from").toInt() : 0);
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send ( 200, "text/plain", "" );
+
+  while (flashlog_next(&cur, &rec)) {
+    n = flashlog_format(buff+len, sizeof(buff)-len, &rec);
+
+    // buffer full, drop the partial record, send the rest and retry
+    if (!n) {
+      buff[len] = '\0';
+      server.sendContent(String(buff));
+      len = 0;
+      ESP.wdtFeed();
+      n = flashlog_format(buff, sizeof(buff), &rec);
+    }
+    len += n;
   }
 
-  // Led off
-  LedBluOFF();
+  if (len)
+    server.sendContent(String(buff));
 }
 #endif
 
+/* ======================================================================
+Function: handleNotFound
+Purpose : default WEB routing when URI is not found
+Input   : -
+Output  : -
+Comments: We search is we have a label that match to this URI, if one we
+          return it's pair name/value in json, taken from the index built
+          with /json data (see tinfo_json_label)
+====================================================================== */
+void handleNotFound(void)
+{
+  char buff[64];
+  const char * label;
+  uint16_t len;
+  int n;
+
+  // Reference, no copy with core returning a const String &
+  const String & uri = server.uri();
+
+  // Led on
+  LedRGBON(COLOR_BLUE);
+
+  // Got a consistent URI and this label ?
+  if (uri.length() > 1 && (label = tinfo_json_label(uri.c_str()+1, &len)) != NULL &&
+      (n = snprintf(buff, sizeof(buff), "{%.*s}\r\n", len, label)) < (int) sizeof(buff)) {
+    server.send ( 200, "text/json", buff );
+  } else {
+    // Fixed answer written as is, no String for the many bad URIs
+    static const char notfound[] = "HTTP/1.1 404 Not Found\r\n"
+                                   "Content-Type: text/plain\r\n"
+                                   "Content-Length: 11\r\n"
+                                   "Connection: close\r\n\r\n"
+                                   "Not found\r\n";
+
+    server.client().write((const uint8_t *) notfound, sizeof(notfound)-1);
+  }
+
+  // Led off
+  LedRGBOFF();
+}
 #endif
@@ -38,5 +38,11 @@ extern uint16_t response_idx;
 void handleNotFound(void);
 void tinfoJSONTable(void);
 void sendJSON(void);
+void handleStats(void);
+void handleMetrics(void);
+void handleLog(void);
+void handleRfOta(void);
+void handleRfOtaUpload(void);
+void handleRfBatch(void);
 
 #endif
@@ -0,0 +1,395 @@
+// **********************************************************************************
+// Agrégats de consommation management file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Calcul au fil de l'eau des min/max/moyenne de PAPP et IINST,
+//           des consommations par période tarifaire et des ADPS par minute,
+//           heure et jour
+//
+// Chaque trame téléinfo met à jour uniquement l'agrégat en cours de chaque
+// niveau (coût constant), aucune trame n'est conservée. La moyenne est
+// calculée à la lecture à partir de la somme et du nombre de trames.
+// **********************************************************************************
+
+#include "stats.h"
+
+// Table circulaire d'un niveau d'agrégation
+typedef struct
+{
+  stats_t * table;        // Agrégats
+  uint8_t   size;         // Nombre d'agrégats de la table
+  uint8_t   idx;          // Agrégat en cours
+  uint8_t   count;        // Nombre d'agrégats valides
+  unsigned long period;   // Durée d'un agrégat en secondes
+} stats_ring_t;
+
+stats_t stats_minutes[STATS_NB_MINUTES];
+stats_t stats_hours[STATS_NB_HOURS];
+stats_t stats_days[STATS_NB_DAYS];
+
+stats_ring_t stats_rings[STATS_NB_LEVELS] = {
+  { stats_minutes, STATS_NB_MINUTES, 0, 0,    60L },
+  { stats_hours,   STATS_NB_HOURS,   0, 0,  3600L },
+  { stats_days,    STATS_NB_DAYS,    0, 0, 86400L }
+};
+
+// Etiquettes d'index connues et compteur (slot) associé
+// Base et EJP n'utilisent que les 2 premiers, Tempo les 6
+const char * const stats_labels[] = {
+  "BASE", "HCHC", "HCHP", "EJPHN", "EJPHPM",
+  "BBRHCJB", "BBRHPJB", "BBRHCJW", "BBRHPJW", "BBRHCJR", "BBRHPJR"
+};
+const uint8_t stats_label_slot[] = { 0, 0, 1, 0, 1, 0, 1, 2, 3, 4, 5 };
+
+#define STATS_NB_LABELS (sizeof(stats_label_slot)/sizeof(stats_label_slot[0]))
+
+// Dernière valeur d'index reçue par étiquette
+uint32_t stats_last_index[STATS_NB_LABELS];
+
+// Nom de l'étiquette associée à chaque slot, pour l'affichage
+const char * stats_slot_name[STATS_NB_SLOTS];
+
+// Dernier agrégat minute, heure et jour au format JSON
+char mystats[STATS_JSON_SIZE] = "{}";
+
+/* ======================================================================
+Function: stats_reset
+Purpose : initialise un agrégat
+Input   : pointeur sur l'agrégat
+          début de la période (secondes d'uptime)
+Output  : -
+Comments: -
+====================================================================== */
+void stats_reset(stats_t * s, unsigned long start)
+{
+  memset(s, 0, sizeof(stats_t));
+  s->start = start;
+  s->papp_min  = 0xFFFF;
+  s->iinst_min = 0xFF;
+}
+
+/* ======================================================================
+Function: stats_current
+Purpose : retourne l'agrégat en cours d'un niveau
+Input   : niveau d'agrégation (STATS_MINUTE, STATS_HOUR, STATS_DAY)
+Output  : pointeur sur l'agrégat en cours
+Comments: avance d'un agrégat par période écoulée, les périodes sans
+          trame (téléinfo coupée) restent vides (nb à 0). Les périodes
+          sont alignées sur l'uptime, pas sur l'heure
+====================================================================== */
+stats_t * stats_current(uint8_t level)
+{
+  stats_ring_t * r = &stats_rings[level];
+  unsigned long start = uptime - (uptime % r->period);
+  unsigned long last = r->table[r->idx].start;
+  unsigned long n;
+
+  if (last == start)
+    return &r->table[r->idx];
+
+  // Au-delà de la taille de la table tout est écrasé
+  n = (start - last) / r->period;
+  if (n > r->size)
+    n = r->size;
+
+  // Périodes écoulées, on écrase les plus anciens agrégats
+  while (n--) {
+    r->idx = (r->idx + 1) % r->size;
+    if (r->count < r->size)
+      r->count++;
+    stats_reset(&r->table[r->idx], start - n * r->period);
+  }
+
+  return &r->table[r->idx];
+}
+
+/* ======================================================================
+Function: stats_get
+Purpose : retourne un agrégat
+Input   : niveau d'agrégation (STATS_MINUTE, STATS_HOUR, STATS_DAY)
+          age de l'agrégat (0 pour celui en cours, 1 le précédent, ...)
+Output  : pointeur sur l'agrégat, NULL si il n'existe pas
+Comments: -
+====================================================================== */
+stats_t * stats_get(uint8_t level, uint8_t age)
+{
+  stats_ring_t * r;
+
+  if (level >= STATS_NB_LEVELS)
+    return NULL;
+
+  r = &stats_rings[level];
+
+  if (age >= r->count)
+    return NULL;
+
+  return &r->table[(r->idx + r->size - age) % r->size];
+}
+
+/* ======================================================================
+Function: stats_json_entry
+Purpose : formate un agrégat en JSON
+Input   : buffer de destination et sa taille
+          pointeur sur l'agrégat
+Output  : nombre de caractères écrits, 0 si le buffer est trop petit
+Comments: {"t":3600,"nb":40,"papp":[min,moy,max],"iinst":[min,moy,max],
+           "adps":0,"wh":{"HCHC":12,"HCHP":0}}
+====================================================================== */
+int stats_json_entry(char * buff, int size, stats_t * s)
+{
+  int len;
+  uint16_t papp_min  = s->nb ? s->papp_min  : 0;
+  uint8_t  iinst_min = s->nb ? s->iinst_min : 0;
+
+  if (size <= 0)
+    return 0;
+
+  len = snprintf(buff, size,
+                 "{\"t\":%lu,\"nb\":%u,\"papp\":[%u,%lu,%u],\"iinst\":[%u,%lu,%u],\"adps\":%u,\"wh\":{",
+                 s->start, s->nb,
+                 papp_min,  s->nb ? (unsigned long) (s->papp_sum/s->nb)  : 0UL, s->papp_max,
+                 iinst_min, s->nb ? (unsigned long) (s->iinst_sum/s->nb) : 0UL, s->iinst_max,
+                 s->adps);
+
+  // Uniquement les compteurs utilisés par le contrat
+  for (uint8_t i=0; i<STATS_NB_SLOTS && len<size; i++) {
+    if (stats_slot_name[i])
+      len += snprintf(buff+len, size-len, "%s\"%s\":%lu",
+                      buff[len-1]=='{' ? "" : ",", stats_slot_name[i], (unsigned long) s->wh[i]);
+  }
+
+  if (len < size)
+    len += snprintf(buff+len, size-len, "}}");
+
+  // Tronqué, on ne retourne rien
+  if (len >= size) {
+    *buff = '\0';
+    return 0;
+  }
+
+  return len;
+}
+
+/* ======================================================================
+Function: stats_json
+Purpose : formate les derniers agrégats d'un niveau en tableau JSON
+Input   : buffer de destination et sa taille
+          niveau d'agrégation (STATS_MINUTE, STATS_HOUR, STATS_DAY)
+          nombre d'agrégats voulus, le plus récent en premier
+Output  : nombre de caractères écrits
+Comments: on s'arrête au dernier agrégat complet qui tient dans le buffer
+====================================================================== */
+int stats_json(char * buff, int size, uint8_t level, uint8_t count)
+{
+  stats_t * s;
+  int len = 0;
+  int n;
+
+  if (size < 3)
+    return 0;
+
+  buff[len++] = '[';
+
+  // on garde 2 caractères pour "]\0"
+  for (uint8_t age=0; age<count && (s=stats_get(level, age))!=NULL; age++) {
+    if (age)
+      buff[len++] = ',';
+
+    n = stats_json_entry(buff+len, size-len-2, s);
+    if (!n) {
+      // pas la place, on retire la virgule
+      if (age)
+        len--;
+      break;
+    }
+    len += n;
+  }
+
+  buff[len++] = ']';
+  buff[len] = '\0';
+
+  return len;
+}
+
+/* ======================================================================
+Function: stats_publish
+Purpose : met à jour la variable cloud des agrégats
+Input   : -
+Output  : -
+Comments: dernière minute complète, heure et jour en cours
+====================================================================== */
+void stats_publish(void)
+{
+  stats_t * s;
+  int len = 0;
+  int n;
+  uint8_t level, age;
+
+  mystats[len++] = '{';
+
+  for (level=STATS_MINUTE; level<STATS_NB_LEVELS; level++) {
+    // la minute en cours vient de commencer
+    age = level==STATS_MINUTE ? 1 : 0;
+
+    if ((s=stats_get(level, age)) == NULL)
+      continue;
+
+    if (len>1)
+      mystats[len++] = ',';
+
+    len += sprintf(mystats+len, "\"%c\":", "mhd"[level]);
+
+    n = stats_json_entry(mystats+len, STATS_JSON_SIZE-len-2, s);
+    len += n ? n : sprintf(mystats+len, "null");
+  }
+
+  mystats[len++] = '}';
+  mystats[len] = '\0';
+}
+
+#ifdef MOD_FLASHLOG
+/* ======================================================================
+Function: stats_log_minute
+Purpose : enregistre un agrégat minute dans le journal en flash
+Input   : agrégat
+Output  : -
+Comments: -
+====================================================================== */
+void stats_log_minute(stats_t * s)
+{
+  flashlog_minute_t m;
+
+  if (!s || !s->nb)
+    return;
+
+  m.minute    = s->start / 60;
+  m.nb        = s->nb   > 255 ? 255 : s->nb;
+  m.adps      = s->adps > 255 ? 255 : s->adps;
+  m.papp_min  = s->papp_min;
+  m.papp_avg  = s->papp_sum / s->nb;
+  m.papp_max  = s->papp_max;
+  m.iinst_min = s->iinst_min;
+  m.iinst_max = s->iinst_max;
+  for (uint8_t i=0; i<6; i++)
+    m.wh[i] = s->wh[i] > 0xFFFF ? 0xFFFF : s->wh[i];
+
+  flashlog_append(FLASHLOG_MINUTE, &m, sizeof(m));
+}
+#endif
+
+/* ======================================================================
+Function: stats_frame
+Purpose : agrège une trame téléinfo complète
+Input   : -
+Output  : -
+Comments: à appeler depuis les callback de fin de trame, PAPP et IINST
+          sont alors à jour
+====================================================================== */
+void stats_frame(void)
+{
+  uint8_t minute = stats_rings[STATS_MINUTE].idx;
+  stats_t * s;
+
+  for (uint8_t level=STATS_MINUTE; level<STATS_NB_LEVELS; level++) {
+    s = stats_current(level);
+
+    if (s->nb < 0xFFFF) {
+      s->nb++;
+      s->papp_sum  += mypApp;
+      s->iinst_sum += myiInst;
+    }
+    if (mypApp  < s->papp_min)  s->papp_min  = mypApp;
+    if (mypApp  > s->papp_max)  s->papp_max  = mypApp;
+    if (myiInst < s->iinst_min) s->iinst_min = myiInst;
+    if (myiInst > s->iinst_max) s->iinst_max = myiInst;
+  }
+
+  // Nouvelle minute, la précédente est complète
+  if (minute != stats_rings[STATS_MINUTE].idx) {
+    stats_publish();
+
+    #ifdef MOD_FLASHLOG
+      stats_log_minute(stats_get(STATS_MINUTE, 1));
+    #endif
+  }
+}
+
+/* ======================================================================
+Function: stats_adps
+Purpose : comptabilise un ADPS
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void stats_adps(void)
+{
+  stats_t * s;
+
+  for (uint8_t level=STATS_MINUTE; level<STATS_NB_LEVELS; level++) {
+    s = stats_current(level);
+    if (s->adps < 0xFFFF)
+      s->adps++;
+  }
+}
+
+/* ======================================================================
+Function: stats_index
+Purpose : comptabilise la consommation à partir des index
+Input   : nom de l'étiquette
+          valeur de l'étiquette
+Output  : -
+Comments: à appeler depuis le callback de données pour chaque étiquette
+          nouvelle ou modifiée, les autres sont ignorées
+====================================================================== */
+void stats_index(const char * name, const char * value)
+{
+  uint32_t index, delta;
+  uint8_t slot;
+  uint8_t i;
+
+  // Toutes les étiquettes d'index commencent par B, H ou E
+  if (*name!='B' && *name!='H' && *name!='E')
+    return;
+
+  for (i=0; i<STATS_NB_LABELS; i++) {
+    if (!strcmp(name, stats_labels[i]))
+      break;
+  }
+
+  if (i == STATS_NB_LABELS)
+    return;
+
+  index = atol(value);
+  slot  = stats_label_slot[i];
+  stats_slot_name[slot] = stats_labels[i];
+
+  // 1ere valeur ou index revenu en arrière (changement de compteur)
+  // on repart de cette valeur sans rien comptabiliser
+  if (stats_last_index[i] && index >= stats_last_index[i]) {
+    delta = index - stats_last_index[i];
+    for (uint8_t level=STATS_MINUTE; level<STATS_NB_LEVELS; level++)
+      stats_current(level)->wh[slot] += delta;
+  }
+
+  stats_last_index[i] = index;
+}
+
+/* ======================================================================
+Function: stats_setup
+Purpose : prepare and init stuff, configuration, ..
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void stats_setup(void)
+{
+  for (uint8_t level=STATS_MINUTE; level<STATS_NB_LEVELS; level++) {
+    stats_ring_t * r = &stats_rings[level];
+
+    r->idx = 0;
+    r->count = 1;
+    stats_reset(&r->table[0], uptime - (uptime % r->period));
+  }
+}
@@ -0,0 +1,63 @@
+// **********************************************************************************
+// Agrégats de consommation header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : Calcul au fil de l'eau des min/max/moyenne de PAPP et IINST,
+//           des consommations par période tarifaire et des ADPS par minute,
+//           heure et jour
+//
+// **********************************************************************************
+#ifndef STATS_h
+#define STATS_h
+
+#include "remora.h"
+
+// Taille des tables circulaires
+// 60 minutes, 24 heures et 7 jours glissants
+#define STATS_NB_MINUTES  60
+#define STATS_NB_HOURS    24
+#define STATS_NB_DAYS      7
+
+// Nombre de compteurs d'index par agrégat
+// le contrat Tempo en utilise 6 (HC/HP Bleu, Blanc et Rouge)
+#define STATS_NB_SLOTS     6
+
+// Taille du buffer JSON exposé via le cloud
+// (622 caractères au maximum pour une variable Particle)
+#define STATS_JSON_SIZE  600
+
+// Niveaux d'agrégation
+enum stats_level_e { STATS_MINUTE = 0, STATS_HOUR, STATS_DAY, STATS_NB_LEVELS };
+
+// Un agrégat (une minute, une heure ou un jour)
+typedef struct
+{
+  unsigned long start;          // Début de la période (secondes d'uptime)
+  uint16_t nb;                  // Nombre de trames agrégées
+  uint16_t adps;                // Nombre d'ADPS reçus
+  uint16_t papp_min;            // Puissance apparente (VA)
+  uint16_t papp_max;
+  uint32_t papp_sum;
+  uint8_t  iinst_min;           // Intensité instantanée (A)
+  uint8_t  iinst_max;
+  uint32_t iinst_sum;
+  uint32_t wh[STATS_NB_SLOTS];  // Consommation (Wh) par période tarifaire
+} stats_t;
+
+// Variables exported to other source file
+// ========================================
+extern char mystats[];
+
+// Function exported for other source file
+// =======================================
+void      stats_setup(void);
+void      stats_frame(void);
+void      stats_adps(void);
+void      stats_index(const char * name, const char * value);
+stats_t * stats_get(uint8_t level, uint8_t age);
+int       stats_json_entry(char * buff, int size, stats_t * s);
+int       stats_json(char * buff, int size, uint8_t level, uint8_t count);
+
+#endif
@@ -37,6 +37,14 @@ int etatrelais       = 0; // Etat du relais
 unsigned long tinfo_led_timer = 0; // Led blink timer
 unsigned long tinfo_last_frame = 0; // dernière fois qu'on a recu une trame valide
 
+char     tinfo_json[TINFO_JSON_SIZE]; // Dernière trame en JSON
+uint16_t tinfo_json_len = 0;
+uint32_t tinfo_json_seq = 0;          // Numéro de la trame en JSON
+uint16_t tinfo_boot;                  // Identifiant du démarrage
+char     tinfo_etag[TINFO_ETAG_SIZE] = "";
+tinfo_index_t tinfo_index[TINFO_INDEX_SIZE];
+uint8_t  tinfo_label_max = 0;         // Plus longue étiquette indexée
+
 ptec_e ptec; // Puissance tarifaire en cours
 
 /* ======================================================================
@@ -65,6 +73,9 @@ void ADPSCallback(uint8_t phase)
     Serial.println('0' + phase);
   }
 
+  // Comptabiliser l'ADPS dans les agrégats
+  stats_adps();
+
   // nous avons une téléinfo fonctionelle
   status |= STATUS_TINFO;
   tinfo_last_frame = millis();
@@ -114,12 +125,173 @@ void DataCallback(ValueList * me, uint8_t flags)
   if (!strcmp(me->name, "ISOUSC")) myisousc  = atoi(me->value);
   if (!strcmp(me->name, "IMAX"))   myimax    = atoi(me->value);
 
+  // Consommation par période tarifaire pour les agrégats
+  if (flags & (TINFO_FLAGS_ADDED | TINFO_FLAGS_UPDATED)) {
+    stats_index(me->name, me->value);
+
+    // Seules les étiquettes modifiées sont poussées aux abonnés
+    #ifdef MOD_WEBAPI
+      webapi_event("tinfo", "{\"%s\":\"%s\"}", me->name, me->value);
+    #endif
+  }
+
   Serial.println();
 
   // nous avons une téléinfo fonctionelle
   status |= STATUS_TINFO;
 }
 
+/* ======================================================================
+Function: tinfo_json_value
+Purpose : ajoute une valeur au JSON, en nombre si elle est numérique
+Input   : position d'écriture, fin du tampon, valeur
+Output  : nouvelle position, NULL si le tampon est plein
+Comments: 00150 => 150, HC.. => "HC.."
+====================================================================== */
+char * tinfo_json_value(char * p, char * end, const char * value)
+{
+  const char * v = value;
+  int len;
+
+  while (*v >= '0' && *v <= '9')
+    v++;
+
+  if (*value && !*v) {
+    // Suppression des zéros non significatifs
+    while (*value == '0' && value[1])
+      value++;
+    len = snprintf(p, end-p, "%s", value);
+  } else {
+    len = snprintf(p, end-p, "\"%s\"", value);
+  }
+
+  return len < end-p ? p+len : NULL;
+}
+
+/* ======================================================================
+Function: tinfo_hash
+Purpose : hash d'une étiquette, sans tenir compte de la casse
+Input   : étiquette, taille
+Output  : hash, jamais 0
+Comments: FNV-1a replié sur 16 bits
+====================================================================== */
+uint16_t tinfo_hash(const char * name, uint8_t len)
+{
+  uint32_t h = 2166136261UL;
+
+  while (len--) {
+    h ^= (uint8_t) tolower(*name++);
+    h *= 16777619UL;
+  }
+  h ^= h >> 16;
+  return h ? h : 1;
+}
+
+/* ======================================================================
+Function: tinfo_index_add
+Purpose : indexe une étiquette de tinfo_json
+Input   : position du "ETIQUETTE":valeur dans tinfo_json et sa taille
+Output  : -
+Comments: adressage ouvert, l'index est vidé à chaque reconstruction
+====================================================================== */
+void tinfo_index_add(char * p, uint16_t len)
+{
+  uint8_t lgname = strchr(p+1, '"') - (p+1);
+  uint16_t hash = tinfo_hash(p+1, lgname);
+  uint8_t i = hash & (TINFO_INDEX_SIZE-1);
+  uint8_t n;
+
+  if (lgname > tinfo_label_max)
+    tinfo_label_max = lgname;
+
+  for (n=0; n<TINFO_INDEX_SIZE/2; n++, i = (i+1) & (TINFO_INDEX_SIZE-1)) {
+    if (!tinfo_index[i].len) {
+      tinfo_index[i].hash = hash;
+      tinfo_index[i].pos = p - tinfo_json;
+      tinfo_index[i].len = len;
+      return;
+    }
+  }
+  // Index plein, l'étiquette ne sera pas servie seule
+}
+
+/* ======================================================================
+Function: tinfo_json_label
+Purpose : cherche une étiquette dans la dernière trame JSON
+Input   : étiquette (casse indifférente), taille trouvée
+Output  : pointeur sur "ETIQUETTE":valeur dans tinfo_json, NULL sinon
+Comments: pas de parcours de la liste chaînée ni d'allocation. Un nom
+          plus long que toutes les étiquettes (URI quelconque) est
+          rejeté sans calcul
+====================================================================== */
+const char * tinfo_json_label(const char * name, uint16_t * len)
+{
+  size_t lgname = strlen(name);
+  uint16_t hash;
+  uint8_t i;
+  uint8_t n;
+  char * p;
+
+  if (!lgname || lgname > tinfo_label_max)
+    return NULL;
+
+  hash = tinfo_hash(name, lgname);
+  i = hash & (TINFO_INDEX_SIZE-1);
+
+  for (n=0; n<TINFO_INDEX_SIZE/2 && tinfo_index[i].len; n++, i = (i+1) & (TINFO_INDEX_SIZE-1)) {
+    p = tinfo_json + tinfo_index[i].pos;
+    if (tinfo_index[i].hash == hash && !strncasecmp(p+1, name, lgname) && p[1+lgname] == '"') {
+      *len = tinfo_index[i].len;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/* ======================================================================
+Function: tinfo_json_build
+Purpose : sérialise la trame complète dans tinfo_json
+Input   : linked list pointer on the concerned data
+Output  : -
+Comments: appelée seulement sur trame modifiée, l'ETag change avec le
+          numéro de trame et le démarrage, une requête sans nouvelle
+          trame ne coûte alors qu'une comparaison. L'index des étiquettes
+          est refait en même temps, les positions ayant pu changer
+====================================================================== */
+void tinfo_json_build(ValueList * me)
+{
+  char * p = tinfo_json;
+  char * end = tinfo_json + sizeof(tinfo_json) - 3;
+  char * next;
+  int len;
+
+  memset(tinfo_index, 0, sizeof(tinfo_index));
+  tinfo_label_max = 0;
+
+  // _UPTIME est celui de la trame, pas celui de la requête
+  len = snprintf(p, end-p, "{\"_UPTIME\":%lu", uptime);
+  p += len;
+
+  while (me->next) {
+    me = me->next;
+    len = snprintf(p, end-p, ",\"%s\":", me->name);
+    next = len < end-p ? tinfo_json_value(p+len, end, me->value) : NULL;
+
+    // Trame trop grande, on s'arrête à la dernière étiquette complète
+    if (!next) {
+      Serial.println(F("tinfo_json_build overflow!"));
+      break;
+    }
+    tinfo_index_add(p+1, next - (p+1));
+    p = next;
+  }
+
+  // Place réservée pour la fin
+  strcpy(p, "}\r\n");
+  tinfo_json_len = p + 3 - tinfo_json;
+  sprintf(tinfo_etag, "\"%04x-%lx\"", tinfo_boot, (unsigned long) ++tinfo_json_seq);
+}
+
 /* ======================================================================
 Function: NewFrame
 Purpose : callback when we received a complete teleinfo frame
@@ -144,6 +316,14 @@ void NewFrame(ValueList * me)
   #endif
   //Serial.println(buff);
 
+  // Mise à jour des agrégats minute/heure/jour
+  stats_frame();
+
+  // Publication des étiquettes modifiées
+  #ifdef MOD_MQTT
+    mqtt_tinfo(me);
+  #endif
+
   // Ok nous avons une téléinfo fonctionelle
   status |= STATUS_TINFO;
   tinfo_last_frame = millis();
@@ -174,6 +354,21 @@ void UpdatedFrame(ValueList * me)
   #endif
   //Serial.println(buff);
 
+  // Mise à jour des agrégats minute/heure/jour
+  stats_frame();
+
+  // Publication des étiquettes modifiées
+  #ifdef MOD_MQTT
+    mqtt_tinfo(me);
+  #endif
+
+  // Diffusion de la trame modifiée
+  #ifdef MOD_MCAST
+    mcast_frame(me);
+  #endif
+
+  // Réponse de /json
+  tinfo_json_build(me);
 
   myDelestLimit = myisousc * ratio_delestage;
 
@@ -211,6 +406,9 @@ bool tinfo_setup(bool wait_data)
   // reset du timeout de detection de la teleinfo
   tinfo_last_frame = millis();
 
+  // Les ETag d'un démarrage précédent ne doivent pas correspondre
+  tinfo_boot = bootId();
+
   // Init teleinfo
   tinfo.init();
 
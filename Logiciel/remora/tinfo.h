@@ -24,6 +24,22 @@
 #define IMAX 35 // sera mis à jour à la reception de trame teleinfo
 #define TINFO_LED_BLINK_MS  150 // Time of RGB LED blink
 
+// Trame complète au format JSON, reconstruite uniquement quand une
+// étiquette change et servie telle quelle par /json
+#define TINFO_JSON_SIZE    1024
+#define TINFO_ETAG_SIZE      20
+
+// Index des étiquettes dans tinfo_json pour /PAPP, /IINST...
+// (puissance de 2, au moins le double du nombre d'étiquettes)
+#define TINFO_INDEX_SIZE     64
+
+typedef struct
+{
+  uint16_t hash;    // Hash de l'étiquette en minuscules
+  uint16_t pos;     // Position de "ETIQUETTE":valeur dans tinfo_json
+  uint16_t len;     // Taille, 0 si libre
+} tinfo_index_t;
+
 // Tarif en cours au format numérique
 enum ptec_e { PTEC_HP = 1, PTEC_HC = 2 };
 
@@ -43,10 +59,16 @@ extern char myAction[];
 extern int      etatrelais;
 extern float    myDelestLimit;
 extern float    myRelestLimit;
+extern unsigned long tinfo_last_frame;
+extern char     tinfo_json[];
+extern uint16_t tinfo_json_len;   // 0 tant qu'aucune trame n'est reçue
+extern uint32_t tinfo_json_seq;
+extern char     tinfo_etag[];
 
 // Function exported for other source file
 // =======================================
 bool tinfo_setup(bool);
+const char * tinfo_json_label(const char * name, uint16_t * len);
 void tinfo_loop();
 
 #endif
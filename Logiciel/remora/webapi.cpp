@@ -0,0 +1,504 @@
+// **********************************************************************************
+// API HTTP locale pour remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : API HTTP sur le réseau local, mêmes commandes que les fonctions
+//           et variables du cloud Particle sans passer par api.spark.io
+//
+//           GET  /fp            => état des fils pilotes, délestage et
+//                                  zones en attente de montée en charge
+//           POST /fp/<cmd>      => fonction fp (ex: /fp/CCCEEHH)
+//           POST /setfp/<cmd>   => fonction setfp (ex: /setfp/3C)
+//           GET  /relais        => état du relais
+//           POST /relais/<cmd>  => fonction relais (ex: /relais/1)
+//           POST /rfsend/<cmd>  => message pour un noeud RF, envoyé dans
+//                                  l'ACK de sa prochaine trame (MOD_RF69)
+//                                  noeud,priorité,hexa (ex: /rfsend/12,1,0401)
+//           GET  /tinfo         => variable tinfo
+//           GET  /metrics       => métriques Prometheus (MOD_METRICS)
+//           GET  /rfbatch       => dernier lot de relevés RF envoyé, 204
+//                                  tant qu'il n'y en a pas (MOD_RF_BATCH)
+//           GET  /events        => flux Server-Sent Events des étiquettes
+//                                  téléinfo modifiées (tinfo), des zones
+//                                  (fp), du délestage (delest) et du
+//                                  relais (relais), 503 si plus de place
+//                                  (WEBAPI_EVENTS_SUBS, aucune sur Particle)
+//
+//           La commande peut aussi être passée dans le corps de la requête
+//           comme avec le cloud (params=3C). GET est accepté pour les
+//           commandes. Les fonctions répondent {"return_value":n}
+//
+//           Les connexions restent ouvertes (HTTP/1.1 keep-alive) pour que
+//           les requêtes suivantes ne paient pas l'ouverture TCP
+//
+// **********************************************************************************
+
+#include <stdarg.h>
+#include "webapi.h"
+
+WEBAPI_SERVER_T webapi_server(WEBAPI_PORT);
+webapi_client_t webapi_clients[WEBAPI_CLIENTS];
+
+// Flux d'événements commun à tous les abonnés
+char webapi_ev_buf[WEBAPI_EVENTS_SIZE];
+uint32_t webapi_ev_head = 0;      // Octets écrits depuis le démarrage
+uint8_t webapi_ev_subs = 0;       // Nombre d'abonnés
+unsigned long webapi_ev_last = 0; // Date du dernier événement
+
+/* ======================================================================
+Function: webapi_event
+Purpose : publie un événement à tous les abonnés de /events
+Input   : nom de l'événement (NULL pour un commentaire), format printf
+          des données et ses arguments
+Output  : -
+Comments: encodé une seule fois dans le flux commun, envoyé à chaque
+          abonné par webapi_loop. Rien n'est fait sans abonné
+====================================================================== */
+void webapi_event(const char * event, const char * fmt, ...)
+{
+  char buff[WEBAPI_EVENT_MAX];
+  va_list args;
+  uint16_t pos, n;
+  int len;
+
+  if (!webapi_ev_subs)
+    return;
+
+  if (event) {
+    len = snprintf(buff, sizeof(buff), "event: %s\ndata: ", event);
+    va_start(args, fmt);
+    len += vsnprintf(buff+len, sizeof(buff)-len, fmt, args);
+    va_end(args);
+    // Evénement tronqué, on ne l'envoie pas plutôt qu'un JSON invalide
+    if (len > (int) sizeof(buff)-3)
+      return;
+    strcpy(buff+len, "\n\n");
+    len += 2;
+  } else {
+    strcpy(buff, ":\n\n");
+    len = 3;
+  }
+
+  // Copie dans le tampon circulaire, en 2 fois s'il reboucle
+  pos = webapi_ev_head % WEBAPI_EVENTS_SIZE;
+  n = min(len, WEBAPI_EVENTS_SIZE - pos);
+  memcpy(webapi_ev_buf+pos, buff, n);
+  memcpy(webapi_ev_buf, buff+n, len-n);
+  webapi_ev_head += len;
+  webapi_ev_last = millis();
+}
+
+/* ======================================================================
+Function: webapi_flush
+Purpose : envoie à un abonné les événements qu'il n'a pas encore reçus
+Input   : connexion
+Output  : false si l'abonné a trop de retard et doit être fermé
+Comments: -
+====================================================================== */
+bool webapi_flush(webapi_client_t * c)
+{
+  uint32_t pending = webapi_ev_head - c->ev_pos;
+  uint16_t pos, n;
+
+  // Les événements non lus ont été écrasés
+  if (pending > WEBAPI_EVENTS_SIZE)
+    return false;
+
+  while (pending) {
+    pos = c->ev_pos % WEBAPI_EVENTS_SIZE;
+    n = min(pending, (uint32_t) (WEBAPI_EVENTS_SIZE - pos));
+    n = c->client.write((const uint8_t *) webapi_ev_buf+pos, n);
+    if (!n)
+      break;
+    c->ev_pos += n;
+    pending -= n;
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: webapi_decode
+Purpose : décode les %XX et + d'un paramètre, sur place
+Input   : chaîne à décoder
+Output  : taille de la chaîne décodée
+Comments: -
+====================================================================== */
+int webapi_decode(char * str)
+{
+  char * in = str;
+  char * out = str;
+
+  while (*in) {
+    if (*in == '%' && isxdigit(in[1]) && isxdigit(in[2])) {
+      char hex[3] = { in[1], in[2], '\0' };
+      *out++ = (char) strtol(hex, NULL, 16);
+      in += 3;
+    } else {
+      *out++ = *in == '+' ? ' ' : *in;
+      in++;
+    }
+  }
+  *out = '\0';
+  return out - str;
+}
+
+/* ======================================================================
+Function: webapi_send
+Purpose : envoie une réponse complète en un seul appel
+Input   : connexion, code HTTP, corps de la réponse
+Output  : -
+Comments: entête et corps dans le même segment TCP
+====================================================================== */
+void webapi_send(webapi_client_t * c, int code, const char * body)
+{
+  char buff[WEBAPI_RESP_SIZE];
+  int len;
+
+  len = snprintf(buff, sizeof(buff),
+                 "HTTP/1.1 %d %s\r\n"
+                 "Content-Type: application/json\r\n"
+                 "Content-Length: %d\r\n"
+                 "Connection: %s\r\n\r\n%s",
+                 code, code==200 ? "OK" : code==204 ? "No Content" : code==400 ? "Bad Request" :
+                       code==503 ? "Service Unavailable" : "Not Found",
+                 (int) strlen(body), c->close ? "close" : "keep-alive", body);
+
+  if (len >= (int) sizeof(buff))
+    len = sizeof(buff) - 1;
+
+  c->client.write((const uint8_t *) buff, len);
+}
+
+/* ======================================================================
+Function: webapi_send_text
+Purpose : envoie une réponse 200 dont le corps est déjà prêt
+Input   : connexion, type du contenu, corps et sa taille
+Output  : -
+Comments: pour les corps trop grands pour webapi_send, sans copie
+====================================================================== */
+void webapi_send_text(webapi_client_t * c, const char * type, const char * body, uint16_t len)
+{
+  char buff[WEBAPI_LINE_SIZE];
+  int n;
+
+  n = snprintf(buff, sizeof(buff),
+               "HTTP/1.1 200 OK\r\n"
+               "Content-Type: %s\r\n"
+               "Content-Length: %u\r\n"
+               "Connection: %s\r\n\r\n",
+               type, len, c->close ? "close" : "keep-alive");
+
+  c->client.write((const uint8_t *) buff, n);
+  c->client.write((const uint8_t *) body, len);
+}
+
+/* ======================================================================
+Function: webapi_route
+Purpose : exécute une requête
+Input   : connexion, chemin (modifié), corps éventuel
+Output  : -
+Comments: -
+====================================================================== */
+void webapi_route(webapi_client_t * c, char * path, char * body)
+{
+  char resp[WEBAPI_RESP_SIZE/2];
+  char * arg;
+  int len = 0;
+  int code = 200;
+
+  // Pas de paramètres d'URL, /setfp?3C équivaut à /setfp/3C
+  arg = strpbrk(path+1, "/?");
+  if (arg) {
+    *arg++ = '\0';
+    len = webapi_decode(arg);
+  }
+
+  // Sinon la commande est dans le corps, comme pour le cloud
+  if (!len && body && *body) {
+    arg = strncmp(body, "params=", 7) ? body : body+7;
+    len = webapi_decode(arg);
+  }
+
+  if (!strcmp(path, "/events") && webapi_ev_subs >= WEBAPI_EVENTS_SUBS) {
+    // Un abonné de plus bloquerait l'API zones et relais
+    code = 503;
+    strcpy(resp, "{}");
+  } else if (!strcmp(path, "/events")) {
+    // La connexion devient un abonné, elle ne reçoit plus de requête
+    const char * head = "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: text/event-stream\r\n"
+                        "Cache-Control: no-cache\r\n\r\n";
+
+    c->client.write((const uint8_t *) head, strlen(head));
+    c->state = WEBAPI_EVENTS;
+    c->ev_pos = webapi_ev_head;
+    webapi_ev_subs++;
+    return;
+  } else if (!strcmp(path, "/fp")) {
+    if (len)
+      sprintf(resp, "{\"return_value\":%d}", fp_cmd(arg, len));
+    else
+      sprintf(resp, "{\"etatfp\":\"%s\",\"memfp\":\"%s\",\"nivdelest\":%d,\"rampe\":%d}",
+              etatFP, memFP, nivDelest, rampCount);
+  } else if (!strcmp(path, "/setfp")) {
+    if (len) {
+      sprintf(resp, "{\"return_value\":%d}", setfp_cmd(arg, len));
+    } else {
+      code = 400;
+      strcpy(resp, "{}");
+    }
+  #ifndef REMORA_BOARD_V10
+  } else if (!strcmp(path, "/relais")) {
+    if (len)
+      sprintf(resp, "{\"return_value\":%d}", relais_cmd(arg, len));
+    else
+      sprintf(resp, "{\"etatrelais\":%d}", etatrelais);
+  #endif
+  #ifdef MOD_RF69
+  } else if (!strcmp(path, "/rfsend")) {
+    if (len) {
+      sprintf(resp, "{\"return_value\":%d}", rfsend_cmd(arg, len));
+    } else {
+      code = 400;
+      strcpy(resp, "{}");
+    }
+  #endif
+  #ifdef MOD_TELEINFO
+  } else if (!strcmp(path, "/tinfo")) {
+    webapi_send(c, 200, mytinfo);
+    return;
+  #endif
+  #ifdef MOD_METRICS
+  } else if (!strcmp(path, "/metrics")) {
+    uint16_t n;
+    const char * text = metrics_text(&n);
+
+    webapi_send_text(c, METRICS_CONTENT_TYPE, text, n);
+    return;
+  #endif
+  #ifdef MOD_RF_BATCH
+  } else if (!strcmp(path, "/rfbatch")) {
+    uint16_t n;
+    const uint8_t * batch = rfbatch_last(&n);
+
+    if (!batch) {
+      webapi_send(c, 204, "");
+      return;
+    }
+
+    webapi_send_text(c, RFBATCH_CONTENT_TYPE, (const char *) batch, n);
+    return;
+  #endif
+  } else {
+    code = 404;
+    strcpy(resp, "{}");
+  }
+
+  webapi_send(c, code, resp);
+}
+
+/* ======================================================================
+Function: webapi_request
+Purpose : traite une requête reçue en entier
+Input   : connexion, corps de la requête ou NULL
+Output  : -
+Comments: la ligne de requête est "METHODE /chemin HTTP/1.x"
+====================================================================== */
+void webapi_request(webapi_client_t * c, char * body)
+{
+  char * path = strchr(c->req, ' ');
+  char * proto;
+
+  if (!path) {
+    c->close = true;
+    webapi_send(c, 400, "{}");
+    return;
+  }
+
+  path++;
+  proto = strchr(path, ' ');
+  if (proto) {
+    *proto++ = '\0';
+    // HTTP/1.0 ferme par défaut
+    if (!strcmp(proto, "HTTP/1.0"))
+      c->close = true;
+  }
+
+  webapi_route(c, path, body);
+}
+
+/* ======================================================================
+Function: webapi_header
+Purpose : analyse une ligne d'entête
+Input   : connexion, ligne sans CR/LF
+Output  : -
+Comments: seuls Connection et Content-Length sont utilisés
+====================================================================== */
+void webapi_header(webapi_client_t * c, char * line)
+{
+  if (!strncasecmp(line, "Connection:", 11)) {
+    line += 11;
+    while (*line==' ')
+      line++;
+    c->close = !strcasecmp(line, "close");
+  } else if (!strncasecmp(line, "Content-Length:", 15)) {
+    c->body = atoi(line+15);
+    if (c->body < 0)
+      c->body = 0;
+  }
+}
+
+/* ======================================================================
+Function: webapi_read
+Purpose : lit les données disponibles sur une connexion
+Input   : connexion
+Output  : -
+Comments: non bloquant, la requête est traitée dès qu'elle est complète
+====================================================================== */
+void webapi_read(webapi_client_t * c)
+{
+  int ch;
+
+  while (c->client.available()) {
+    ch = c->client.read();
+    if (ch < 0)
+      break;
+
+    c->last = millis();
+
+    // Un abonné n'envoie plus rien d'utile
+    if (c->state == WEBAPI_EVENTS)
+      continue;
+
+    // Corps de la requête, gardé dans line
+    if (c->state == WEBAPI_BODY) {
+      if (c->len < WEBAPI_LINE_SIZE-1)
+        c->line[c->len++] = ch;
+      if (--c->body == 0) {
+        c->line[c->len] = '\0';
+        c->state = WEBAPI_REQ;
+        webapi_request(c, c->line);
+        c->len = 0;
+      }
+      continue;
+    }
+
+    if (ch == '\r')
+      continue;
+
+    if (ch != '\n') {
+      if (c->len < WEBAPI_LINE_SIZE-1)
+        c->line[c->len++] = ch;
+      continue;
+    }
+
+    c->line[c->len] = '\0';
+
+    if (c->state == WEBAPI_REQ) {
+      // Ligne de requête, on ignore les lignes vides qui la précèdent
+      if (c->len) {
+        strcpy(c->req, c->line);
+        c->body = 0;
+        c->state = WEBAPI_HEADER;
+      }
+    } else if (c->len) {
+      webapi_header(c, c->line);
+    } else if (c->body > 0) {
+      // Fin de l'entête, le corps suit
+      c->state = WEBAPI_BODY;
+    } else {
+      // Fin de l'entête, requête sans corps
+      c->state = WEBAPI_REQ;
+      webapi_request(c, NULL);
+    }
+    c->len = 0;
+  }
+}
+
+/* ======================================================================
+Function: webapi_setup
+Purpose : démarre le serveur
+Input   : -
+Output  : -
+Comments: à appeler une fois le réseau disponible et à chaque
+          reconnexion, les connexions d'avant sont alors perdues
+====================================================================== */
+void webapi_setup(void)
+{
+  for (uint8_t i=0; i<WEBAPI_CLIENTS; i++) {
+    if (webapi_clients[i].used)
+      webapi_clients[i].client.stop();
+    webapi_clients[i].used = false;
+  }
+  webapi_ev_subs = 0;
+
+  webapi_server.stop();
+  webapi_server.begin();
+  #ifdef ESP8266
+    webapi_server.setNoDelay(true);
+  #endif
+
+  Serial.print("API locale sur le port ");
+  Serial.println(WEBAPI_PORT);
+}
+
+/* ======================================================================
+Function: webapi_loop
+Purpose : accepte les connexions et traite les requêtes
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void webapi_loop(void)
+{
+  webapi_client_t * c;
+
+  // Nouvelle connexion s'il reste une place
+  for (uint8_t i=0; i<WEBAPI_CLIENTS; i++) {
+    if (!webapi_clients[i].used) {
+      WEBAPI_CLIENT_T client = webapi_server.available();
+
+      if (client) {
+        c = &webapi_clients[i];
+        c->client = client;
+        c->used = true;
+        c->last = millis();
+        c->len = 0;
+        c->state = WEBAPI_REQ;
+        c->close = false;
+      }
+      break;
+    }
+  }
+
+  for (uint8_t i=0; i<WEBAPI_CLIENTS; i++) {
+    c = &webapi_clients[i];
+    if (!c->used)
+      continue;
+
+    webapi_read(c);
+
+    if (c->state == WEBAPI_EVENTS) {
+      // Abonné déconnecté ou trop en retard
+      if (!c->client.connected() || !webapi_flush(c)) {
+        c->client.stop();
+        c->used = false;
+        webapi_ev_subs--;
+      }
+      continue;
+    }
+
+    // Fermée par le client, inactive ou à fermer après la réponse
+    if (!c->client.connected() || (c->close && c->state==WEBAPI_REQ) ||
+        millis()-c->last > WEBAPI_TIMEOUT) {
+      c->client.stop();
+      c->used = false;
+    }
+  }
+
+  // Les abonnés détectent ainsi une connexion perdue
+  if (webapi_ev_subs && millis()-webapi_ev_last > WEBAPI_KEEPALIVE)
+    webapi_event(NULL, NULL);
+}
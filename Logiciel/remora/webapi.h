@@ -0,0 +1,71 @@
+// **********************************************************************************
+// API HTTP locale header file for remora project
+// **********************************************************************************
+// Copyright (C) 2014 Thibault Ducret
+// Licence MIT
+//
+// History : API HTTP sur le réseau local, mêmes commandes que les fonctions
+//           et variables du cloud Particle sans passer par api.spark.io
+//
+// **********************************************************************************
+#ifndef WEBAPI_h
+#define WEBAPI_h
+
+#include "remora.h"
+
+// Le port 80 est pris par le serveur WEB sur ESP8266
+#ifdef SPARK
+  #define WEBAPI_PORT     80
+  #define WEBAPI_CLIENTS   1  // TCPServer ne suit qu'un client à la fois
+  #define WEBAPI_CLIENT_T TCPClient
+  #define WEBAPI_SERVER_T TCPServer
+#endif
+#ifdef ESP8266
+  #define WEBAPI_PORT   8080
+  #define WEBAPI_CLIENTS   4
+  #define WEBAPI_CLIENT_T WiFiClient
+  #define WEBAPI_SERVER_T WiFiServer
+#endif
+
+// Connexion fermée après WEBAPI_TIMEOUT ms sans requête (keep-alive)
+#define WEBAPI_TIMEOUT   5000
+// Taille maximale d'une ligne de la requête (les plus longues sont tronquées)
+#define WEBAPI_LINE_SIZE  128
+// Taille maximale d'une réponse, entête compris
+#define WEBAPI_RESP_SIZE  400
+
+// Flux d'événements (/events) : les événements sont encodés une seule fois
+// dans un tampon circulaire commun, chaque abonné n'a que sa position de
+// lecture. Un abonné en retard de plus d'un tampon est déconnecté
+#define WEBAPI_EVENTS_SIZE  1024
+#define WEBAPI_EVENT_MAX     160  // Taille maximale d'un événement encodé
+#define WEBAPI_KEEPALIVE   15000  // Commentaire envoyé aux abonnés sans événement (ms)
+// Abonnés au plus, la dernière connexion reste pour les requêtes. Pas de
+// flux d'événements sur Particle où il n'y a qu'une connexion
+#define WEBAPI_EVENTS_SUBS  (WEBAPI_CLIENTS - 1)
+
+// Etape de lecture d'une requête
+enum webapi_state_e { WEBAPI_REQ, WEBAPI_HEADER, WEBAPI_BODY, WEBAPI_EVENTS };
+
+// Une connexion en cours
+typedef struct
+{
+  WEBAPI_CLIENT_T client;
+  unsigned long   last;                       // Dernière activité (millis)
+  char            req[WEBAPI_LINE_SIZE];      // Ligne de requête
+  char            line[WEBAPI_LINE_SIZE];     // Ligne en cours de lecture
+  uint8_t         len;                        // Taille de line
+  uint8_t         state;                      // webapi_state_e
+  int16_t         body;                       // Octets de corps restant à lire
+  uint32_t        ev_pos;                     // Position dans le flux d'événements
+  bool            close;                      // Fermer après la réponse
+  bool            used;
+} webapi_client_t;
+
+// Function exported for other source file
+// =======================================
+void webapi_setup(void);
+void webapi_loop(void);
+void webapi_event(const char * event, const char * fmt, ...);
+
+#endif